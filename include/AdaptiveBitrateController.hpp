@@ -0,0 +1,72 @@
+#ifndef RTSP_PROXY_ADAPTIVE_BITRATE_CONTROLLER_HPP
+#define RTSP_PROXY_ADAPTIVE_BITRATE_CONTROLLER_HPP
+
+// Project headers
+#include <RtspProxyConfig.hpp>
+
+namespace rtsp_proxy_server {
+
+/**
+ * \brief One observation of the output path health
+ */
+struct BitrateSample {
+    /** worst fraction of lost packets (0..1) reported by the clients */
+    double loss = 0.;
+
+    /** worst inter-arrival jitter in milliseconds reported by the clients */
+    double jitterMs = 0.;
+
+    /** encoder input queue fill level (0..1) */
+    double queueFill = 0.;
+};
+
+/**
+ * \brief Decides the output encoder bitrate from periodic samples
+ *
+ * The controller steps the bitrate down multiplicatively after
+ * 'downSamples' consecutive congested samples, and steps it up additively
+ * after 'upSamples' consecutive healthy samples. Samples between the low and
+ * high thresholds reset both counters, so the bitrate does not oscillate
+ * around a single threshold.
+ */
+class AdaptiveBitrateController {
+public:
+    /**
+     * \brief Constructor
+     *
+     * \param[in] config adaptive bitrate settings
+     * \param[in] initialKbps current bitrate of the encoder
+     */
+    AdaptiveBitrateController(
+        AdaptiveBitrateConfig const& config,
+        uint initialKbps);
+
+    /**
+     * \brief Feed a new sample to the controller
+     *
+     * \return true if the bitrate has changed and should be applied
+     */
+    bool update(BitrateSample const& sample);
+
+    /**
+     * \brief Get the bitrate the encoder should run at, in kbit/s
+     */
+    uint getBitrate() const { return m_bitrate; }
+
+private:
+    /** controller settings */
+    AdaptiveBitrateConfig m_config;
+
+    /** current bitrate in kbit/s */
+    uint m_bitrate = 0;
+
+    /** number of consecutive congested samples */
+    uint m_congestedCount = 0;
+
+    /** number of consecutive healthy samples */
+    uint m_healthyCount = 0;
+};
+
+} // end of namespace
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef RTSP_PROXY_ADAPTIVE_JITTER_CONTROLLER_HPP
+#define RTSP_PROXY_ADAPTIVE_JITTER_CONTROLLER_HPP
+
+// STL headers
+#include <cstdint>
+
+// Project headers
+#include <RtspProxyConfig.hpp>
+
+namespace rtsp_proxy_server {
+
+/**
+ * \brief Jitter buffer activity of one camera during one sampling interval
+ */
+struct JitterSample {
+    /** packets pushed out of the jitter buffer in time */
+    uint64_t pushed = 0;
+
+    /** packets given up on, because they never arrived or arrived late */
+    uint64_t lost = 0;
+
+    /** packets arriving after they were given up on */
+    uint64_t late = 0;
+
+    /** average inter-arrival jitter in milliseconds */
+    double jitterMs = 0.;
+};
+
+/**
+ * \brief Decides the jitter buffer latency of a camera from periodic samples
+ *
+ * Packets arriving late mean the buffer is too short for the link, so the
+ * latency is at least doubled on a sample with too many late packets. After
+ * 'downSamples' consecutive healthy samples it is lowered by one step. The
+ * latency never goes below a multiple of the measured jitter, so it settles
+ * at the smallest value the link supports. Packets which never arrive at all
+ * are not a reason to buffer more and only count as lost.
+ */
+class AdaptiveJitterController {
+public:
+    /**
+     * \brief Constructor
+     *
+     * \param[in] config adaptive jitter buffer settings
+     */
+    explicit AdaptiveJitterController(JitterBufferConfig const& config);
+
+    /**
+     * \brief Feed a new sample to the controller
+     *
+     * \return true if the latency has changed and should be applied
+     */
+    bool update(JitterSample const& sample);
+
+    /**
+     * \brief Get the latency the jitter buffer should run with, in
+     *        milliseconds
+     */
+    uint getLatency() const { return m_latency; }
+
+private:
+    /** controller settings */
+    JitterBufferConfig m_config;
+
+    /** current latency in milliseconds */
+    uint m_latency = 0;
+
+    /** number of consecutive healthy samples */
+    uint m_healthyCount = 0;
+};
+
+} // end of namespace
+
+#endif
@@ -0,0 +1,181 @@
+#ifndef RTSP_PROXY_ANALYTICS_ENGINE_HPP
+#define RTSP_PROXY_ANALYTICS_ENGINE_HPP
+
+// STL headers
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Project headers
+#include <RtspProxyConfig.hpp>
+#include <OpenCvReader.hpp>
+
+namespace rtsp_proxy_server {
+
+/**
+ * \brief Area of a camera frame with motion, as fractions (0..1) of the
+ *        frame dimensions
+ */
+struct MotionBox {
+    double x = 0.;
+    double y = 0.;
+    double width = 0.;
+    double height = 0.;
+};
+
+/**
+ * \brief Latest analysis of one camera
+ */
+struct AnalyticsResult {
+    /** number of frames analysed since the camera was attached */
+    uint64_t frames = 0;
+
+    /** fraction (0..1) of the frame with motion */
+    double motion = 0.;
+
+    /** areas with motion */
+    std::vector<MotionBox> boxes;
+
+    /** when the analysed frame was offered */
+    std::chrono::steady_clock::time_point time;
+};
+
+/**
+ * \brief Motion detection on the camera frames, off the output path
+ *
+ * Camera readers offer every decoded frame. A frame is only taken if the
+ * camera's rate allows it, its previous frame has been analysed and the
+ * queue has room, otherwise it is dropped right away. Taking a frame only
+ * takes a reference to the decoded buffer. The frames are scaled down and
+ * compared with the camera's previous analysed frame by a fixed pool of
+ * worker threads.
+ */
+class AnalyticsEngine {
+public:
+    /**
+     * \brief Constructor. Starts the worker threads.
+     *
+     * \param[in] config analytics settings
+     * \param[in] placement CPU placement of the worker threads
+     */
+    AnalyticsEngine(
+        AnalyticsConfig const& config,
+        ThreadRoleConfig const& placement = ThreadRoleConfig());
+
+    /**
+     * \brief Destructor
+     *
+     * Drops the waiting frames and joins the worker threads.
+     */
+    ~AnalyticsEngine();
+
+    /**
+     * \brief Start over with a number of cameras, dropping the results and
+     *        the state of the previous ones
+     */
+    void setCameras(size_t num);
+
+    /**
+     * \brief Offer a decoded frame of a camera. Called from the reader
+     *        threads, never blocks.
+     */
+    void offer(size_t cam, CvMatPtr const& frame);
+
+    /**
+     * \brief Get the latest result of each camera, by camera index
+     */
+    std::vector<AnalyticsResult> getResults() const;
+
+    /**
+     * \brief Format the latest results as JSON
+     */
+    std::string formatJson() const;
+
+    /**
+     * \brief Check if the motion boxes should be drawn into the mosaic
+     */
+    bool isOverlayEnabled() const { return m_config.overlay; }
+
+private:
+    /**
+     * \brief Analysis state of one camera
+     */
+    struct Camera {
+        explicit Camera(size_t i) : idx(i) {}
+
+        /** camera index */
+        size_t idx;
+
+        /** last time a frame was taken */
+        std::chrono::steady_clock::time_point lastTaken;
+
+        /** a frame of the camera is queued or being analysed */
+        bool busy = false;
+
+        /**
+         * previous analysed frame, scaled, grey and blurred. Only used by
+         * the worker analysing the camera, while busy is set.
+         */
+        cv::Mat previous;
+
+        /** latest result */
+        AnalyticsResult result;
+    };
+
+    using CameraPtr = std::shared_ptr<Camera>;
+
+    /**
+     * \brief A frame waiting for a worker
+     */
+    struct Job {
+        CameraPtr camera;
+        CvMatPtr frame;
+        std::chrono::steady_clock::time_point time;
+    };
+
+    /**
+     * \brief Compare a frame with the previous frame of its camera
+     */
+    AnalyticsResult analyze(Camera& camera, cv::Mat const& frame) const;
+
+    void workerThread();
+
+private:
+    /** analytics settings */
+    AnalyticsConfig m_config;
+
+    /** CPU placement of the worker threads */
+    ThreadRoleConfig m_placement;
+
+    /** minimum time between two frames taken from a camera */
+    std::chrono::steady_clock::duration m_interval;
+
+    /**
+     * cameras, by camera index. Replaced by setCameras(), jobs of previous
+     * cameras finish on their own copy.
+     */
+    std::vector<CameraPtr> m_cameras;
+
+    /** frames waiting for a worker */
+    std::deque<Job> m_jobs;
+
+    /** the workers are stopping */
+    bool m_stopping = false;
+
+    /** protects all of the above and the state of the cameras */
+    mutable std::mutex m_mutex;
+
+    /** signals new jobs */
+    std::condition_variable m_jobsCond;
+
+    std::vector<std::thread> m_workers;
+};
+
+} // end of namespace
+
+#endif
@@ -0,0 +1,119 @@
+#ifndef RTSP_PROXY_COMPOSITOR_PIPELINE_HPP
+#define RTSP_PROXY_COMPOSITOR_PIPELINE_HPP
+
+// STL headers
+#include <atomic>
+#include <string>
+#include <utility>
+#include <vector>
+
+// gstreamer headers
+#include <gst/gst.h>
+
+// Project headers
+#include <RtspProxyConfig.hpp>
+#include <FrameLatencyProbe.hpp>
+
+namespace rtsp_proxy_server {
+
+/**
+ * \brief Output pipeline of the GStreamer engine
+ *
+ * The camera pipelines, without their appsink, are scaled to their tiles
+ * and feed a compositor element whose pads are placed by the same layout
+ * as the OpenCV processor. The mosaic goes straight into the encoder of
+ * the output pipeline, no frame is copied into OpenCV or handed between
+ * threads of the proxy.
+ *
+ * An object of this class measures a running mosaic pipeline: the time
+ * from the compositor starting a frame to the frame leaving a pad.
+ */
+class CompositorPipeline {
+public:
+    /**
+     * \brief Build the launch string of the mosaic
+     *
+     * \param[in] config configuration providing the camera pipelines, the
+     *            output dimensions and the output pipeline
+     * \param[in] sink element replacing the payloader of the output
+     *            pipeline, empty to keep it
+     * \param[in] encode continue the mosaic with the output pipeline.
+     *            Otherwise it goes straight into the sink.
+     *
+     * \throw std::runtime_error if a pipeline cannot be used
+     */
+    static std::string build(
+        RtspProxyConfig const& config,
+        std::string const& sink = std::string(),
+        bool encode = true);
+
+    /**
+     * \brief Replace the last element of a linear launch string
+     */
+    static std::string replaceLastElement(
+        std::string const& pipeline,
+        std::string const& element);
+
+    /**
+     * \brief Constructor. Adds probes to the compositor of a mosaic
+     *        pipeline.
+     *
+     * \param[in] bin bin created from a launch string of build()
+     * \param[in] end pad the measured frames leave by, e.g. the encoder
+     *            source pad
+     * \param[in] callback receives the latency of every frame
+     */
+    CompositorPipeline(
+        GstElement* bin,
+        GstPad* end,
+        FrameLatencyProbe::Callback callback);
+
+    /**
+     * \brief Destructor. Removes the probes.
+     */
+    ~CompositorPipeline();
+
+    /**
+     * \brief Get the number of frames that left by the end pad
+     */
+    uint64_t getFrames() const { return m_latency.getFrames(); }
+
+private:
+    /**
+     * \brief Buffer probe on the compositor inputs, remembers when the last
+     *        camera frame arrived
+     */
+    static GstPadProbeReturn onInputBuffer(
+        GstPad* pad,
+        GstPadProbeInfo* info,
+        CompositorPipeline* pipeline);
+
+    /**
+     * \brief Buffer probe on the compositor output, starts measuring the
+     *        composed frame
+     */
+    static GstPadProbeReturn onOutputBuffer(
+        GstPad* pad,
+        GstPadProbeInfo* info,
+        CompositorPipeline* pipeline);
+
+private:
+    /** compositor pads and their probes */
+    std::vector<std::pair<GstPad*, gulong>> m_probes;
+
+    /** measures the composed frames */
+    FrameLatencyProbe m_latency;
+
+    /** arrival of the last camera frame, steady clock nanoseconds */
+    std::atomic<int64_t> m_lastInputNs = {0};
+
+    /**
+     * last composed frame, steady clock nanoseconds. Only used by the
+     * compositor output thread.
+     */
+    int64_t m_lastOutputNs = 0;
+};
+
+} // end of namespace
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef RTSP_PROXY_FRAME_LATENCY_PROBE_HPP
+#define RTSP_PROXY_FRAME_LATENCY_PROBE_HPP
+
+// STL headers
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <utility>
+
+// gstreamer headers
+#include <gst/gst.h>
+
+namespace rtsp_proxy_server {
+
+/**
+ * \brief Measures how long frames take through a part of an output
+ *        pipeline, from a start reported by the caller to a pad they leave
+ *        by. Frames are matched by their PTS.
+ */
+class FrameLatencyProbe {
+public:
+    /**
+     * \brief Receives the latency of a frame in milliseconds. Called from
+     *        the streaming thread of the pad.
+     */
+    using Callback = std::function<void(double latencyMs)>;
+
+    /**
+     * \brief Constructor. Adds a buffer probe to the pad.
+     *
+     * \param[in] pad pad frames leave the measured part by
+     * \param[in] callback receives the latency of every matched frame
+     */
+    FrameLatencyProbe(GstPad* pad, Callback callback);
+
+    /**
+     * \brief Destructor. Removes the probe.
+     */
+    ~FrameLatencyProbe();
+
+    FrameLatencyProbe(FrameLatencyProbe const&) = delete;
+    FrameLatencyProbe& operator=(FrameLatencyProbe const&) = delete;
+
+    /**
+     * \brief A frame entered the measured part of the pipeline
+     *
+     * \param[in] pts PTS of the frame when it reaches the pad
+     * \param[in] time when it entered
+     */
+    void start(GstClockTime pts, std::chrono::steady_clock::time_point time);
+
+    /**
+     * \brief Get the number of frames that left by the pad
+     */
+    uint64_t getFrames() const { return m_frames; }
+
+private:
+    static GstPadProbeReturn onBuffer(
+        GstPad* pad,
+        GstPadProbeInfo* info,
+        FrameLatencyProbe* probe);
+
+private:
+    GstPad* m_pad = nullptr;
+    gulong m_probeId = 0;
+
+    Callback m_callback;
+
+    /** frames started but not out yet, oldest first */
+    std::deque<std::pair<GstClockTime, std::chrono::steady_clock::time_point>>
+        m_starts;
+
+    /** protects m_starts */
+    std::mutex m_mutex;
+
+    std::atomic<uint64_t> m_frames = {0};
+};
+
+} // end of namespace
+
+#endif
@@ -0,0 +1,170 @@
+#ifndef RTSP_PROXY_FRAME_TRACER_HPP
+#define RTSP_PROXY_FRAME_TRACER_HPP
+
+// STL headers
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace rtsp_proxy_server {
+
+/**
+ * \brief One traced stage of a frame, e.g. its decode or its compose
+ */
+struct TraceEvent {
+    /** stage name, must be a string literal */
+    const char* name = nullptr;
+
+    /** stage start and end, in steady clock nanoseconds */
+    int64_t startNs = 0;
+    int64_t endNs = 0;
+
+    /** ID of the frame, counted by the component producing it */
+    uint64_t frame = 0;
+
+    /** camera index, -1 if the stage is not about one camera */
+    int cam = -1;
+
+    /**
+     * flows linking the stages of a frame across threads, from flowId().
+     * 0 for none.
+     */
+    uint64_t flowIn = 0;
+    uint64_t flowOut = 0;
+
+    /** thread recording the event, set by FrameTracer::record() */
+    int tid = 0;
+};
+
+/**
+ * \brief Process wide recorder of per frame events, exported in the Chrome
+ *        trace format for chrome://tracing and Perfetto
+ *
+ * Every thread records into its own ring of the last 'eventsPerThread'
+ * events, without locks. The rings are only read when a trace is exported.
+ * Components check isEnabled() before taking timestamps, so a disabled
+ * tracer costs one relaxed atomic load per stage.
+ */
+class FrameTracer {
+public:
+    /**
+     * \brief Get the single instance of the tracer
+     */
+    static FrameTracer& instance();
+
+    /**
+     * \brief Start recording. Must be called before any thread records.
+     *
+     * \param[in] eventsPerThread size of the ring of each thread
+     */
+    void enable(size_t eventsPerThread);
+
+    /**
+     * \brief Check if events should be recorded
+     */
+    static bool isEnabled() {
+        return s_enabled.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * \brief Convert a steady clock time to event nanoseconds
+     */
+    static int64_t toNs(std::chrono::steady_clock::time_point time) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            time.time_since_epoch()).count();
+    }
+
+    /**
+     * \brief Get the current time in event nanoseconds
+     */
+    static int64_t now() { return toNs(std::chrono::steady_clock::now()); }
+
+    /**
+     * \brief Get the ID of a flow from the stage of a frame produced by
+     *        'owner' to the stage consuming it
+     */
+    static uint64_t flowId(const void* owner, uint64_t frame) {
+        // heap addresses fit 47 bits and are 8 byte aligned, frame numbers
+        // wrap after 2^20 frames, long after the rings were overwritten
+        return (uint64_t(reinterpret_cast<uintptr_t>(owner)) >> 3 << 20) |
+            (frame & 0xfffff);
+    }
+
+    /**
+     * \brief Record an event into the ring of the calling thread
+     */
+    void record(TraceEvent const& event);
+
+    /**
+     * \brief Format the events of all threads as Chrome trace JSON
+     */
+    std::string formatJson();
+
+    /**
+     * \brief Write the events of all threads as Chrome trace JSON
+     *
+     * \return false if the file could not be written
+     */
+    bool writeJson(std::string const& path);
+
+private:
+    /**
+     * \brief Ring of the events of one thread
+     */
+    struct ThreadRing {
+        explicit ThreadRing(size_t size) : events(size) {}
+
+        /** events, the oldest overwritten first */
+        std::vector<TraceEvent> events;
+
+        /** number of events ever recorded */
+        std::atomic<uint64_t> head = {0};
+
+        /** the thread exited, another one may take the ring */
+        std::atomic<bool> free = {false};
+    };
+
+    /**
+     * \brief Releases the ring of a thread when the thread exits
+     */
+    struct ThreadRingHolder {
+        ThreadRing* ring = nullptr;
+        ~ThreadRingHolder();
+    };
+
+    FrameTracer() = default;
+
+    /**
+     * \brief Get a ring for the calling thread, reusing one of an exited
+     *        thread if possible
+     */
+    ThreadRing* acquireRing();
+
+private:
+    /** events are recorded */
+    static std::atomic<bool> s_enabled;
+
+    /** ring of the calling thread */
+    static thread_local ThreadRingHolder t_ring;
+
+    /** number of events in each ring */
+    size_t m_eventsPerThread = 0;
+
+    /** rings of all threads that ever recorded */
+    std::vector<std::unique_ptr<ThreadRing>> m_rings;
+
+    /** names of all threads that ever recorded, by thread ID */
+    std::map<int, std::string> m_threadNames;
+
+    /** protects m_rings and m_threadNames */
+    std::mutex m_mutex;
+};
+
+} // end of namespace
+
+#endif
@@ -0,0 +1,128 @@
+#ifndef RTSP_PROXY_HTTP_SERVER_HPP
+#define RTSP_PROXY_HTTP_SERVER_HPP
+
+// System headers
+#include <sys/types.h>
+
+// STL headers
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace rtsp_proxy_server {
+
+using HttpBody = std::shared_ptr<const std::vector<uint8_t>>;
+
+/**
+ * \brief Response of an HTTP handler. The body is shared, so many requests
+ *        can send the same buffer without copying it.
+ */
+struct HttpResponse {
+    int status = 200;
+    std::string contentType = "text/plain";
+    HttpBody body;
+
+    /**
+     * \brief Create a response with a text body
+     */
+    static HttpResponse text(int status, std::string const& text);
+};
+
+/**
+ * \brief Handler of one HTTP path. Receives the query string of the request
+ *        (without '?').
+ */
+using HttpHandler = std::function<HttpResponse(std::string const& query)>;
+
+/**
+ * \brief Minimal local HTTP/1.0 server for status and snapshot endpoints
+ *
+ * Only GET requests are supported. Connections are accepted by one thread
+ * and served by a fixed pool of worker threads, one request per connection.
+ */
+class HttpServer {
+public:
+    /**
+     * \brief Constructor. Starts listening right away.
+     *
+     * \param[in] address local address to listen on
+     * \param[in] port TCP port to listen on
+     * \param[in] threads number of worker threads serving requests
+     */
+    HttpServer(std::string const& address, ushort port, uint threads);
+
+    /**
+     * \brief Destructor
+     *
+     * Stops accepting connections and joins all threads.
+     */
+    ~HttpServer();
+
+    /**
+     * \brief Register a handler for a path. Must be called before requests
+     *        for the path arrive.
+     */
+    void addHandler(std::string const& path, HttpHandler handler);
+
+    /**
+     * \brief Get the value of a parameter from a query string
+     *
+     * \return true if the parameter is present
+     */
+    static bool getQueryParam(
+        std::string const& query,
+        std::string const& name,
+        std::string& value);
+
+private:
+    /**
+     * \brief Thread accepting new connections
+     */
+    void acceptThread();
+
+    /**
+     * \brief Thread serving accepted connections
+     */
+    void workerThread();
+
+    /**
+     * \brief Read one request from a connection and send the response
+     */
+    void serve(int fd);
+
+private:
+    /** listening socket */
+    int m_listenFd = -1;
+
+    /** handlers by path */
+    std::map<std::string, HttpHandler> m_handlers;
+
+    /** accepted connections waiting for a worker */
+    std::deque<int> m_pending;
+
+    /** protects m_pending and m_handlers */
+    std::mutex m_mutex;
+
+    /** signals workers that a connection is pending */
+    std::condition_variable m_pendingCv;
+
+    /** Thread accepting connections */
+    std::thread m_acceptThread;
+
+    /** Threads serving connections */
+    std::vector<std::thread> m_workers;
+
+    /** Indicates if the server is running */
+    std::atomic<bool> m_running = {false};
+};
+
+} // end of namespace
+
+#endif
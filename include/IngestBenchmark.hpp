@@ -0,0 +1,87 @@
+#ifndef RTSP_PROXY_INGEST_BENCHMARK_HPP
+#define RTSP_PROXY_INGEST_BENCHMARK_HPP
+
+// STL headers
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Project headers
+#include <RtspProxyConfig.hpp>
+
+namespace rtsp_proxy_server {
+
+/**
+ * \brief Headless throughput run on replayed camera files
+ *
+ * Runs the output engine without the RTSP server, consuming composed frames
+ * as fast as they are produced. Reports the sustained composed FPS, the CPU
+ * time per frame, the latency from compose start to the end of the output
+ * path and the peak RSS of the process, so the engines can be compared on
+ * the same files. The OpenCV engine also reports the time spent in each
+ * stage per frame.
+ *
+ * With input_file_encode the composed frames go through the output pipeline
+ * up to the encoder, like when they are served.
+ */
+class IngestBenchmark {
+public:
+    /**
+     * \brief Constructor
+     *
+     * \param[in] config configuration with input_file_locations set
+     */
+    IngestBenchmark(std::shared_ptr<const RtspProxyConfig> config);
+
+    /**
+     * \brief Run until all files ended, or for input_file_duration seconds
+     *
+     * \return process exit code
+     */
+    int run();
+
+private:
+    /**
+     * \brief Figures of a run
+     */
+    struct Measurement {
+        /** frames out of the output path */
+        uint64_t frames = 0;
+
+        /** seconds from the first frame out */
+        double elapsed = 0.;
+
+        /** CPU seconds of the process over elapsed */
+        double cpu = 0.;
+
+        /** latency of each frame, compose start to the end of the path */
+        std::vector<double> latencyMs;
+
+        /** change of the processor stage metrics, OpenCV engine only */
+        std::map<std::string, double> stages;
+    };
+
+    /**
+     * \brief Run the OpenCV processor, pushing the composed frames into the
+     *        output pipeline if they are encoded
+     */
+    bool runProcessor(Measurement& m);
+
+    /**
+     * \brief Run the mosaic pipeline of the GStreamer engine
+     */
+    bool runCompositor(Measurement& m);
+
+    /**
+     * \brief Print the figures of a run
+     */
+    void printResults(Measurement& m) const;
+
+private:
+    std::shared_ptr<const RtspProxyConfig> m_config;
+};
+
+} // end of namespace
+
+#endif
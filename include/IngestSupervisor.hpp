@@ -0,0 +1,122 @@
+#ifndef RTSP_PROXY_INGEST_SUPERVISOR_HPP
+#define RTSP_PROXY_INGEST_SUPERVISOR_HPP
+
+// System headers
+#include <sys/types.h>
+
+// STL headers
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Project headers
+#include <RtspProxyConfig.hpp>
+
+namespace rtsp_proxy_server {
+
+/**
+ * \brief Runs the ingest workers and starts them again when they exit
+ *
+ * Workers are the proxy binary started again with IngestWorker::OPTION,
+ * so they never inherit the threads of the proxy. They are started from
+ * the supervisor thread, which outlives them: the kernel terminates them
+ * when it exits, e.g. if the proxy crashed. The rings of a worker that
+ * died without closing them are closed by the supervisor, so the readers
+ * of the proxy never wait on them.
+ */
+class IngestSupervisor {
+public:
+    /**
+     * \brief Constructor. Starts the supervisor thread, which starts the
+     *        workers.
+     *
+     * \param[in] configFile configuration file the workers load
+     * \param[in] config the configuration loaded from it
+     */
+    IngestSupervisor(
+        std::string const& configFile,
+        std::shared_ptr<const RtspProxyConfig> config);
+
+    /**
+     * \brief Destructor. Terminates the workers.
+     */
+    ~IngestSupervisor();
+
+    /**
+     * \brief Terminate the workers whose cameras changed and start them
+     *        again, with the configuration reloaded from the file. Never
+     *        blocks.
+     */
+    void restart(std::shared_ptr<const RtspProxyConfig> config);
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * \brief A worker process
+     */
+    struct Worker {
+        /** process ID, -1 while it is not running */
+        pid_t pid = -1;
+
+        /** when it is started again, if it is not running */
+        Clock::time_point startAt;
+    };
+
+    void supervisorThread();
+
+    /**
+     * \brief Start a worker process
+     */
+    void spawn(uint index, Worker& worker);
+
+    /**
+     * \brief Reap the workers that exited
+     */
+    void reap();
+
+    /**
+     * \brief Terminate all workers, killing those not gone after a while
+     */
+    void terminateAll();
+
+    /**
+     * \brief Terminate some workers, killing those not gone after a while
+     */
+    void terminate(std::vector<uint> const& indexes);
+
+    /**
+     * \brief Close the rings of a worker that is gone
+     */
+    void closeRings(uint index);
+
+private:
+    std::string m_configFile;
+
+    /** configuration the workers run with */
+    std::shared_ptr<const RtspProxyConfig> m_config;
+
+    /** delay before a worker that exited is started again */
+    Clock::duration m_restartDelay;
+
+    /** only used by the supervisor thread, as m_config */
+    std::vector<Worker> m_workers;
+
+    /** configuration wanted by restart(), null if none is pending */
+    std::shared_ptr<const RtspProxyConfig> m_pendingConfig;
+
+    /** protects m_pendingConfig */
+    std::mutex m_pendingMutex;
+
+    std::atomic<bool> m_running = {true};
+
+    std::thread m_thread;
+};
+
+} // end of namespace
+
+#endif
@@ -0,0 +1,106 @@
+#ifndef RTSP_PROXY_INGEST_WORKER_HPP
+#define RTSP_PROXY_INGEST_WORKER_HPP
+
+// System headers
+#include <sys/types.h>
+
+// STL headers
+#include <memory>
+#include <string>
+#include <vector>
+
+// Project headers
+#include <RtspProxyConfig.hpp>
+
+namespace rtsp_proxy_server {
+
+/**
+ * \brief Decodes a group of cameras in a child process of the proxy
+ *
+ * Worker N decodes the cameras N * input_workers_cameras and following,
+ * with the same readers the proxy uses, and publishes their frames into
+ * the shared memory rings named by getRingName(). The readers of the proxy
+ * copy the frames out of the rings. A worker exits when it is terminated,
+ * or when the proxy is gone.
+ */
+class IngestWorker {
+public:
+    /** command line option starting the proxy binary as a worker */
+    static const char* const OPTION;
+
+    /**
+     * \brief Constructor
+     *
+     * \param[in] config configuration of the proxy
+     * \param[in] index index of the worker
+     * \param[in] proxy process ID of the proxy
+     */
+    IngestWorker(
+        std::shared_ptr<const RtspProxyConfig> config,
+        uint index,
+        pid_t proxy);
+
+    /**
+     * \brief Decode and publish the frames until the worker is terminated
+     *
+     * \return exit code of the worker process
+     */
+    int run();
+
+    /**
+     * \brief Get the name of the ring a camera is published into
+     *
+     * \param[in] proxy process ID of the proxy
+     * \param[in] cam camera index
+     */
+    static std::string getRingName(pid_t proxy, size_t cam);
+
+    /**
+     * \brief Get the cameras a worker decodes
+     *
+     * \param[in] config configuration the worker runs with
+     * \param[in] index index of the worker
+     * \param[out] first index of its first camera
+     * \param[out] last index after its last camera, first if it has none
+     */
+    static void getCameras(
+        RtspProxyConfig const& config,
+        uint index,
+        size_t& first,
+        size_t& last);
+
+    /**
+     * \brief Get the names of the rings a worker publishes into
+     *
+     * \param[in] config configuration the worker runs with
+     * \param[in] proxy process ID of the proxy
+     * \param[in] index index of the worker
+     */
+    static std::vector<std::string> getRingNames(
+        RtspProxyConfig const& config,
+        pid_t proxy,
+        uint index);
+
+    /**
+     * \brief Get the number of workers decoding the cameras of a
+     *        configuration
+     */
+    static uint getWorkersNum(RtspProxyConfig const& config);
+
+private:
+    /** shared memory name prefix of the rings of a proxy */
+    static std::string getRingPrefix(pid_t proxy);
+
+private:
+    std::shared_ptr<const RtspProxyConfig> m_config;
+
+    /** index of the worker */
+    uint m_index = 0;
+
+    /** process ID of the proxy */
+    pid_t m_proxy = 0;
+};
+
+} // end of namespace
+
+#endif
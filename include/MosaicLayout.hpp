@@ -0,0 +1,45 @@
+#ifndef RTSP_PROXY_MOSAIC_LAYOUT_HPP
+#define RTSP_PROXY_MOSAIC_LAYOUT_HPP
+
+// STL headers
+#include <cstddef>
+
+// Open CV headers
+#include <opencv2/core/core.hpp>        // cv::Rect
+
+namespace rtsp_proxy_server {
+
+/**
+ * \brief Get the area of a camera tile in the mosaic
+ *
+ * Both output engines place the cameras with it, so they compose the same
+ * mosaic from the same configuration.
+ *
+ * \param[in] idx camera index
+ * \param[in] num number of cameras
+ * \param[in] canvasSize dimensions of the mosaic
+ * \param[in] columns tiles per row, 0 to place all cameras in one row
+ */
+inline cv::Rect
+getMosaicTileRect(
+    size_t idx,
+    size_t num,
+    cv::Size const& canvasSize,
+    size_t columns = 0)
+{
+    // cameras fill the rows left to right, each tile with an equal share
+    // of width and height
+    auto cols = int((columns == 0 || columns > num) ? num : columns);
+    auto rows = int((num + size_t(cols) - 1) / size_t(cols));
+    auto col = int(idx) % cols;
+    auto row = int(idx) / cols;
+    int x = col * canvasSize.width / cols;
+    int w = (col + 1) * canvasSize.width / cols - x;
+    int y = row * canvasSize.height / rows;
+    int h = (row + 1) * canvasSize.height / rows - y;
+    return cv::Rect(x, y, w, h);
+}
+
+} // end of namespace
+
+#endif
@@ -6,7 +6,13 @@
 
 // STL headers
 #include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
 #include <thread>
+#include <vector>
 
 // Boost headers
 #include <boost/lockfree/spsc_queue.hpp>
@@ -15,11 +21,63 @@
 #include <opencv2/core/core.hpp>        // cv::Mat
 #include <opencv2/highgui/highgui.hpp>  // cv::VideoCapture
 
+// gstreamer headers
+#include <gst/gst.h>
+
+// Project headers
+#include <RtspProxyConfig.hpp>
+#include <AdaptiveJitterController.hpp>
+#include <ShmFrameRing.hpp>
+
 namespace rtsp_proxy_server {
 
 using CvMatPtr = std::shared_ptr<cv::Mat>;
 using FrameBuffer = boost::lockfree::spsc_queue<CvMatPtr>;
 
+/**
+ * \brief Receives every decoded frame of a reader, in the reader thread
+ */
+using FrameListener = std::function<void(CvMatPtr const& frame)>;
+
+/**
+ * \brief Ingest statistics of a camera. Jitter buffer totals are since the
+ *        camera was last opened, reconnect totals since the reader started.
+ */
+struct IngestStats {
+    /**
+     * false if the camera is read through OpenCV, without jitter buffer
+     * statistics
+     */
+    bool available = false;
+
+    /** current jitter buffer latency in milliseconds */
+    uint latencyMs = 0;
+
+    /** average inter-arrival jitter in milliseconds */
+    double jitterMs = 0.;
+
+    /** packets pushed out of the jitter buffer */
+    uint64_t pushed = 0;
+
+    /** packets given up on */
+    uint64_t lost = 0;
+
+    /** packets arriving after they were given up on */
+    uint64_t late = 0;
+
+    /** the camera is being reconnected */
+    bool down = false;
+
+    /** successful reconnects */
+    uint64_t reconnects = 0;
+
+    /** seconds without frames, over all outages that ended */
+    double outageSec = 0.;
+
+    /** pipeline in use, 0 for the camera pipeline, N for its Nth backup */
+    size_t source = 0;
+};
+
 class OpenCvReader {
 public:
     /**
@@ -29,11 +87,32 @@ public:
      *            latency RTSP stream open using OpenCV API
      * \param[in] bufferSize size of a ring buffer for holding video frames
      * \param[in] sem semaphore to signal a consumer that a video frame is ready
+     * \param[in] placement CPU placement of the reader thread
+     * \param[in] frameNode NUMA node to allocate frames on, or -1 to leave
+     *            them where the decoder allocates them
+     * \param[in] fileIngest pacing and looping if the pipeline replays a
+     *            file instead of a camera
+     * \param[in] jitterBuffer adaptive jitter buffer settings. If enabled,
+     *            camera pipelines are run without OpenCV, so their jitter
+     *            buffers can be watched and tuned.
+     * \param[in] backupPipelines pipelines tried in turn when gstPipeline
+     *            fails
+     * \param[in] reconnect reconnect settings, unused for replayed files
+     * \param[in] shmRing if set, read the frames of the camera from this
+     *            shared memory ring, published by an ingest worker, instead
+     *            of running gstPipeline
      */
     OpenCvReader(
         std::string const& gstPipeline,
         uint bufferSize,
-        sem_t* sem);
+        sem_t* sem,
+        ThreadRoleConfig const& placement = ThreadRoleConfig(),
+        int frameNode = -1,
+        FileIngestConfig const& fileIngest = FileIngestConfig(),
+        JitterBufferConfig const& jitterBuffer = JitterBufferConfig(),
+        CameraPipelines const& backupPipelines = CameraPipelines(),
+        ReconnectConfig const& reconnect = ReconnectConfig(),
+        std::string const& shmRing = std::string());
 
     /**
      * \brief Destructor
@@ -42,9 +121,40 @@ public:
      */
     ~OpenCvReader();
 
-    bool isConnected() { return m_videoCapture.isOpened(); }
+    bool isConnected() const { return m_connected; }
+
+    /**
+     * \brief Get the next decoded frame, if any
+     *
+     * \param[out] frameId sequence number of the frame among all frames
+     *             queued by this reader, used to trace it
+     */
+    CvMatPtr getFrame(uint64_t* frameId = nullptr);
+
+    /**
+     * \brief Set a listener receiving every decoded frame, whether or not
+     *        it fits into the ring buffer. The listener must not block.
+     *        An empty listener is never called once this returns.
+     */
+    void setFrameListener(FrameListener listener);
+
+    /**
+     * \brief Get number of frames dropped because the consumer didn't
+     *        read them fast enough
+     */
+    size_t getDroppedFrames() const { return m_droppedFrames; }
+
+    /**
+     * \brief Check if a replayed file ended and all its frames were read
+     */
+    bool isFinished() const {
+        return m_finished && m_buffer.read_available() == 0;
+    }
 
-    CvMatPtr getFrame();
+    /**
+     * \brief Get jitter buffer statistics of the camera
+     */
+    IngestStats getIngestStats() const;
 
     void start();
 
@@ -55,12 +165,112 @@ private:
 
     void closeCam();
 
+    /**
+     * \brief Reopen the camera until it succeeds or the reader is stopped,
+     *        waiting with exponential backoff and jitter between attempts.
+     *        Each attempt tries the next pipeline, the camera pipeline
+     *        first.
+     *
+     * \param[in] outageStart time the camera delivered its last frame, or
+     *            the reader started
+     *
+     * \return false if the reader was stopped
+     */
+    bool reconnect(std::chrono::steady_clock::time_point outageStart);
+
+    /**
+     * \brief Sleep, waking up early if the reader is stopped
+     *
+     * \return false if the reader was stopped
+     */
+    bool sleepWhileRunning(std::chrono::steady_clock::duration duration);
+
+    /**
+     * \brief Map the shared memory ring of the camera
+     */
+    bool openShm();
+
+    /**
+     * \brief Copy the next frame out of the shared memory ring. Follows the
+     *        ring when its worker replaced it.
+     */
+    bool readShm(cv::Mat& frame);
+
+    /**
+     * \brief Run the pipeline without OpenCV, pulling frames from its
+     *        appsink
+     */
+    bool openPipeline();
+
+    void closePipeline();
+
+    /**
+     * \brief Read the next frame of a pipeline opened by openPipeline()
+     */
+    bool readPipeline(cv::Mat& frame);
+
+    /**
+     * \brief Report and discard the messages of the pipeline's bus
+     */
+    void drainBus();
+
+    /**
+     * \brief Collect the statistics of all jitter buffers of the camera,
+     *        and adapt their latency
+     */
+    void sampleJitterBuffers();
+
+    /**
+     * \brief rtspsrc created its RTP bin, watch it for jitter buffers
+     */
+    static void onNewManager(
+        GstElement* rtspsrc,
+        GstElement* manager,
+        OpenCvReader* reader);
+
+    /**
+     * \brief The RTP bin created a jitter buffer for a new stream
+     */
+    static void onNewJitterBuffer(
+        GstElement* rtpbin,
+        GstElement* jitterBuffer,
+        guint session,
+        guint ssrc,
+        OpenCvReader* reader);
+
     void cvReaderThread();
 
+    /** a pooled frame and the buffer that was bound to m_frameNode */
+    struct PoolFrame {
+        cv::Mat frame;
+        const uchar* boundData = nullptr;
+    };
+
+    /**
+     * \brief Get a frame to decode into from the frame pool. The frame
+     *        returns to the pool when its last user releases it.
+     *
+     * \param[out] pooled the pooled frame, null if the pool is exhausted
+     *             and the frame is not pooled
+     */
+    CvMatPtr getPoolFrame(PoolFrame*& pooled);
+
 private:
     /** GST Pipeline used to create the capture (for reference) */
     std::string m_gstPipeline;
 
+    /**
+     * camera pipeline followed by its backups. m_gstPipeline is the one
+     * in use.
+     */
+    CameraPipelines m_pipelines;
+
+    /** reconnect settings */
+    ReconnectConfig m_reconnect;
+
+    /** randomizes the reconnect delays */
+    std::mt19937 m_random;
+
     /** OpenCV video capture device connected to a remote RTSP server */
     cv::VideoCapture m_videoCapture;
 
@@ -75,6 +285,105 @@ private:
 
     /** Indicates if openCV thread is running */
     std::atomic<bool> m_running = {false};
+
+    /**
+     * Number of frames queued into m_buffer by the reader thread, and taken
+     * out of it by the consumer. They number the frames for tracing.
+     */
+    uint64_t m_pushedFrames = 0;
+    uint64_t m_poppedFrames = 0;
+
+    /** Receives every decoded frame besides the consumer */
+    FrameListener m_frameListener;
+
+    /** protects m_frameListener */
+    std::mutex m_frameListenerMutex;
+
+    /** Number of frames dropped because the ring buffer was full */
+    std::atomic<size_t> m_droppedFrames = {0};
+
+    /** file replay settings, if the pipeline replays a file */
+    FileIngestConfig m_fileIngest;
+
+    /** Indicates a replayed file ended */
+    std::atomic<bool> m_finished = {false};
+
+    /** CPU placement of the reader thread */
+    ThreadRoleConfig m_placement;
+
+    /** NUMA node of frame buffers, -1 if frames are not pooled */
+    int m_frameNode = -1;
+
+    /**
+     * Frames reused for decoding once all their users released them, so
+     * they stay on m_frameNode. A frame is put back by the deleter of the
+     * CvMatPtr handed out, on the thread dropping the last reference; the
+     * mutex orders the reads of that user before the next decode into it.
+     * Shared with the deleters, frames may outlive the reader.
+     */
+    struct FramePool {
+        std::mutex mutex;
+        std::vector<std::unique_ptr<PoolFrame>> free;
+    };
+    std::shared_ptr<FramePool> m_framePool;
+
+    /** frames allocated for the pool, only used by the reader thread */
+    size_t m_framePoolAllocated = 0;
+
+    /** maximum number of pooled frames */
+    size_t m_framePoolSize = 0;
+
+    /** adaptive jitter buffer settings */
+    JitterBufferConfig m_jitterBuffer;
+
+    /**
+     * the camera is run by openPipeline() and read from its appsink, with
+     * a timeout, instead of through OpenCV
+     */
+    bool m_appsinkRead = false;
+
+    /** pipeline run without OpenCV, and its appsink and rtspsrc */
+    GstElement* m_pipeline = nullptr;
+    GstElement* m_appsink = nullptr;
+    GstElement* m_rtspsrc = nullptr;
+
+    /** shared memory ring published by an ingest worker, if set */
+    std::string m_shmRing;
+
+    /** reader of m_shmRing */
+    std::unique_ptr<ShmFrameReader> m_shmReader;
+
+    /**
+     * Indicates the camera is open, through OpenCV, m_pipeline or
+     * m_shmReader
+     */
+    std::atomic<bool> m_connected = {false};
+
+    /** jitter buffers of the camera streams */
+    std::vector<GstElement*> m_jitterBuffers;
+
+    /**
+     * protects m_jitterBuffers. They are created in streaming threads.
+     */
+    std::mutex m_jitterBuffersMutex;
+
+    /**
+     * decides the jitter buffer latency. Set if the pipeline is run without
+     * OpenCV.
+     */
+    std::unique_ptr<AdaptiveJitterController> m_jitterController;
+
+    /** jitter buffer totals at the previous sample */
+    JitterSample m_jitterTotals;
+
+    /** set once the jitter buffer was found not to report its jitter */
+    bool m_noAvgJitter = false;
+
+    /** latest statistics */
+    IngestStats m_ingestStats;
+
+    /** protects m_ingestStats */
+    mutable std::mutex m_ingestStatsMutex;
 };
 
 } // end of namespace
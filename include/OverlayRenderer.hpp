@@ -0,0 +1,133 @@
+#ifndef RTSP_PROXY_OVERLAY_RENDERER_HPP
+#define RTSP_PROXY_OVERLAY_RENDERER_HPP
+
+// STL headers
+#include <ctime>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Open CV headers
+#include <opencv2/core/core.hpp>        // cv::Mat
+
+// Project headers
+#include <RtspProxyConfig.hpp>
+
+namespace rtsp_proxy_server {
+
+/**
+ * \brief Labels of one camera tile to draw into an output frame
+ */
+struct TileOverlay {
+    /** area of the tile in the output frame */
+    cv::Rect rect;
+
+    /** camera index, selects the camera name */
+    size_t cam = 0;
+
+    /** the camera has no signal */
+    bool noSignal = false;
+
+    /** areas of the tile with motion, in frame coordinates */
+    std::vector<cv::Rect> motion;
+};
+
+/**
+ * \brief Draws camera names, status and the wall clock into camera tiles
+ *
+ * Every label is rendered once with cv::putText into a cached, premultiplied
+ * alpha image, and rendered again only when its text changes: camera names
+ * on a configuration reload, the clock once a second. Drawing a frame only
+ * alpha-blends the small label rectangles into the tiles, so its cost does
+ * not depend on the output resolution.
+ *
+ * Motion boxes of the analytics are outlined in every frame, labels are
+ * drawn on top of them if they are enabled.
+ */
+class OverlayRenderer {
+public:
+    /**
+     * \brief Constructor
+     *
+     * \param[in] config overlay settings
+     */
+    explicit OverlayRenderer(OverlayConfig const& config);
+
+    /**
+     * \brief Set the camera names, by camera index
+     */
+    void setCameraNames(std::vector<std::string> const& names);
+
+    /**
+     * \brief Draw the labels and motion boxes of the tiles into an output
+     *        frame
+     *
+     * \param[in,out] frame output frame, CV_8UC3
+     * \param[in] tiles tiles of the frame to label
+     */
+    void draw(cv::Mat& frame, std::vector<TileOverlay> const& tiles);
+
+private:
+    /**
+     * \brief Text rendered for blending
+     */
+    struct Label {
+        /** label colors premultiplied by alpha, CV_8UC3 */
+        cv::Mat premultiplied;
+
+        /** 255 - alpha, repeated for each channel, CV_8UC3 */
+        cv::Mat inverseAlpha;
+    };
+
+    using LabelPtr = std::shared_ptr<const Label>;
+
+    /**
+     * \brief Render a text on a translucent box
+     *
+     * \param[in] text text to render
+     * \param[in] color BGR text color
+     */
+    LabelPtr render(std::string const& text, cv::Scalar const& color) const;
+
+    /**
+     * \brief Get the name label of a camera, rendering it on first use
+     */
+    Label const& getNameLabel(size_t cam);
+
+    /**
+     * \brief Blend a label into a frame, clipped to a tile
+     *
+     * \param[in,out] frame output frame
+     * \param[in] label label to blend
+     * \param[in] at top left corner of the label in the frame
+     * \param[in] tile area of the frame the label may cover
+     */
+    static void blend(
+        cv::Mat& frame,
+        Label const& label,
+        cv::Point const& at,
+        cv::Rect const& tile);
+
+private:
+    /** overlay settings */
+    OverlayConfig m_config;
+
+    /** camera names, by camera index */
+    std::vector<std::string> m_names;
+
+    /** name label of each camera, by camera index, empty until drawn */
+    std::vector<LabelPtr> m_nameLabels;
+
+    /** status label shared by all cameras without signal */
+    LabelPtr m_noSignalLabel;
+
+    /** clock label shared by all tiles */
+    LabelPtr m_clockLabel;
+
+    /** wall clock second m_clockLabel shows */
+    std::time_t m_clockTime = 0;
+};
+
+} // end of namespace
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef RTSP_PROXY_OVERLOAD_GOVERNOR_HPP
+#define RTSP_PROXY_OVERLOAD_GOVERNOR_HPP
+
+// STL headers
+#include <atomic>
+
+// Project headers
+#include <RtspProxyConfig.hpp>
+
+namespace rtsp_proxy_server {
+
+/**
+ * \brief Degrades the composed output gracefully under CPU pressure
+ *
+ * The compositor reports how long each composed frame took, and the output
+ * media reports how long the encoder spent on each frame. The governor keeps
+ * a moving average of both and compares the per-frame cost against the
+ * output frame interval. Under sustained overload it steps to the next
+ * configured level, and it steps back when there is headroom again.
+ */
+class OverloadGovernor {
+public:
+    /**
+     * \brief Constructor
+     *
+     * \param[in] config governor settings
+     * \param[in] outputFps output stream FPS, defines the frame budget
+     */
+    OverloadGovernor(GovernorConfig const& config, uint outputFps);
+
+    /**
+     * \brief Get parameters of the current level
+     */
+    GovernorLevel const& getLevel() const {
+        return m_config.levels[m_level];
+    }
+
+    /**
+     * \brief Report the cost of one composed frame and re-evaluate the
+     *        current level. Called from the compositor thread.
+     *
+     * \param[in] seconds time spent composing the frame
+     */
+    void reportComposeCost(double seconds);
+
+    /**
+     * \brief Report the cost of encoding one frame. Called from the
+     *        encoder streaming thread.
+     *
+     * \param[in] seconds time spent encoding the frame
+     */
+    void reportEncodeCost(double seconds);
+
+private:
+    /** governor settings */
+    GovernorConfig m_config;
+
+    /** output frame interval in seconds */
+    double m_frameInterval = 0.;
+
+    /** index of the current level in m_config.levels */
+    std::atomic<size_t> m_level = {0};
+
+    /** moving average of the compose cost in seconds */
+    double m_composeCost = 0.;
+
+    /** moving average of the encode cost in seconds */
+    std::atomic<double> m_encodeCost = {0.};
+
+    /** number of consecutive overloaded frames */
+    uint m_overloadedCount = 0;
+
+    /** number of consecutive frames with headroom */
+    uint m_headroomCount = 0;
+};
+
+} // end of namespace
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef RTSP_PROXY_METRICS_HPP
+#define RTSP_PROXY_METRICS_HPP
+
+// STL headers
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace rtsp_proxy_server {
+
+/**
+ * \brief Process wide registry of named metrics
+ *
+ * Every component of the proxy publishes its runtime values (gauges) and
+ * event counts (counters) here, so they can be reported from one place.
+ * Metric names are dot separated, e.g. "output.bitrate_kbps".
+ */
+class ProxyMetrics {
+public:
+    /**
+     * \brief Get the single instance of the metrics registry
+     */
+    static ProxyMetrics& instance();
+
+    /**
+     * \brief Set a gauge to a new value
+     */
+    void set(std::string const& name, double value);
+
+    /**
+     * \brief Add a delta to a counter, creating it if needed
+     */
+    void add(std::string const& name, double delta = 1.);
+
+    /**
+     * \brief Get the current value of a metric, or 0 if it doesn't exist
+     */
+    double get(std::string const& name) const;
+
+    /**
+     * \brief Format all metrics as "name value" lines, sorted by name
+     */
+    std::string format() const;
+
+private:
+    ProxyMetrics() = default;
+
+    /** protects m_values */
+    mutable std::mutex m_mutex;
+
+    /** all metrics by name */
+    std::map<std::string, double> m_values;
+};
+
+} // end of namespace
+
+#endif
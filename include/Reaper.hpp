@@ -0,0 +1,69 @@
+#ifndef RTSP_PROXY_REAPER_HPP
+#define RTSP_PROXY_REAPER_HPP
+
+// STL headers
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace rtsp_proxy_server {
+
+/**
+ * \brief Destroys objects whose destruction blocks, on a thread of its own
+ *
+ * Medias and processors join their threads and close camera pipelines when
+ * destroyed, which takes up to seconds. They are released from gstreamer
+ * callbacks, often on the main loop, which must keep serving all other
+ * clients meanwhile. Destructions run one after the other, in the order
+ * they were retired.
+ */
+class Reaper {
+public:
+    /**
+     * \brief Constructor. Starts the reaper thread.
+     *
+     * \param[in] metric prefix of the metrics reported: '<metric>s',
+     *            '<metric>_sec' and '<metric>_pending'
+     */
+    explicit Reaper(std::string const& metric = "server.teardown");
+
+    /**
+     * \brief Destructor
+     *
+     * Runs all pending destructions, then joins the reaper thread.
+     */
+    ~Reaper();
+
+    /**
+     * \brief Run a destruction on the reaper thread. Never blocks.
+     */
+    void retire(std::function<void()> destroy);
+
+private:
+    void reaperThread();
+
+private:
+    /** prefix of the reported metrics */
+    std::string m_metric;
+
+    /** destructions waiting to run */
+    std::deque<std::function<void()>> m_pending;
+
+    /** the reaper thread exits once m_pending is empty */
+    bool m_stopping = false;
+
+    /** protects m_pending and m_stopping */
+    std::mutex m_mutex;
+
+    /** signals new destructions */
+    std::condition_variable m_pendingCond;
+
+    std::thread m_thread;
+};
+
+} // end of namespace
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef RTSP_PROXY_REPLAY_MEDIA_HPP
+#define RTSP_PROXY_REPLAY_MEDIA_HPP
+
+// rtsp server headers
+#include <gst/rtsp-server/rtsp-media.h>
+
+// Project headers
+#include <SegmentRing.hpp>
+
+namespace rtsp_proxy_server {
+
+/**
+ * \brief Media of the replay mount point
+ *
+ * Feeds the encoded frames kept in the segment ring into the replay
+ * pipeline. The stream time starts at the oldest keyframe in the ring when
+ * the media is created, so an RTSP PLAY with a 'Range: npt=...' header seeks
+ * relative to that keyframe. Playback continues up to the live edge and then
+ * follows it.
+ */
+class ReplayMedia {
+public:
+    /**
+     * \brief Constructor
+     *
+     * \param[in] rtspMedia gstreamer media of the replay mount point
+     * \param[in] ring segment ring holding the encoded output
+     */
+    ReplayMedia(GstRTSPMedia* rtspMedia, SegmentRing& ring);
+
+    ~ReplayMedia();
+
+private:
+    /**
+     * \brief Callback feeding the next frame from the ring to the appsrc
+     */
+    static void onNeedData(
+        GstElement* gstSrc,
+        guint size,
+        ReplayMedia* media);
+
+    /**
+     * \brief Callback repositioning the ring reader on a seek
+     *
+     * \param[in] offset requested stream time in nanoseconds
+     */
+    static gboolean onSeekData(
+        GstElement* gstSrc,
+        guint64 offset,
+        ReplayMedia* media);
+
+private:
+    /** segment ring holding the encoded output */
+    SegmentRing& m_ring;
+
+    /** the source element of the replay pipeline */
+    GstElement* m_appsrc = nullptr;
+
+    /** wall clock timestamp corresponding to the stream time 0 */
+    uint64_t m_origin = 0;
+
+    /** position of the next frame in the ring. Only used from the appsrc
+     *  streaming thread, seeks are serialized with it by the appsrc */
+    SegmentPosition m_position;
+
+    /** true if the ring has data to replay */
+    bool m_valid = false;
+};
+
+} // end of namespace
+
+#endif
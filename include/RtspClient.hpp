@@ -35,29 +35,25 @@ public:
 
 private:
     /**
-     * \brief Callback for constructing RtspMedia objects
-     *
-     * GST server factory calls this callback on "media-constructed" event
+     * \brief The client started playing a media
      */
-    static void onConstructRtspMedia(
-        GstRTSPMediaFactory*,
-        GstRTSPMedia* gstRtspMedia,
+    static void onPlayRequest(
+        GstRTSPClient* gstClient,
+        GstRTSPContext* ctx,
         RtspClient* client);
 
+private:
     /** instance of the server this client connected to */
     RtspServer* m_server = nullptr;
 
-    /** instance of the RTSP media this client instantiated */
-    RtspMedia* m_rtspMedia = nullptr;
-
     /** pointer to internal instance of the gstreamer media object */
     GstRTSPClient* m_gstClient = nullptr;
 
-    /** ID for gstreamer media callback created for this client */
-    gulong m_mediaConstructedHandlerId = 0;
-
     /** ID for gstreamer media callback created for this client */
     gulong m_cliendClosedHandlerId = 0;
+
+    /** ID of the play request callback */
+    gulong m_playRequestHandlerId = 0;
 };
 
 } // end of namespace
@@ -1,7 +1,11 @@
 #ifndef RTSP_PROXY_RTSP_MEDIA_HPP
 #define RTSP_PROXY_RTSP_MEDIA_HPP
 
+#include <array>
+#include <atomic>
+#include <deque>
 #include <memory>
+#include <mutex>
 #include <chrono>
 
 // gstreamer headers
@@ -16,29 +20,230 @@
 #include <RtspProxyProcessor.hpp>
 #include <RtspProxyConfig.hpp>
 #include <OpenCvReader.hpp>
+#include <AdaptiveBitrateController.hpp>
+#include <SegmentRing.hpp>
 
 namespace rtsp_proxy_server {
 
 using QuadFrame = std::vector<cv::Mat>;
 
+class RtspServer;
+
+class RtspMedia;
+
+/**
+ * \brief Shared ownership of a media. Attached to its gstreamer media, and
+ *        taken by whoever uses it outside of gstreamer callbacks.
+ */
+using RtspMediaPtr = std::shared_ptr<RtspMedia>;
+
 class RtspMedia {
 
 public:
+    /**
+     * \brief Constructor
+     *
+     * \param[in] rtspMedia gstreamer media this object feeds. The media
+     *            owns this object.
+     * \param[in] server RTSP server providing the configuration and the
+     *            shared replay and snapshot services
+     */
     RtspMedia(
         GstRTSPMedia* rtspMedia,
-        std::shared_ptr<RtspProxyConfig> config);
+        RtspServer* server);
 
     ~RtspMedia();
 
+    /**
+     * \brief A client started playing the media. Asks the encoder for a
+     *        keyframe, and measures how long the client waits for it.
+     *
+     * Called from the client's thread. The keyframe is forced by the next
+     * frame pushed into the pipeline, at most once per
+     * output_keyframe_min_interval_ms: a request within the interval stays
+     * pending and is served by the first frame after it.
+     */
+    void requestKeyframe();
+
+    /**
+     * \brief The gstreamer media is being finalized. Stops the callbacks
+     *        that could still reach this object from the main loop, the
+     *        object itself may be destroyed later on another thread.
+     */
+    void detach();
+
 private:
+    /**
+     * \brief Lets the adaptive bitrate timer outlive the media. The timer
+     *        runs on the main loop, the media is destroyed elsewhere.
+     */
+    struct TimerGuard {
+        /** media the timer samples, nullptr once it is detached */
+        RtspMedia* media = nullptr;
+
+        /** held while the timer runs, and while the media detaches */
+        std::mutex mutex;
+    };
+
+    using TimerGuardPtr = std::shared_ptr<TimerGuard>;
+
+    /**
+     * \brief Get the next frame of the mosaic, or of the view
+     *
+     * \param[out] frameId processor sequence number of a mosaic frame
+     */
+    CvMatPtr popFrame(uint64_t* frameId);
+
     static GstFlowReturn onNeedData(
         GstElement* gstSrc,
         guint size,
         RtspMedia* media);
 
+    /**
+     * \brief Buffer probe on the encoder input, remembers when the encoder
+     *        started working on a frame
+     */
+    static GstPadProbeReturn onEncoderSinkBuffer(
+        GstPad* pad,
+        GstPadProbeInfo* info,
+        RtspMedia* media);
+
+    /**
+     * \brief Probe on the encoder output. Reports the encode cost of a frame
+     *        to the overload governor, and tees encoded frames and caps into
+     *        the replay ring.
+     */
+    static GstPadProbeReturn onEncoderSrcBuffer(
+        GstPad* pad,
+        GstPadProbeInfo* info,
+        RtspMedia* media);
+
+    /**
+     * \brief Send a pending keyframe request to the encoder, if the
+     *        minimum interval since the last one has passed
+     */
+    void forceKeyframe();
+
+    /**
+     * \brief The encoder produced a keyframe
+     */
+    void onKeyframe();
+
+    /**
+     * \brief Periodic callback sampling RTCP receiver reports and the
+     *        encoder input queue, and adjusting the encoder bitrate
+     */
+    static gboolean onAdaptiveBitrateTimer(TimerGuardPtr* guard);
+
+    /**
+     * \brief Sample the clients and the queue, and adjust the bitrate
+     */
+    void adaptBitrate();
+
+    /**
+     * \brief Bus sync handler applying the output placement to every new
+     *        streaming thread of the output pipeline
+     */
+    static GstBusSyncReply onBusSync(
+        GstBus* bus,
+        GstMessage* message,
+        ThreadRoleConfig* placement);
+
+    /**
+     * \brief Collect the worst loss and jitter reported by all clients
+     *        through RTCP receiver reports
+     */
+    void sampleReceiverReports(BitrateSample& sample);
+
 private:
+    /** gstreamer media object this media is attached to */
+    GstRTSPMedia* m_gstMedia = nullptr;
+
+    /**
+     * output encoder element, used for runtime bitrate changes and forced
+     * keyframes
+     */
+    GstElement* m_encoder = nullptr;
+
+    /** encoder pads and probes measuring the encode cost */
+    GstPad* m_encoderSinkPad = nullptr;
+    GstPad* m_encoderSrcPad = nullptr;
+    gulong m_encoderSinkProbeId = 0;
+    gulong m_encoderSrcProbeId = 0;
+
+    /**
+     * \brief A frame being encoded
+     */
+    struct EncodeStart {
+        /** PTS of the frame */
+        GstClockTime pts = 0;
+
+        /** time the frame entered the encoder */
+        std::chrono::steady_clock::time_point time;
+
+        /** frame number of the frame, for tracing */
+        guint64 frame = 0;
+    };
+
+    /** frames being encoded */
+    std::deque<EncodeStart> m_encodeStarts;
+
+    /** protects m_encodeStarts */
+    std::mutex m_encodeStartsMutex;
+
+    /** keyframe settings */
+    KeyframeConfig m_keyframeConfig;
+
+    /** a client waits for a forced keyframe */
+    std::atomic<bool> m_keyframeWanted = {false};
+
+    /** a keyframe was forced, but the encoder hasn't produced it yet */
+    bool m_keyframeInFlight = false;
+
+    /** time the last keyframe was forced */
+    std::chrono::steady_clock::time_point m_keyframeForcedTime;
+
+    /** a client started playing and hasn't got a keyframe yet */
+    bool m_playPending = false;
+
+    /** time the first client waiting for a keyframe started playing */
+    std::chrono::steady_clock::time_point m_playTime;
+
+    /** protects the keyframe state above, except m_keyframeWanted */
+    std::mutex m_keyframeMutex;
+
+    /** trade throughput for latency, see getOutputLowLatency() */
+    bool m_lowLatency = false;
+
+    /** number of frames whose compose time is remembered */
+    static constexpr size_t COMPOSE_TIMES = 64;
+
+    /**
+     * compose start of the frames being encoded, in steady clock
+     * nanoseconds by frame number modulo the size. 0 for repeated frames.
+     */
+    std::array<std::atomic<int64_t>, COMPOSE_TIMES> m_composeTimes {};
+
+    /** average time from compose start to encoded frame */
+    double m_frameLatencyMs = 0.;
+
+    /** replay ring receiving the encoded output */
+    SegmentRing* m_segmentRing = nullptr;
+
+    /** decides encoder bitrate from RTCP feedback and queue depth */
+    std::unique_ptr<AdaptiveBitrateController> m_bitrateController;
+
+    /** guard shared with the periodic adaptive bitrate timer */
+    TimerGuardPtr m_bitrateTimerGuard;
+
+    /** fill level (0..1) of the encoder input queue, updated by onNeedData */
+    std::atomic<double> m_queueFill = {0.};
+
     /** The RTSP proxy processor that gives us ready to display video frames */
-    RtspProxyProcessor m_rtspProxyProcessor;
+    std::shared_ptr<RtspProxyProcessor> m_rtspProxyProcessor;
+
+    /** frames of the view this media streams, empty for the mosaic */
+    ViewOutputPtr m_view;
 
     /** last received frame from the processor */
     CvMatPtr m_lastFrame;
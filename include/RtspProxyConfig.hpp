@@ -15,6 +15,509 @@ struct FrameDimensions {
     uint height = 0;
 };
 
+/**
+ * \brief Engine composing the mosaic of the output mount point
+ */
+enum class OutputEngine {
+    /**
+     * camera frames are decoded into OpenCV, composed by the processor and
+     * pushed into the output pipeline
+     */
+    OpenCv,
+
+    /**
+     * the camera pipelines feed a compositor element, the mosaic goes
+     * straight into the encoder
+     */
+    GStreamer,
+};
+
+/**
+ * \brief Settings of the file replay ingest. Recorded camera files replace
+ *        the camera pipelines, for reproducible runs without cameras.
+ */
+struct FileIngestConfig {
+    /** replay files instead of opening the camera pipelines */
+    bool enabled = false;
+
+    /**
+     * replay each file at its frame rate. Otherwise frames are decoded as
+     * fast as the compositor takes them, and the proxy runs headless.
+     */
+    bool realtime = true;
+
+    /** start over at the end of a file */
+    bool loop = true;
+
+    /** frame rate of files without timing, e.g. raw H.264. 0 to use the
+     *  rate reported by the file. */
+    double fps = 0.;
+
+    /** seconds to run headless, 0 to run until all files ended */
+    uint duration = 0;
+
+    /**
+     * encode the composed frames with the output pipeline when running
+     * headless, to measure the whole output path
+     */
+    bool encode = false;
+};
+
+/**
+ * \brief Settings of the adaptive jitter buffer of the cameras. Each camera
+ *        gets the smallest jitter buffer latency its link supports.
+ */
+struct JitterBufferConfig {
+    /**
+     * run the camera pipelines directly instead of through OpenCV, watch
+     * their jitter buffers and adapt their latency
+     */
+    bool enabled = false;
+
+    /** latency limits in milliseconds */
+    uint minMs = 0;
+    uint maxMs = 1000;
+
+    /** latency of a newly opened camera in milliseconds */
+    uint initialMs = 200;
+
+    /** latency is lowered by this amount after a run of healthy samples */
+    uint stepMs = 20;
+
+    /** fraction of packets arriving too late (0..1) to raise the latency */
+    double lateHigh = 0.002;
+
+    /** latency is kept above this multiple of the measured jitter */
+    double jitterFactor = 3.;
+
+    /** number of consecutive healthy samples before lowering the latency */
+    uint downSamples = 10;
+
+    /** sampling interval in milliseconds */
+    uint intervalMs = 1000;
+};
+
+/**
+ * \brief Settings of the camera reconnects. A camera that failed to open,
+ *        or delivered no frame for a while, is reopened with exponential
+ *        backoff, trying its backup pipelines in turn.
+ */
+struct ReconnectConfig {
+    /** reopen failed and stalled cameras */
+    bool enabled = true;
+
+    /** a camera without a new frame for this long is reopened */
+    uint stallMs = 5000;
+
+    /** delay before the first attempt, doubled after each failed round */
+    uint backoffMinMs = 500;
+
+    /** longest delay between two attempts */
+    uint backoffMaxMs = 30000;
+
+    /**
+     * random fraction (0..1) a delay is shortened by, so cameras behind
+     * the same recorder don't reconnect in lockstep
+     */
+    double jitter = 0.3;
+};
+
+/**
+ * \brief Settings of the ingest workers. Cameras are decoded in child
+ *        processes of the proxy, which publish the frames into shared
+ *        memory rings, so a crashing decoder only takes down its worker.
+ */
+struct IngestWorkersConfig {
+    /** decode the cameras in worker processes */
+    bool enabled = false;
+
+    /** cameras decoded by each worker */
+    uint cameras = 1;
+
+    /** frames in the ring of each camera */
+    uint slots = 4;
+
+    /** delay before a worker that exited is started again */
+    uint restartMs = 1000;
+};
+
+/**
+ * \brief Settings of the adaptive encoder bitrate control. The bitrate of
+ *        the output encoder follows RTCP receiver reports of the attached
+ *        clients and the depth of the encoder input queue.
+ */
+struct AdaptiveBitrateConfig {
+    /** enable runtime bitrate adjustments */
+    bool enabled = false;
+
+    /** bitrate limits in kbit/s */
+    uint minKbps = 500;
+    uint maxKbps = 8000;
+
+    /** bitrate is multiplied by this factor on each step down */
+    double stepDownFactor = 0.75;
+
+    /** bitrate is increased by this amount on each step up */
+    uint stepUpKbps = 250;
+
+    /** reported fraction of lost packets (0..1) considered congested */
+    double lossHigh = 0.05;
+
+    /** reported fraction of lost packets (0..1) considered healthy */
+    double lossLow = 0.01;
+
+    /** reported inter-arrival jitter considered congested */
+    double jitterHighMs = 40.;
+
+    /** encoder input queue fill level (0..1) considered congested */
+    double queueHigh = 0.75;
+
+    /** number of consecutive congested samples before stepping down */
+    uint downSamples = 2;
+
+    /** number of consecutive healthy samples before stepping up */
+    uint upSamples = 5;
+
+    /** sampling interval in milliseconds */
+    uint intervalMs = 1000;
+};
+
+/**
+ * \brief Settings of how quickly a client joining the output gets its first
+ *        decodable picture
+ */
+struct KeyframeConfig {
+    /** ask the output encoder for a keyframe when a client starts playing */
+    bool onPlay = true;
+
+    /**
+     * minimum time between forced keyframes in milliseconds. Clients
+     * starting within this time share one keyframe.
+     */
+    uint minIntervalMs = 1000;
+
+    /**
+     * refresh the picture gradually with intra coded stripes instead of
+     * keyframes, which avoids their bitrate spikes. Keyframes are not forced
+     * then, new clients recover within one keyframe interval.
+     */
+    bool intraRefresh = false;
+};
+
+/**
+ * \brief One degradation level of the overload governor
+ */
+struct GovernorLevel {
+    /** compose only every N-th output frame interval */
+    uint fpsDivisor = 1;
+
+    /** scale (0..1] of the compose canvas relative to the output frame */
+    double composeScale = 1.;
+
+    /** refresh only one out of N tiles in each composed frame */
+    uint tileSkip = 1;
+};
+
+/**
+ * \brief Settings of the labels burned into the camera tiles of the mosaic
+ */
+struct OverlayConfig {
+    /** draw the labels */
+    bool enabled = false;
+
+    /**
+     * name of each camera, by input pipeline index. Cameras without a name
+     * are labelled "Camera <N>".
+     */
+    std::vector<std::string> cameraNames;
+
+    /** draw the wall clock time into each tile */
+    bool clock = true;
+
+    /** OpenCV Hershey font scale of the labels, in output pixels */
+    double fontScale = 0.7;
+
+    /** a camera without a new frame for this long shows "NO SIGNAL" */
+    uint noSignalMs = 2000;
+};
+
+/**
+ * \brief Settings of the raw frame output into shared memory, for consumers
+ *        on the same host
+ */
+struct ShmOutputConfig {
+    /** publish the composed frames */
+    bool enabled = false;
+
+    /**
+     * POSIX shared memory name prefix. The mosaic ring is "<name>-mosaic",
+     * the camera rings "<name>-cam<N>".
+     */
+    std::string name = "/rtsp-proxy";
+
+    /** frames in each ring */
+    uint slots = 4;
+
+    /** also publish the decoded frames of each camera */
+    bool cameras = false;
+};
+
+/**
+ * \brief Settings of the overload governor. The governor compares the
+ *        per-frame cost of composing and encoding against the output
+ *        frame interval, and steps through 'levels' under sustained load.
+ */
+struct GovernorConfig {
+    /** enable stepping through the levels */
+    bool enabled = false;
+
+    /** load (cost / frame interval) above which a frame is overloaded */
+    double overloadRatio = 0.9;
+
+    /** load below which a frame has enough headroom */
+    double headroomRatio = 0.5;
+
+    /** number of consecutive overloaded frames before stepping down */
+    uint downFrames = 30;
+
+    /** number of consecutive frames with headroom before stepping up */
+    uint upFrames = 150;
+
+    /** degradation levels, first one is the normal operation */
+    std::vector<GovernorLevel> levels;
+};
+
+/**
+ * \brief Settings of the timeshift/replay ring. The encoded output is kept
+ *        in a ring of memory mapped segment files and served on a replay
+ *        mount point.
+ */
+struct ReplayConfig {
+    /** enable the replay ring and mount point */
+    bool enabled = false;
+
+    /** mount point serving the replay */
+    std::string path = "/replay";
+
+    /** directory holding the segment files */
+    std::string directory = "/tmp/rtsp-proxy-replay";
+
+    /** number of segment files */
+    size_t segmentCount = 32;
+
+    /** size of one segment file in bytes */
+    size_t segmentSize = 16 * 1024 * 1024;
+
+    /** number of encoded frames queued between the live path and the
+     *  segment writer */
+    size_t queueSize = 64;
+
+    /** gstreamer pipeline of the replay mount point */
+    std::string pipeline;
+};
+
+/**
+ * \brief Settings of the local HTTP endpoint serving snapshots and metrics
+ */
+struct HttpConfig {
+    /** enable the HTTP endpoint */
+    bool enabled = false;
+
+    /** local address to listen on */
+    std::string address = "127.0.0.1";
+
+    /** TCP port to listen on */
+    ushort port = 8080;
+
+    /** number of threads serving requests */
+    uint threads = 4;
+
+    /** quality (0..100) of JPEG snapshots */
+    int jpegQuality = 80;
+};
+
+/**
+ * \brief When the output media is kept prepared while no client plays it
+ */
+enum class MediaPersistence {
+    /** the media is prepared by the first client, and unprepared after
+     *  the last one left */
+    None,
+
+    /** the media is prepared before the first client connects */
+    Startup,
+
+    /** the media prepared for the first client is kept */
+    FirstUse,
+};
+
+/**
+ * \brief Settings of the RTSP server serving the output
+ */
+struct ServerConfig {
+    /** TCP port of the RTSP server */
+    ushort port = 8554;
+
+    /**
+     * number of threads serving RTSP clients. Each client is assigned to
+     * one of the threads, and its requests and RTCP are handled in that
+     * thread's own main context. One, the gst-rtsp-server default, serves
+     * them all from a single thread. Zero serves them from the main loop.
+     */
+    uint threads = 1;
+
+    /** maximum number of pending connections on the listening socket */
+    int backlog = 128;
+
+    /** keep the output media prepared while no client plays it */
+    MediaPersistence mediaPersistence = MediaPersistence::None;
+};
+
+/**
+ * \brief Settings of RTP multicast delivery of the output mount point. The
+ *        encoded stream is sent once to a multicast group, RTSP is only used
+ *        to set up the sessions.
+ */
+struct MulticastConfig {
+    /** allow clients to request multicast transport */
+    bool enabled = false;
+
+    /** refuse unicast transports, so egress never depends on viewers */
+    bool only = false;
+
+    /**
+     * range of multicast groups to allocate from. Groups in 232.0.0.0/8
+     * are source-specific (SSM), all others any-source (ASM).
+     */
+    std::string addressMin = "224.3.0.1";
+    std::string addressMax = "224.3.0.10";
+
+    /** range of UDP ports to allocate RTP/RTCP port pairs from */
+    ushort portMin = 5000;
+    ushort portMax = 5009;
+
+    /** TTL of multicast packets */
+    uint ttl = 1;
+
+    /** interface to send multicast from, empty for the default route */
+    std::string iface;
+};
+
+/**
+ * \brief Settings of viewports: additional streams of the output mount
+ *        point, selected by the URL query, e.g. rtsp://host/be?cam=2
+ */
+struct ViewConfig {
+    /** accept view parameters in output URLs */
+    bool enabled = false;
+
+    /** dimensions of a view stream */
+    uint width = 1920;
+    uint height = 1080;
+
+    /** maximum number of different views streamed at the same time */
+    uint maxViews = 4;
+
+    /** gstreamer pipeline encoding a view */
+    std::string pipeline;
+};
+
+/**
+ * \brief CPU placement and scheduling of one thread role
+ */
+struct ThreadRoleConfig {
+    /** CPUs the threads may run on, e.g. "0-3,8". Empty for all CPUs. */
+    std::string cpus;
+
+    /** scheduling policy: "other", "batch", "idle", "fifo" or "rr" */
+    std::string policy = "other";
+
+    /** real time priority (1..99) for the "fifo" and "rr" policies */
+    int priority = 0;
+
+    /** nice value (-20..19) for the other policies */
+    int nice = 0;
+
+    /**
+     * \brief Check if the role changes anything compared to the defaults
+     */
+    bool isSet() const {
+        return not cpus.empty() || policy != "other" || nice != 0;
+    }
+};
+
+/**
+ * \brief Placement of the proxy threads on CPUs and NUMA nodes
+ */
+struct PlacementConfig {
+    /** the main loop, serving RTSP requests if server_threads is 0 */
+    ThreadRoleConfig main;
+
+    /** camera reader threads, and decoder threads they start */
+    ThreadRoleConfig input;
+
+    /** the compositor thread */
+    ThreadRoleConfig processor;
+
+    /** streaming threads of the output pipeline (appsrc, encoder) */
+    ThreadRoleConfig output;
+
+    /** analytics worker threads */
+    ThreadRoleConfig analytics;
+
+    /**
+     * allocate decoded camera frames on the NUMA node of the processor
+     * CPUs, which reads them
+     */
+    bool numaFrameBuffers = false;
+};
+
+/**
+ * \brief Settings of the motion analytics run next to the compositor
+ */
+struct AnalyticsConfig {
+    /** analyse the camera frames */
+    bool enabled = false;
+
+    /** frames analysed per second and camera, at most */
+    double fps = 2.;
+
+    /** width the frames are scaled down to before the analysis */
+    uint width = 320;
+
+    /** number of worker threads */
+    uint workers = 2;
+
+    /**
+     * number of frames waiting for a worker. Frames arriving while the
+     * queue is full are dropped.
+     */
+    uint queueSize = 8;
+
+    /** luma difference (0..255) of a pixel considered moving */
+    uint threshold = 25;
+
+    /** smallest reported motion area, as a fraction of the frame */
+    double minArea = 0.002;
+
+    /** draw the motion boxes into the tiles of the mosaic */
+    bool overlay = true;
+};
+
+/**
+ * \brief Settings of per frame tracing
+ */
+struct TraceConfig {
+    /** record when each frame passes each stage */
+    bool enabled = false;
+
+    /** number of events kept for each thread */
+    uint eventsPerThread = 16384;
+
+    /** file the trace is written to on SIGUSR1 */
+    std::string path = "rtsp-proxy-trace.json";
+};
+
 class RtspProxyConfig {
 public:
     /**
@@ -35,6 +538,15 @@ public:
         return m_inputPipelines;
     }
 
+    /**
+     * \brief Get the backup pipelines of each camera, tried in turn when
+     *        its pipeline fails. Empty for cameras without backups.
+     */
+    std::vector<CameraPipelines> const& getInputBackupPipelines() const
+    {
+        return m_inputBackupPipelines;
+    }
+
     /**
      * \brief Get number of configured input pipelines
      */
@@ -50,6 +562,30 @@ public:
      */
     uint getInputBufferSize() const { return m_inputBufferSize; }
 
+    /**
+     * \brief Get file replay ingest settings
+     */
+    FileIngestConfig const& getFileIngest() const { return m_fileIngest; }
+
+    /**
+     * \brief Get adaptive jitter buffer settings of the cameras
+     */
+    JitterBufferConfig const& getJitterBuffer() const {
+        return m_jitterBuffer;
+    }
+
+    /**
+     * \brief Get camera reconnect settings
+     */
+    ReconnectConfig const& getReconnect() const { return m_reconnect; }
+
+    /**
+     * \brief Get ingest worker settings
+     */
+    IngestWorkersConfig const& getIngestWorkers() const {
+        return m_ingestWorkers;
+    }
+
     /**
      * \brief Get gstreamer output pipeline for the RTSP proxy server
      */
@@ -73,17 +609,170 @@ public:
         return m_outputDimensions;
     }
 
+    /**
+     * \brief Get number of camera tiles per row of the mosaic, 0 if all
+     *        cameras are in one row
+     */
+    uint getMosaicColumns() const { return m_mosaicColumns; }
+
+    /**
+     * \brief Get name of the encoder element in the output pipeline
+     */
+    std::string const& getOutputEncoderName() const {
+        return m_outputEncoderName;
+    }
+
+    /**
+     * \brief Get whether the output trades throughput for latency: tiles
+     *        are composed in parallel, the output always takes the newest
+     *        composed frame and the encoder uses sliced threads
+     */
+    bool getOutputLowLatency() const { return m_outputLowLatency; }
+
+    /**
+     * \brief Get the engine composing the mosaic
+     */
+    OutputEngine getOutputEngine() const { return m_outputEngine; }
+
+    /**
+     * \brief Get settings of the labels burned into the camera tiles
+     */
+    OverlayConfig const& getOverlay() const { return m_overlay; }
+
+    /**
+     * \brief Get settings of the raw frame output into shared memory
+     */
+    ShmOutputConfig const& getShmOutput() const { return m_shmOutput; }
+
+    /**
+     * \brief Get adaptive bitrate settings for the output encoder
+     */
+    AdaptiveBitrateConfig const& getAdaptiveBitrate() const {
+        return m_adaptiveBitrate;
+    }
+
+    /**
+     * \brief Get keyframe settings for clients joining the output
+     */
+    KeyframeConfig const& getKeyframe() const { return m_keyframe; }
+
+    /**
+     * \brief Get overload governor settings
+     */
+    GovernorConfig const& getGovernor() const { return m_governor; }
+
+    /**
+     * \brief Get multicast settings of the output mount point
+     */
+    MulticastConfig const& getOutputMulticast() const {
+        return m_outputMulticast;
+    }
+
+    /**
+     * \brief Get viewport settings of the output mount point
+     */
+    ViewConfig const& getView() const { return m_view; }
+
+    /**
+     * \brief Get timeshift/replay settings
+     */
+    ReplayConfig const& getReplay() const { return m_replay; }
+
+    /**
+     * \brief Get HTTP endpoint settings
+     */
+    HttpConfig const& getHttp() const { return m_http; }
+
+    /**
+     * \brief Get RTSP server settings
+     */
+    ServerConfig const& getServer() const { return m_server; }
+
+    /**
+     * \brief Get thread placement settings
+     */
+    PlacementConfig const& getPlacement() const { return m_placement; }
+
+    /**
+     * \brief Get motion analytics settings
+     */
+    AnalyticsConfig const& getAnalytics() const { return m_analytics; }
+
+    /**
+     * \brief Get per frame tracing settings
+     */
+    TraceConfig const& getTrace() const { return m_trace; }
+
+    /**
+     * \brief Get whether the configuration file is watched and reloaded
+     *        when it changes
+     */
+    bool getConfigWatch() const { return m_configWatch; }
+
+    /**
+     * \brief Get interval in seconds between metrics reports printed by
+     *        the server. Zero disables the reports.
+     */
+    uint getMetricsReportInterval() const { return m_metricsReportInterval; }
+
 private:
     ushort m_inputRtspPort = 554;
     uint m_inputBufferSize = 3;
 
     CameraPipelines m_inputPipelines;
 
+    std::vector<CameraPipelines> m_inputBackupPipelines;
+
+    FileIngestConfig m_fileIngest;
+
+    JitterBufferConfig m_jitterBuffer;
+
+    ReconnectConfig m_reconnect;
+
+    IngestWorkersConfig m_ingestWorkers;
+
     uint m_outputFps = 0;
     FrameDimensions m_outputDimensions;
+    uint m_mosaicColumns = 0;
 
     std::string m_outputPath;
     std::string m_outputPipeline;
+
+    std::string m_outputEncoderName = "encoder";
+
+    bool m_outputLowLatency = false;
+
+    OutputEngine m_outputEngine = OutputEngine::OpenCv;
+
+    OverlayConfig m_overlay;
+
+    ShmOutputConfig m_shmOutput;
+
+    AdaptiveBitrateConfig m_adaptiveBitrate;
+
+    KeyframeConfig m_keyframe;
+
+    GovernorConfig m_governor;
+
+    MulticastConfig m_outputMulticast;
+
+    ViewConfig m_view;
+
+    ReplayConfig m_replay;
+
+    HttpConfig m_http;
+
+    ServerConfig m_server;
+
+    PlacementConfig m_placement;
+
+    AnalyticsConfig m_analytics;
+
+    TraceConfig m_trace;
+
+    uint m_metricsReportInterval = 0;
+
+    bool m_configWatch = false;
 };
 
 } // end of namespace
@@ -5,7 +5,10 @@
 #include <semaphore.h>
 
 // STL headers
+#include <array>
 #include <atomic>
+#include <chrono>
+#include <mutex>
 #include <thread>
 
 // Boost headers
@@ -13,16 +16,56 @@
 
 // Project headers
 #include <RtspProxyConfig.hpp>
+#include <AnalyticsEngine.hpp>
 #include <OpenCvReader.hpp>
+#include <OverloadGovernor.hpp>
+#include <OverlayRenderer.hpp>
+#include <Reaper.hpp>
+#include <ShmOutput.hpp>
+#include <SnapshotCache.hpp>
+#include <Viewport.hpp>
 
 namespace rtsp_proxy_server {
 
+/**
+ * \brief Frames composed for one view, consumed by the media streaming it
+ */
+struct ViewOutput {
+    ViewOutput(Viewport const& v, cv::Size const& s, size_t bufferSize)
+        :
+        viewport(v),
+        size(s),
+        buffer(bufferSize)
+    {
+    }
+
+    /** part of the mosaic to compose */
+    Viewport viewport;
+
+    /** dimensions of the view frames */
+    cv::Size size;
+
+    /** composed frames waiting for the media */
+    FrameBuffer buffer;
+};
+
+using ViewOutputPtr = std::shared_ptr<ViewOutput>;
+
 class RtspProxyProcessor {
 public:
     /**
      * \brief Constructor
+     *
+     * \param[in] config RTSP proxy server configuration
+     * \param[in] snapshotCache cache receiving the latest composed and
+     *            camera frames, or nullptr if snapshots are disabled
+     * \param[in] analytics analytics offered the camera frames, or nullptr
+     *            if they are disabled. Must outlive the processor.
      */
-    RtspProxyProcessor(std::shared_ptr<const RtspProxyConfig>);
+    RtspProxyProcessor(
+        std::shared_ptr<const RtspProxyConfig> config,
+        SnapshotCache* snapshotCache = nullptr,
+        AnalyticsEngine* analytics = nullptr);
 
     /**
      * \brief Destructor
@@ -33,12 +76,80 @@ public:
 
     bool isConnected() const;
 
-    CvMatPtr getFrame() {
+    /**
+     * \brief Get the next composed frame, if any
+     *
+     * \param[out] frameId sequence number of the frame among all composed
+     *             frames, used to trace it
+     */
+    CvMatPtr getFrame(uint64_t* frameId = nullptr) {
         CvMatPtr ptr;
-        m_buffer.pop(ptr);
+        if (m_buffer.pop(ptr)) {
+            if (frameId) {
+                *frameId = m_poppedFrames;
+            }
+            m_poppedFrames++;
+        }
         return ptr;
     }
 
+    /**
+     * \brief Get the time a recently composed frame started to be composed
+     *
+     * \param[in] frameId frame ID returned by getFrame()
+     *
+     * \return steady clock nanoseconds, 0 if unknown
+     */
+    int64_t getComposeTime(uint64_t frameId) const {
+        return m_composeTimes[frameId % m_composeTimes.size()].load(
+            std::memory_order_acquire);
+    }
+
+    /**
+     * \brief Get number of processed frames waiting for the consumer.
+     *        Must be called from the consumer thread.
+     */
+    size_t getQueueDepth() const { return m_buffer.read_available(); }
+
+    /**
+     * \brief Get maximum number of processed frames waiting for the consumer
+     */
+    size_t getQueueCapacity() const { return m_bufferSize; }
+
+    /**
+     * \brief Start composing a view next to the mosaic
+     *
+     * \param[in] viewport part of the mosaic to compose
+     * \param[in] size dimensions of the view frames
+     *
+     * \return output receiving the view frames, to be passed to removeView()
+     *         when the view is no longer streamed
+     */
+    ViewOutputPtr addView(Viewport const& viewport, cv::Size const& size);
+
+    /**
+     * \brief Stop composing a view
+     */
+    void removeView(ViewOutputPtr const& view);
+
+    /**
+     * \brief Apply a reloaded configuration. Only cameras whose pipeline
+     *        changed are closed and reopened, the new layout is used from
+     *        the next output frame. Output settings are not changed.
+     */
+    void reconfigure(std::shared_ptr<const RtspProxyConfig> config);
+
+    /**
+     * \brief Check if all replayed input files ended and their frames were
+     *        composed
+     */
+    bool isInputFinished() const { return m_inputFinished; }
+
+    /**
+     * \brief Get the governor that degrades the output under CPU pressure
+     */
+    OverloadGovernor& getGovernor() { return m_governor; }
+
 private:
     /**
      * \brief Start RTSP proxy processor
@@ -56,6 +167,66 @@ private:
      */
     void rtspProxyProcessorThread();
 
+    /**
+     * \brief Compose the last frames of all cameras into a new output frame
+     *
+     * \param[in] level current governor level defining the compose scale
+     *            and the tiles to refresh
+     * \param[in] idx sequence number of the composed frame
+     *
+     * \return new output frame, or empty pointer on failure
+     */
+    CvMatPtr composeFrame(GovernorLevel const& level, uint64_t idx);
+
+    /**
+     * \brief Offer the frames of all current cameras to the analytics, by
+     *        their current index
+     */
+    void attachAnalytics();
+
+    /**
+     * \brief Draw the camera labels and motion boxes into a composed output
+     *        frame
+     */
+    void drawOverlay(cv::Mat& frame);
+
+    /**
+     * \brief Publish the jitter buffer and reconnect statistics of every
+     *        camera as 'input.cam<N>.*' metrics
+     */
+    void publishIngestStats();
+
+    /**
+     * \brief Compose the last frames of the cameras inside a view
+     *
+     * \return new view frame, or empty pointer on failure
+     */
+    CvMatPtr composeView(ViewOutput const& view);
+
+    /**
+     * \brief Replace readers according to a configuration passed to
+     *        reconfigure(), if any. Called from the processor thread.
+     */
+    void applyPendingConfig();
+
+    /**
+     * \brief Open the reader of a camera, reading from its ingest worker if
+     *        workers are enabled
+     */
+    std::unique_ptr<OpenCvReader> openReader(
+        RtspProxyConfig const& config,
+        size_t cam);
+
+    /**
+     * \brief Create a black placeholder frame for a camera without frames
+     */
+    static CvMatPtr makeEmptyFrame();
+
+    /**
+     * \brief Get the area of a camera tile on a canvas of a given size
+     */
+    cv::Rect getTileRect(size_t idx, cv::Size const& canvasSize) const;
+
 private:
     /** readers for all camera inputs */
     std::vector<std::unique_ptr<OpenCvReader>> m_openCvReaders;
@@ -63,20 +234,106 @@ private:
     /** last received frames for all cameras */
     std::vector<CvMatPtr> m_lastFrame;
 
+    /** arrival of m_lastFrame, or when the camera was opened */
+    std::vector<std::chrono::steady_clock::time_point> m_lastFrameTime;
+
     /** A consumer created semaphore to signal that a video frame is ready */
     sem_t m_videoFrameReadySemaphore;
 
     /** Circular buffer to store processed OpenCV video frames */
     FrameBuffer m_buffer;
 
+    /**
+     * Number of frames queued into m_buffer by the processor thread, and
+     * taken out of it by the consumer. They number the frames for tracing.
+     */
+    uint64_t m_pushedFrames = 0;
+    uint64_t m_poppedFrames = 0;
+
+    /**
+     * Compose start of the last queued frames, by frame ID modulo the size.
+     * Read by the consumer to measure the output latency.
+     */
+    std::array<std::atomic<int64_t>, 64> m_composeTimes {};
+
+    /** Size of the circular buffer of processed frames */
+    size_t m_bufferSize = 0;
+
     /** Dimensions of an output frame */
     cv::Size m_outputSize;
 
+    /** Output stream FPS */
+    uint m_outputFps = 0;
+
+    /** camera tiles per row of the mosaic, 0 for one row */
+    size_t m_mosaicColumns = 0;
+
+    /** Degrades the output under CPU pressure */
+    OverloadGovernor m_governor;
+
+    /** Views composed next to the mosaic */
+    std::vector<ViewOutputPtr> m_views;
+
+    /** protects m_views */
+    std::mutex m_viewsMutex;
+
+    /** Cache receiving the latest frames for snapshots */
+    SnapshotCache* m_snapshotCache = nullptr;
+
+    /** Analytics offered the camera frames */
+    AnalyticsEngine* m_analytics = nullptr;
+
+    /** Canvas the camera tiles are composed on, kept between frames */
+    cv::Mat m_canvas;
+
+    /** GST pipelines of m_openCvReaders, and their backups */
+    CameraPipelines m_inputPipelines;
+    std::vector<CameraPipelines> m_inputBackupPipelines;
+
+    /** CPU placement of the processor thread */
+    ThreadRoleConfig m_placement;
+
+    /** NUMA node of camera frames, -1 to not bind them */
+    int m_frameNode = -1;
+
+    /** compose the tiles in parallel */
+    bool m_lowLatency = false;
+
+    /**
+     * draws the camera labels and motion boxes, empty if neither is enabled
+     */
+    std::unique_ptr<OverlayRenderer> m_overlay;
+
+    /** publishes raw frames into shared memory, empty if disabled */
+    std::unique_ptr<ShmOutput> m_shmOutput;
+
+    /** a camera without a new frame for this long has no signal */
+    std::chrono::milliseconds m_noSignalTime;
+
+    /** compose on every new input frame instead of at the output FPS */
+    bool m_unpaced = false;
+
+    /** Indicates all replayed input files ended */
+    std::atomic<bool> m_inputFinished = {false};
+
+    /** Configuration waiting to be applied by the processor thread */
+    std::shared_ptr<const RtspProxyConfig> m_pendingConfig;
+
+    /** protects m_pendingConfig */
+    std::mutex m_pendingConfigMutex;
+
     /** Thread to read and process all input RTSP frames */
     std::thread m_thread;
 
     /** Indicates if openCV thread is running */
     std::atomic<bool> m_running = {false};
+
+    /**
+     * closes readers removed by configuration reloads, one after the other,
+     * off the processor thread. Declared last, so the readers are closed
+     * before anything they use is gone.
+     */
+    Reaper m_retirer{"input.reader_teardown"};
 };
 
 } // end of namespace
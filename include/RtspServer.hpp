@@ -1,11 +1,23 @@
 #ifndef RTSP_PROXY_RTSP_SERVER_HPP
 #define RTSP_PROXY_RTSP_SERVER_HPP
 
+#include <chrono>
+#include <memory>
+#include <mutex>
 #include <unordered_map>
 
+// glib headers
+#include <gio/gio.h>
+
 // project headers
 #include <RtspProxyConfig.hpp>
+#include <AnalyticsEngine.hpp>
 #include <RtspClient.hpp>
+#include <SegmentRing.hpp>
+#include <SnapshotCache.hpp>
+#include <HttpServer.hpp>
+#include <IngestSupervisor.hpp>
+#include <Reaper.hpp>
 
 namespace rtsp_proxy_server {
 
@@ -32,7 +44,43 @@ public:
     /**
      * \brief Get RTSP proxy server configuration
      */
-    std::shared_ptr<RtspProxyConfig> getConfig() { return m_config; }
+    std::shared_ptr<RtspProxyConfig> getConfig() {
+        return std::atomic_load(&m_config);
+    }
+
+    /**
+     * \brief Get the running RTSP proxy processor, starting a new one if
+     *        no media uses it at the moment
+     */
+    std::shared_ptr<RtspProxyProcessor> acquireProcessor();
+
+    /**
+     * \brief Get the replay ring, or nullptr if replay is disabled
+     */
+    SegmentRing* getSegmentRing() { return m_segmentRing.get(); }
+
+    /**
+     * \brief Get the snapshot cache, or nullptr if the HTTP endpoint is
+     *        disabled
+     */
+    SnapshotCache* getSnapshotCache() { return m_snapshotCache.get(); }
+
+    /**
+     * \brief Get the motion analytics, or nullptr if they are disabled
+     */
+    AnalyticsEngine* getAnalytics() { return m_analytics.get(); }
+
+    /**
+     * \brief Get the reaper destroying medias and processors off the main
+     *        loop
+     */
+    Reaper* getReaper() { return m_reaper.get(); }
+
+    /**
+     * \brief A client started playing a media. With media persistence,
+     *        the first mosaic media played is kept prepared if none is yet.
+     */
+    void retainMedia(GstRTSPMedia* gstRtspMedia);
 
 private:
     /**
@@ -57,12 +105,125 @@ private:
         GstRTSPClient* gstClient,
         RtspServer* rtspProxyServer);
 
+    /**
+     * \brief Callback for constructing RtspMedia objects on the output
+     *        mount point, for the mosaic and for each view
+     */
+    static void onConstructRtspMedia(
+        GstRTSPMediaFactory*,
+        GstRTSPMedia* gstRtspMedia,
+        RtspServer* rtspProxyServer);
+
+    /**
+     * \brief Measure a media of the GStreamer engine. Its mosaic is composed
+     *        by the pipeline itself, no RtspMedia feeds it.
+     */
+    static void attachCompositor(
+        GstRTSPMedia* gstRtspMedia,
+        RtspProxyConfig const& config);
+
+    /**
+     * \brief Callback for constructing ReplayMedia objects on the replay
+     *        mount point
+     */
+    static void onConstructReplayMedia(
+        GstRTSPMediaFactory*,
+        GstRTSPMedia* gstRtspMedia,
+        RtspServer* rtspProxyServer);
+
+    /**
+     * \brief Let clients of the output mount point receive the stream from
+     *        a multicast group
+     */
+    void setupMulticast(MulticastConfig const& mcast);
+
+    /**
+     * \brief Construct and prepare the mosaic media of the output mount
+     *        point, and keep it prepared
+     */
+    void preparePersistentMedia();
+
+    /**
+     * \brief Let the kept media be torn down once its clients leave
+     */
+    void releasePersistentMedia();
+
+    /**
+     * \brief Reload the configuration file and apply it to the running
+     *        processor
+     */
+    void reloadConfig();
+
+    /**
+     * \brief Callback for SIGHUP, reloads the configuration
+     */
+    static gboolean onReloadSignal(RtspServer* rtspProxyServer);
+
+    /**
+     * \brief Callback for SIGUSR1, writes the frame trace
+     */
+    static gboolean onTraceSignal(RtspServer* rtspProxyServer);
+
+    /**
+     * \brief Callback for changes of the configuration file. Schedules a
+     *        reload once the file settles.
+     */
+    static void onConfigFileChanged(
+        GFileMonitor* monitor,
+        GFile* file,
+        GFile* otherFile,
+        GFileMonitorEvent event,
+        RtspServer* rtspProxyServer);
+
+    /**
+     * \brief One shot timer reloading the configuration after a change of
+     *        the configuration file
+     */
+    static gboolean onReloadTimer(RtspServer* rtspProxyServer);
+
+    /**
+     * \brief HTTP handler returning a JPEG of the latest composed frame, or
+     *        of one camera with the 'cam=N' parameter
+     */
+    HttpResponse onSnapshotRequest(std::string const& query);
+
+    /**
+     * \brief Periodic callback printing all proxy metrics
+     */
+    static gboolean onMetricsReport(RtspServer* rtspProxyServer);
+
+    /**
+     * \brief Periodic callback measuring how late the main loop runs it,
+     *        i.e. how long the main loop was blocked
+     */
+    static gboolean onHeartbeat(RtspServer* rtspProxyServer);
+
 private:
     /**
-     * RTSP proxy server and remote cameras configuration
+     * Path to the configuration file
+     */
+    std::string m_configFile = "config/rtsp-proxy.yaml";
+
+    /**
+     * RTSP proxy server and remote cameras configuration. Replaced as a
+     * whole on reload, always accessed with atomic_load/atomic_store.
      */
     std::shared_ptr<RtspProxyConfig> m_config;
 
+    /**
+     * The processor shared by all media of the output mount point
+     */
+    std::weak_ptr<RtspProxyProcessor> m_processor;
+
+    /** protects m_processor */
+    std::mutex m_processorMutex;
+
+    /** watches the configuration file for changes */
+    GFileMonitor* m_configMonitor = nullptr;
+
+    /** ID of the pending reload timer */
+    guint m_reloadTimerId = 0;
+
     /**
      * This is the underlying GStreamer RTSP server instance
      */
@@ -71,8 +232,55 @@ private:
     /** GStreamer RTSP media factory used by the RTSP server */
     GstRTSPMediaFactory* m_factory = nullptr;
 
+    /**
+     * mosaic media kept prepared while no client plays it, holding one
+     * reference and one prepare count of its own
+     */
+    GstRTSPMedia* m_persistentMedia = nullptr;
+
+    /**
+     * protects m_persistentMedia. Clients play in their own pool threads.
+     */
+    std::mutex m_persistentMediaMutex;
+
+    /** ring of encoded output frames served on the replay mount point */
+    std::unique_ptr<SegmentRing> m_segmentRing;
+
+    /** GStreamer RTSP media factory of the replay mount point */
+    GstRTSPMediaFactory* m_replayFactory = nullptr;
+
+    /** runs the ingest workers, if enabled */
+    std::unique_ptr<IngestSupervisor> m_ingestSupervisor;
+
+    /** motion analytics of the camera frames, outliving all processors */
+    std::unique_ptr<AnalyticsEngine> m_analytics;
+
+    /**
+     * destroys medias and their processors. Declared after m_analytics, so
+     * the last processors are gone before the analytics.
+     */
+    std::unique_ptr<Reaper> m_reaper;
+
+    /** last run of onHeartbeat() */
+    std::chrono::steady_clock::time_point m_lastHeartbeat;
+
+    /** longest main loop stall seen, in milliseconds */
+    double m_maxStallMs = 0.;
+
+    /** latest frames for the snapshot endpoint */
+    std::unique_ptr<SnapshotCache> m_snapshotCache;
+
+    /** local HTTP endpoint */
+    std::unique_ptr<HttpServer> m_httpServer;
+
     /** map of all connected RTSP clients */
     std::unordered_map<GstRTSPClient*,RtspClient*> m_clients;
+
+    /**
+     * protects m_clients. Clients connect in the main loop, but close in
+     * the thread serving them.
+     */
+    std::mutex m_clientsMutex;
 };
 
 } // end of namespace
@@ -0,0 +1,223 @@
+#ifndef RTSP_PROXY_SEGMENT_RING_HPP
+#define RTSP_PROXY_SEGMENT_RING_HPP
+
+// System headers
+#include <semaphore.h>
+
+// STL headers
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Boost headers
+#include <boost/lockfree/spsc_queue.hpp>
+
+// gstreamer headers
+#include <gst/gst.h>
+
+// Project headers
+#include <RtspProxyConfig.hpp>
+
+namespace rtsp_proxy_server {
+
+/**
+ * \brief Position of a record in the segment ring
+ */
+struct SegmentPosition {
+    /** index of the segment file */
+    size_t segment = 0;
+
+    /** generation of the segment when the position was taken. A segment
+     *  gets a new generation every time it's recycled. */
+    uint64_t generation = 0;
+
+    /** offset of the record in the segment */
+    size_t offset = 0;
+};
+
+/**
+ * \brief Fixed size ring of memory mapped segment files holding the encoded
+ *        output stream, indexed by keyframe
+ *
+ * The live path hands encoded buffers over with push(), which never blocks:
+ * the buffers are queued and written to the segments by a writer thread.
+ * Readers get buffers that wrap the mapped segment memory without copying.
+ * A segment is pinned while any of its buffers is alive, and the writer
+ * drops data rather than recycle a pinned segment.
+ */
+class SegmentRing {
+public:
+    enum class ReadResult {
+        OK,     ///< a record was read
+        WAIT,   ///< the position is at the live edge, no data yet
+        LOST    ///< the position was overwritten by the writer
+    };
+
+    /**
+     * \brief Constructor. Creates and maps all segment files.
+     *
+     * \param[in] config replay settings
+     */
+    SegmentRing(ReplayConfig const& config);
+
+    /**
+     * \brief Destructor
+     *
+     * Stops the writer and unmaps all segment files.
+     */
+    ~SegmentRing();
+
+    /**
+     * \brief Queue an encoded buffer for writing. Never blocks, the buffer
+     *        is dropped if the writer is behind.
+     *
+     * \param[in] buf encoded buffer, a new reference is taken
+     */
+    void push(GstBuffer* buf);
+
+    /**
+     * \brief Set caps of the encoded stream
+     */
+    void setCaps(std::string const& caps);
+
+    /**
+     * \brief Get caps of the encoded stream, empty if not known yet
+     */
+    std::string getCaps() const;
+
+    /**
+     * \brief Get timestamps (wall clock, ns) of the oldest keyframe and of
+     *        the newest record in the ring
+     *
+     * \return false if the ring has no keyframe yet
+     */
+    bool getRange(uint64_t& first, uint64_t& last) const;
+
+    /**
+     * \brief Find the last keyframe at or before a timestamp, or the oldest
+     *        keyframe if the timestamp is older than the ring
+     *
+     * \return false if the ring has no keyframe yet
+     */
+    bool seek(uint64_t timestamp, SegmentPosition& pos) const;
+
+    /**
+     * \brief Read the record at a position and advance the position
+     *
+     * \param[in,out] pos position of the record
+     * \param[out] buf buffer wrapping the record data, owned by the caller
+     * \param[out] timestamp wall clock time of the record in ns
+     */
+    ReadResult read(
+        SegmentPosition& pos,
+        GstBuffer*& buf,
+        uint64_t& timestamp);
+
+    /**
+     * \brief Wait until a record is written after a position
+     */
+    void waitForData(
+        SegmentPosition const& pos,
+        std::chrono::milliseconds timeout);
+
+private:
+    /** a memory mapped segment file */
+    struct Segment {
+        int fd = -1;
+        uint8_t* data = nullptr;
+        uint64_t generation = 0;
+        size_t used = 0;
+        std::atomic<int> pins = {0};
+    };
+
+    /** a keyframe in the index */
+    struct Keyframe {
+        SegmentPosition pos;
+        uint64_t timestamp = 0;
+    };
+
+    /** an encoded buffer waiting for the writer */
+    struct PendingRecord {
+        GstBuffer* buffer;
+        uint64_t timestamp;
+    };
+
+    /** a pinned segment referenced by a buffer given to a reader */
+    struct SegmentPin {
+        SegmentRing* ring;
+        size_t segment;
+    };
+
+    /**
+     * \brief Unpin a segment when a buffer given to a reader is freed
+     */
+    static void onBufferReleased(gpointer pin);
+
+    /**
+     * \brief Thread writing queued buffers to the segments
+     */
+    void writerThread();
+
+    /**
+     * \brief Write one buffer to the current segment
+     */
+    void writeRecord(PendingRecord const& record);
+
+private:
+    /** replay settings */
+    ReplayConfig m_config;
+
+    /** all segment files */
+    std::vector<std::unique_ptr<Segment>> m_segments;
+
+    /** index of the segment being written */
+    size_t m_current = 0;
+
+    /** last generation given to a segment */
+    uint64_t m_generation = 0;
+
+    /** keyframes in the ring, oldest first */
+    std::deque<Keyframe> m_keyframes;
+
+    /** timestamp of the newest record */
+    uint64_t m_lastTimestamp = 0;
+
+    /** caps of the encoded stream */
+    std::string m_caps;
+
+    /** protects segment bookkeeping, the index and the caps */
+    mutable std::mutex m_mutex;
+
+    /** signals readers waiting at the live edge */
+    std::condition_variable m_dataWritten;
+
+    /** buffers waiting for the writer */
+    boost::lockfree::spsc_queue<PendingRecord> m_queue;
+
+    /** signals the writer that a buffer is queued */
+    sem_t m_queueSemaphore;
+
+    /** number of buffers push() dropped because the queue was full */
+    std::atomic<size_t> m_queueDrops = {0};
+
+    /** value of m_queueDrops the writer has already accounted for */
+    size_t m_queueDropsSeen = 0;
+
+    /** drop everything until the next keyframe after a gap */
+    bool m_waitKeyframe = true;
+
+    /** Thread writing the segments */
+    std::thread m_thread;
+
+    /** Indicates if the writer thread is running */
+    std::atomic<bool> m_running = {false};
+};
+
+} // end of namespace
+
+#endif
@@ -0,0 +1,187 @@
+#ifndef RTSP_PROXY_SHM_FRAME_RING_HPP
+#define RTSP_PROXY_SHM_FRAME_RING_HPP
+
+// STL headers
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace rtsp_proxy_server {
+
+/**
+ * Raw frames shared with co-located consumers through POSIX shared memory.
+ *
+ * A ring is a header followed by a fixed number of slots, each with a small
+ * frame header and room for one frame. The writer fills the slot after the
+ * newest frame and publishes its sequence number. Readers map the ring
+ * read-only and use the frame data in place. A slot is only rewritten
+ * after all others, so a reader has the time of (slots - 1) frames to use
+ * a frame. isIntact() tells afterwards if the writer got to it meanwhile.
+ *
+ * This header only depends on the C++ standard library, consumers link
+ * the shm-frame-ring library and nothing else of the proxy.
+ */
+
+/** fourcc of packed 8 bit BGR frames, V4L2_PIX_FMT_BGR24 */
+const uint32_t SHM_FORMAT_BGR = 0x33524742;
+
+/**
+ * \brief A frame in a ring
+ */
+struct ShmFrame {
+    /** sequence number, 1 for the first frame written to the ring */
+    uint64_t seq = 0;
+
+    /**
+     * CLOCK_MONOTONIC nanoseconds the frame was composed, or received from
+     * the camera
+     */
+    uint64_t ptsNs = 0;
+
+    uint32_t width = 0;
+    uint32_t height = 0;
+
+    /** bytes per row */
+    uint32_t stride = 0;
+
+    /** fourcc of the pixel format */
+    uint32_t format = 0;
+
+    /** frame data, inside the mapping of the ring */
+    const uint8_t* data = nullptr;
+
+    /** bytes of frame data */
+    size_t size = 0;
+};
+
+/**
+ * \brief Close a ring for its readers and remove its name. For rings left
+ *        by a writer that is gone, e.g. because it crashed.
+ */
+void closeShmFrameRing(std::string const& name);
+
+/**
+ * \brief Creates a ring and writes frames into it
+ */
+class ShmFrameWriter {
+public:
+    /**
+     * \brief Constructor. Creates the ring, replacing a ring of the same
+     *        name left by a previous writer.
+     *
+     * \param[in] name POSIX shared memory name, e.g. "/rtsp-proxy-mosaic"
+     * \param[in] slots number of frames in the ring, at least 2
+     * \param[in] slotSize largest frame in bytes
+     *
+     * \throw std::runtime_error if the ring cannot be created
+     */
+    ShmFrameWriter(std::string const& name, uint32_t slots, size_t slotSize);
+
+    /**
+     * \brief Destructor. Closes the ring for its readers and removes its
+     *        name, unless a newer writer took it over.
+     */
+    ~ShmFrameWriter();
+
+    ShmFrameWriter(ShmFrameWriter const&) = delete;
+    ShmFrameWriter& operator=(ShmFrameWriter const&) = delete;
+
+    /**
+     * \brief Get the largest frame in bytes
+     */
+    size_t getSlotSize() const { return m_slotSize; }
+
+    /**
+     * \brief Copy a frame into the next slot and publish it
+     *
+     * \param[in] frame frame to write, seq is ignored
+     *
+     * \return sequence number of the frame, 0 if it is larger than the
+     *         slot size and was not written
+     */
+    uint64_t write(ShmFrame const& frame);
+
+private:
+    std::string m_name;
+    size_t m_slotSize = 0;
+
+    /** file descriptor of the ring, identifies it under its name */
+    int m_fd = -1;
+
+    /** mapping of the ring */
+    uint8_t* m_base = nullptr;
+    size_t m_mapSize = 0;
+
+    /** sequence number of the last frame written */
+    uint64_t m_seq = 0;
+};
+
+/**
+ * \brief Maps a ring and reads its frames in place
+ */
+class ShmFrameReader {
+public:
+    /**
+     * \brief Constructor. Maps the ring read-only.
+     *
+     * \throw std::runtime_error if the ring doesn't exist or is not a
+     *        frame ring
+     */
+    explicit ShmFrameReader(std::string const& name);
+
+    ~ShmFrameReader();
+
+    ShmFrameReader(ShmFrameReader const&) = delete;
+    ShmFrameReader& operator=(ShmFrameReader const&) = delete;
+
+    /**
+     * \brief Get the newest frame, if it is newer than the last one
+     *        returned. Never blocks.
+     *
+     * \param[out] frame the frame, its data points into the ring
+     *
+     * \return false if there is no newer frame, or it is being written
+     */
+    bool next(ShmFrame& frame);
+
+    /**
+     * \brief Check if a frame returned by next() was not overwritten
+     *        meanwhile. Call it after using the frame data, the data can
+     *        only be trusted if this returns true.
+     */
+    bool isIntact(ShmFrame const& frame) const;
+
+    /**
+     * \brief Check if the writer closed the ring. A new writer creates a
+     *        new ring under the same name, the reader has to be created
+     *        again to follow it.
+     */
+    bool isClosed() const;
+
+    /**
+     * \brief Check if the process that created the ring still runs. A
+     *        writer that crashed never closes its ring. Only meaningful
+     *        if the writer runs in the PID namespace of the reader.
+     */
+    bool isWriterAlive() const;
+
+    /**
+     * \brief Get the number of frames published but never returned by
+     *        next(), because newer ones were there first
+     */
+    uint64_t getSkipped() const { return m_skipped; }
+
+private:
+    /** mapping of the ring */
+    const uint8_t* m_base = nullptr;
+    size_t m_mapSize = 0;
+
+    /** sequence number of the last frame returned */
+    uint64_t m_seq = 0;
+
+    uint64_t m_skipped = 0;
+};
+
+} // end of namespace
+
+#endif
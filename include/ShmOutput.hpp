@@ -0,0 +1,96 @@
+#ifndef RTSP_PROXY_SHM_OUTPUT_HPP
+#define RTSP_PROXY_SHM_OUTPUT_HPP
+
+// STL headers
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Open CV headers
+#include <opencv2/core/core.hpp>        // cv::Mat
+
+// Project headers
+#include <RtspProxyConfig.hpp>
+#include <ShmFrameRing.hpp>
+
+namespace rtsp_proxy_server {
+
+/**
+ * \brief Publishes the composed mosaic, and optionally the camera frames,
+ *        into shared memory frame rings
+ *
+ * Consumers on the same host read the raw frames in place instead of
+ * decoding the RTSP output again. Each frame is copied once, into its
+ * ring. A ring is created with the first frame published into it, and
+ * again with room for a larger frame when a camera changes its resolution.
+ * Only called from the processor thread.
+ */
+class ShmOutput {
+public:
+    /**
+     * \brief Constructor
+     *
+     * \param[in] config shared memory output settings
+     */
+    explicit ShmOutput(ShmOutputConfig const& config);
+
+    /**
+     * \brief Publish a composed frame
+     *
+     * \param[in] frame composed frame, CV_8UC3
+     * \param[in] time compose start of the frame
+     */
+    void publishOutput(
+        cv::Mat const& frame,
+        std::chrono::steady_clock::time_point time);
+
+    /**
+     * \brief Publish a decoded frame of a camera, if camera frames are
+     *        enabled
+     *
+     * \param[in] cam camera index
+     * \param[in] frame camera frame, CV_8UC3
+     * \param[in] time arrival of the frame
+     */
+    void publishCamera(
+        size_t cam,
+        cv::Mat const& frame,
+        std::chrono::steady_clock::time_point time);
+
+private:
+    /**
+     * \brief A ring and its name
+     */
+    struct Ring {
+        std::string name;
+        std::unique_ptr<ShmFrameWriter> writer;
+
+        /** creating the ring failed, it is not tried again */
+        bool failed = false;
+    };
+
+    /**
+     * \brief Write a frame into a ring, creating the ring if needed
+     *
+     * \return false if the frame could not be published
+     */
+    bool publish(
+        Ring& ring,
+        cv::Mat const& frame,
+        std::chrono::steady_clock::time_point time);
+
+private:
+    /** shared memory output settings */
+    ShmOutputConfig m_config;
+
+    /** ring of the composed frames */
+    Ring m_output;
+
+    /** rings of the cameras, by camera index */
+    std::vector<Ring> m_cameras;
+};
+
+} // end of namespace
+
+#endif
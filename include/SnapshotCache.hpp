@@ -0,0 +1,95 @@
+#ifndef RTSP_PROXY_SNAPSHOT_CACHE_HPP
+#define RTSP_PROXY_SNAPSHOT_CACHE_HPP
+
+// STL headers
+#include <map>
+#include <memory>
+#include <mutex>
+
+// Project headers
+#include <HttpServer.hpp>
+#include <OpenCvReader.hpp>
+
+namespace rtsp_proxy_server {
+
+/**
+ * \brief Latest composed and camera frames, encoded to JPEG on demand
+ *
+ * The compositor publishes every new frame, which only swaps a pointer and
+ * bumps the frame generation. A JPEG is encoded lazily on the first request
+ * after a new generation is published, and all concurrent requests for the
+ * same generation wait for and share that one encoded buffer.
+ */
+class SnapshotCache {
+public:
+    /**
+     * \brief Constructor
+     *
+     * \param[in] jpegQuality JPEG quality (0..100)
+     */
+    SnapshotCache(int jpegQuality);
+
+    /**
+     * \brief Publish a new composed output frame
+     */
+    void publishOutput(CvMatPtr const& frame) { publish(OUTPUT, frame); }
+
+    /**
+     * \brief Publish a new frame of a camera
+     */
+    void publishCamera(size_t idx, CvMatPtr const& frame) {
+        publish(idx + 1, frame);
+    }
+
+    /**
+     * \brief Get the JPEG of the latest composed frame, or nullptr if no
+     *        frame has been published yet
+     */
+    HttpBody getOutputJpeg() { return getJpeg(OUTPUT); }
+
+    /**
+     * \brief Get the JPEG of the latest frame of a camera, or nullptr if no
+     *        frame has been published yet
+     */
+    HttpBody getCameraJpeg(size_t idx) { return getJpeg(idx + 1); }
+
+private:
+    /** source ID of the composed output, cameras follow it */
+    static constexpr size_t OUTPUT = 0;
+
+    /** a frame source and its cached JPEG */
+    struct Source {
+        /** protects frame and generation, held only to swap pointers */
+        std::mutex frameMutex;
+        CvMatPtr frame;
+        uint64_t generation = 0;
+
+        /** protects the JPEG, held while encoding */
+        std::mutex jpegMutex;
+        HttpBody jpeg;
+        uint64_t jpegGeneration = 0;
+    };
+
+    /**
+     * \brief Get a source by ID, creating it if needed
+     */
+    Source& getSource(size_t id);
+
+    void publish(size_t id, CvMatPtr const& frame);
+
+    HttpBody getJpeg(size_t id);
+
+private:
+    /** JPEG quality */
+    int m_jpegQuality = 80;
+
+    /** all sources by ID. Sources are never removed. */
+    std::map<size_t, std::unique_ptr<Source>> m_sources;
+
+    /** protects m_sources */
+    std::mutex m_sourcesMutex;
+};
+
+} // end of namespace
+
+#endif
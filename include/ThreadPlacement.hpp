@@ -0,0 +1,69 @@
+#ifndef RTSP_PROXY_THREAD_PLACEMENT_HPP
+#define RTSP_PROXY_THREAD_PLACEMENT_HPP
+
+// System headers
+#include <sched.h>
+
+// STL headers
+#include <string>
+
+// Project headers
+#include <RtspProxyConfig.hpp>
+
+namespace rtsp_proxy_server {
+
+/**
+ * \brief Places proxy threads on CPUs and NUMA nodes
+ *
+ * Each thread applies the settings of its role to itself when it starts.
+ * Threads created later by that thread (decoder and encoder worker threads)
+ * inherit its CPU set and scheduling policy.
+ */
+class ThreadPlacement {
+public:
+    /**
+     * \brief Apply a role to the calling thread and print the effective
+     *        placement. Failures, e.g. missing permissions for real time
+     *        policies, are reported but not fatal.
+     *
+     * \param[in] name thread name, at most 15 characters are used
+     * \param[in] role CPU set and scheduling settings
+     */
+    static void apply(std::string const& name, ThreadRoleConfig const& role);
+
+    /**
+     * \brief Get the NUMA node hosting all CPUs of a role
+     *
+     * \return node number, or -1 if the role is not pinned to one node
+     */
+    static int getNumaNode(ThreadRoleConfig const& role);
+
+    /**
+     * \brief Move memory to a NUMA node and keep it there
+     */
+    static void bindToNode(void* addr, size_t size, int node);
+
+    /**
+     * \brief Validate the placement settings, and print the NUMA topology
+     *        and where each role will run
+     *
+     * \throw std::runtime_error if a CPU list is invalid
+     */
+    static void report(PlacementConfig const& placement);
+
+    /**
+     * \brief Parse a CPU list like "0-3,8"
+     *
+     * \return false if the list is malformed
+     */
+    static bool parseCpuList(std::string const& list, cpu_set_t& cpus);
+
+    /**
+     * \brief Format a CPU set as a CPU list
+     */
+    static std::string formatCpuList(cpu_set_t const& cpus);
+};
+
+} // end of namespace
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef RTSP_PROXY_VIEW_MEDIA_FACTORY_HPP
+#define RTSP_PROXY_VIEW_MEDIA_FACTORY_HPP
+
+// rtsp server headers
+#include <gst/rtsp-server/rtsp-server.h>
+
+// project headers
+#include <Viewport.hpp>
+
+namespace rtsp_proxy_server {
+
+class RtspServer;
+
+/**
+ * \brief Media factory of the output mount point
+ *
+ * Shared media are looked up by the requested view instead of the whole
+ * URL, so all clients asking for the same view share one media and one
+ * encoder, and clients of the mosaic share the mosaic media whatever else
+ * is in their URL. View media run the view pipeline of the configuration.
+ */
+class ViewMediaFactory {
+public:
+    /**
+     * \brief Create the factory, with the output pipeline as the launch
+     *        line of the mosaic
+     *
+     * \param[in] server RTSP server providing the configuration, must
+     *            outlive the factory
+     */
+    static GstRTSPMediaFactory* create(RtspServer* server);
+
+    /**
+     * \brief Get the view a media was constructed for
+     *
+     * \return view, or nullptr for the mosaic
+     */
+    static Viewport const* getViewport(GstRTSPMedia* media);
+
+    /**
+     * \brief Stop handing out the shared media created so far. New clients
+     *        get new media, running the current launch line, while the
+     *        previous media keep serving their clients until they leave.
+     */
+    static void evictMedia(GstRTSPMediaFactory* factory);
+};
+
+} // end of namespace
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef RTSP_PROXY_VIEWPORT_HPP
+#define RTSP_PROXY_VIEWPORT_HPP
+
+// STL headers
+#include <string>
+
+// Open CV headers
+#include <opencv2/core/core.hpp>
+
+// Project headers
+#include <RtspProxyConfig.hpp>
+
+namespace rtsp_proxy_server {
+
+/**
+ * \brief Part of the composed mosaic a client asked for
+ *
+ * Views are composed from the camera frames, not cut out of the composed
+ * mosaic, so zooming in shows the cameras at their full resolution.
+ */
+struct Viewport {
+    /** camera shown on its own, or -1 */
+    int cam = -1;
+
+    /** area of the mosaic in output pixels, empty for the whole mosaic */
+    cv::Rect roi;
+
+    /**
+     * \brief Check if this is the plain mosaic of the output mount point
+     */
+    bool isMosaic() const { return cam < 0 && roi.area() == 0; }
+
+    /**
+     * \brief Get a canonical form of the view. Requests for the same view
+     *        have the same key, however they were written.
+     */
+    std::string getKey() const;
+
+    /**
+     * \brief Parse view parameters of an output URL query: 'cam=N' for
+     *        one camera, or 'roi=x,y,w,h' for an area of the mosaic
+     *
+     * \param[in] query URL query without the '?', may be empty
+     * \param[in] config configuration defining the mosaic
+     * \param[out] viewport parsed view
+     * \param[out] error reason the parameters were rejected
+     *
+     * \return false if the parameters are invalid
+     */
+    static bool parse(
+        std::string const& query,
+        RtspProxyConfig const& config,
+        Viewport& viewport,
+        std::string& error);
+};
+
+} // end of namespace
+
+#endif
@@ -0,0 +1,62 @@
+// STL headers
+#include <algorithm>
+
+// Project headers
+#include <AdaptiveBitrateController.hpp>
+
+namespace rtsp_proxy_server {
+
+AdaptiveBitrateController::AdaptiveBitrateController(
+    AdaptiveBitrateConfig const& config,
+    uint initialKbps)
+    :
+    m_config(config),
+    m_bitrate(std::min(std::max(initialKbps, config.minKbps), config.maxKbps))
+{
+}
+
+bool
+AdaptiveBitrateController::update(BitrateSample const& sample)
+{
+    bool congested =
+        sample.loss >= m_config.lossHigh ||
+        sample.jitterMs >= m_config.jitterHighMs ||
+        sample.queueFill >= m_config.queueHigh;
+
+    bool healthy =
+        sample.loss <= m_config.lossLow &&
+        sample.jitterMs < m_config.jitterHighMs / 2. &&
+        sample.queueFill < m_config.queueHigh / 2.;
+
+    if (congested) {
+        m_healthyCount = 0;
+        m_congestedCount++;
+    } else if (healthy) {
+        m_congestedCount = 0;
+        m_healthyCount++;
+    } else {
+        // in the hysteresis band - hold the current bitrate
+        m_congestedCount = 0;
+        m_healthyCount = 0;
+    }
+
+    uint bitrate = m_bitrate;
+
+    if (m_congestedCount >= m_config.downSamples) {
+        m_congestedCount = 0;
+        bitrate = uint(double(m_bitrate) * m_config.stepDownFactor);
+    } else if (m_healthyCount >= m_config.upSamples) {
+        m_healthyCount = 0;
+        bitrate = m_bitrate + m_config.stepUpKbps;
+    }
+
+    bitrate = std::min(std::max(bitrate, m_config.minKbps), m_config.maxKbps);
+    if (bitrate == m_bitrate) {
+        return false;
+    }
+
+    m_bitrate = bitrate;
+    return true;
+}
+
+} // end of namespace
@@ -0,0 +1,50 @@
+// STL headers
+#include <algorithm>
+#include <cmath>
+
+// Project headers
+#include <AdaptiveJitterController.hpp>
+
+namespace rtsp_proxy_server {
+
+AdaptiveJitterController::AdaptiveJitterController(
+    JitterBufferConfig const& config)
+    :
+    m_config(config),
+    m_latency(config.initialMs)
+{
+}
+
+bool
+AdaptiveJitterController::update(JitterSample const& sample)
+{
+    uint64_t total = sample.pushed + sample.lost;
+    if (total == 0) {
+        // nothing received, nothing learned
+        return false;
+    }
+
+    double lateRatio = double(sample.late) / double(total);
+    uint latency = m_latency;
+
+    if (lateRatio > m_config.lateHigh) {
+        m_healthyCount = 0;
+        latency = std::max(latency * 2, latency + m_config.stepMs);
+    } else if (++m_healthyCount >= m_config.downSamples) {
+        m_healthyCount = 0;
+        latency = (latency > m_config.stepMs) ? latency - m_config.stepMs : 0;
+    }
+
+    // a buffer shorter than the jitter only produces late packets
+    auto floor = uint(std::ceil(m_config.jitterFactor * sample.jitterMs));
+    latency = std::max(latency, floor);
+    latency = std::min(std::max(latency, m_config.minMs), m_config.maxMs);
+
+    if (latency == m_latency) {
+        return false;
+    }
+    m_latency = latency;
+    return true;
+}
+
+} // end of namespace
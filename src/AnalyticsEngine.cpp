@@ -0,0 +1,292 @@
+// STL headers
+#include <algorithm>
+#include <cstdio>
+
+// Open CV headers
+#include <opencv2/imgproc/imgproc.hpp>  // cv::resize, cv::findContours
+
+// Project headers
+#include <AnalyticsEngine.hpp>
+#include <ProxyMetrics.hpp>
+#include <ThreadPlacement.hpp>
+
+namespace rtsp_proxy_server {
+
+#define DEBUG_ANALYTICS_ENGINE 0
+
+namespace {
+
+/** most motion boxes reported for one frame, the largest areas first */
+const size_t MAX_BOXES = 16;
+
+}
+
+AnalyticsEngine::AnalyticsEngine(
+    AnalyticsConfig const& config,
+    ThreadRoleConfig const& placement)
+    :
+    m_config(config),
+    m_placement(placement),
+    m_interval(
+        std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(1. / config.fps)))
+{
+    for (uint i = 0; i < m_config.workers; i++) {
+        m_workers.emplace_back(&AnalyticsEngine::workerThread, this);
+    }
+
+    printf(
+        "Motion analytics enabled: %.1f fps per camera, %u px wide, "
+        "%u workers\n",
+        m_config.fps,
+        m_config.width,
+        m_config.workers);
+    fflush(stdout);
+}
+
+AnalyticsEngine::~AnalyticsEngine()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+        m_jobs.clear();
+    }
+    m_jobsCond.notify_all();
+    for (auto& w : m_workers) {
+        w.join();
+    }
+}
+
+void
+AnalyticsEngine::setCameras(size_t num)
+{
+    std::vector<CameraPtr> cameras;
+    for (size_t i = 0; i < num; i++) {
+        cameras.push_back(std::make_shared<Camera>(i));
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_cameras = std::move(cameras);
+}
+
+void
+AnalyticsEngine::offer(size_t cam, CvMatPtr const& frame)
+{
+    auto now = std::chrono::steady_clock::now();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (cam >= m_cameras.size()) {
+            return;
+        }
+        auto const& camera = m_cameras[cam];
+        if (now - camera->lastTaken < m_interval) {
+            return;
+        }
+
+        // the analysis is behind, drop the frame instead of queueing it
+        if (camera->busy || m_jobs.size() >= m_config.queueSize) {
+            ProxyMetrics::instance().add("analytics.dropped_frames");
+            return;
+        }
+
+        camera->lastTaken = now;
+        camera->busy = true;
+
+        Job job;
+        job.camera = camera;
+        job.frame = frame;
+        job.time = now;
+        m_jobs.push_back(std::move(job));
+    }
+    m_jobsCond.notify_one();
+}
+
+std::vector<AnalyticsResult>
+AnalyticsEngine::getResults() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::vector<AnalyticsResult> results;
+    results.reserve(m_cameras.size());
+    for (auto const& camera : m_cameras) {
+        results.push_back(camera->result);
+    }
+    return results;
+}
+
+std::string
+AnalyticsEngine::formatJson() const
+{
+    auto results = getResults();
+    auto now = std::chrono::steady_clock::now();
+
+    std::string out = "{\"cameras\":[";
+    char buf[256];
+    for (size_t i = 0; i < results.size(); i++) {
+        auto const& r = results[i];
+        double ageMs = r.frames ?
+            std::chrono::duration<double, std::milli>(now - r.time).count() :
+            -1.;
+        snprintf(
+            buf,
+            sizeof(buf),
+            "%s\n{\"cam\":%zu,\"frames\":%llu,\"age_ms\":%.0f,"
+            "\"motion\":%.4f,\"boxes\":[",
+            i ? "," : "",
+            i,
+            static_cast<unsigned long long>(r.frames),
+            ageMs,
+            r.motion);
+        out += buf;
+        for (size_t b = 0; b < r.boxes.size(); b++) {
+            auto const& box = r.boxes[b];
+            snprintf(
+                buf,
+                sizeof(buf),
+                "%s[%.4f,%.4f,%.4f,%.4f]",
+                b ? "," : "",
+                box.x,
+                box.y,
+                box.width,
+                box.height);
+            out += buf;
+        }
+        out += "]}";
+    }
+    out += "\n]}\n";
+    return out;
+}
+
+AnalyticsResult
+AnalyticsEngine::analyze(Camera& camera, cv::Mat const& frame) const
+{
+    AnalyticsResult result = camera.result;
+    result.frames++;
+    result.motion = 0.;
+    result.boxes.clear();
+
+    int width = std::min(int(m_config.width), frame.cols);
+    int height = std::max(1, frame.rows * width / std::max(1, frame.cols));
+
+    cv::Mat small;
+    cv::resize(frame, small, cv::Size(width, height), 0, 0, cv::INTER_AREA);
+
+    cv::Mat grey;
+    cv::cvtColor(small, grey, cv::COLOR_BGR2GRAY);
+    cv::GaussianBlur(grey, grey, cv::Size(5, 5), 0);
+
+    // the first frame, or the camera resolution changed
+    if (camera.previous.size() != grey.size()) {
+        camera.previous = grey;
+        return result;
+    }
+
+    cv::Mat mask;
+    cv::absdiff(grey, camera.previous, mask);
+    camera.previous = grey;
+
+    cv::threshold(
+        mask, mask, double(m_config.threshold), 255, cv::THRESH_BINARY);
+    cv::dilate(mask, mask, cv::Mat());
+
+    double area = double(width) * double(height);
+    result.motion = double(cv::countNonZero(mask)) / area;
+    if (result.motion == 0.) {
+        return result;
+    }
+
+    std::vector<std::vector<cv::Point>> contours;
+    cv::findContours(
+        mask, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
+
+    std::vector<std::pair<double, cv::Rect>> regions;
+    for (auto const& c : contours) {
+        double a = cv::contourArea(c);
+        if (a >= m_config.minArea * area) {
+            regions.push_back(std::make_pair(a, cv::boundingRect(c)));
+        }
+    }
+    std::sort(
+        regions.begin(),
+        regions.end(),
+        [](std::pair<double, cv::Rect> const& a,
+           std::pair<double, cv::Rect> const& b) {
+            return a.first > b.first;
+        });
+    if (regions.size() > MAX_BOXES) {
+        regions.resize(MAX_BOXES);
+    }
+
+    for (auto const& r : regions) {
+        MotionBox box;
+        box.x = double(r.second.x) / width;
+        box.y = double(r.second.y) / height;
+        box.width = double(r.second.width) / width;
+        box.height = double(r.second.height) / height;
+        result.boxes.push_back(box);
+    }
+    return result;
+}
+
+void
+AnalyticsEngine::workerThread()
+{
+    ThreadPlacement::apply("analytics", m_placement);
+
+    using Seconds = std::chrono::duration<double>;
+    auto& metrics = ProxyMetrics::instance();
+
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_jobsCond.wait(
+                lock, [this] { return m_stopping || not m_jobs.empty(); });
+            if (m_stopping) {
+                return;
+            }
+            job = std::move(m_jobs.front());
+            m_jobs.pop_front();
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        AnalyticsResult result;
+        bool analysed = true;
+        try {
+            result = analyze(*job.camera, *job.frame);
+        } catch (cv::Exception const& e) {
+            fprintf(stderr, "OpenCV call Failed:\n\t%s\n", e.what());
+            analysed = false;
+        }
+
+        // give the decoded buffer back to the reader's pool right away
+        job.frame.reset();
+        Seconds elapsed = std::chrono::steady_clock::now() - start;
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (analysed) {
+                result.time = job.time;
+                job.camera->result = result;
+            }
+            job.camera->busy = false;
+        }
+
+        metrics.add("analytics.analyze_sec", elapsed.count());
+        metrics.add("analytics.analyzed_frames");
+        metrics.set(
+            "analytics.cam" + std::to_string(job.camera->idx) + ".motion",
+            result.motion);
+
+        #if DEBUG_ANALYTICS_ENGINE
+            printf(
+                "analytics: cam %zu motion %.4f, %zu boxes, %.6lf s\n",
+                job.camera->idx,
+                result.motion,
+                result.boxes.size(),
+                elapsed.count());
+        #endif
+    }
+}
+
+} // end of namespace
@@ -0,0 +1,232 @@
+// STL headers
+#include <stdexcept>
+
+// Boost headers
+#include <boost/algorithm/string.hpp>
+
+// Project headers
+#include <CompositorPipeline.hpp>
+#include <MosaicLayout.hpp>
+#include <ProxyMetrics.hpp>
+
+namespace rtsp_proxy_server {
+
+#define DEBUG_COMPOSITOR_PIPELINE 0
+
+namespace {
+
+/** name of the compositor element in the mosaic pipeline */
+const char* MIXER_NAME = "mix";
+
+/**
+ * \brief Split a linear launch string into its elements
+ */
+std::vector<std::string>
+splitElements(std::string const& pipeline)
+{
+    std::vector<std::string> elements;
+    boost::split(elements, pipeline, boost::is_any_of("!"));
+    for (auto& element : elements) {
+        boost::trim(element);
+    }
+    return elements;
+}
+
+std::string
+joinElements(std::vector<std::string> const& elements)
+{
+    return boost::join(elements, " ! ");
+}
+
+int64_t
+toNs(std::chrono::steady_clock::time_point time)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        time.time_since_epoch()).count();
+}
+
+}
+
+std::string
+CompositorPipeline::build(
+    RtspProxyConfig const& config,
+    std::string const& sink,
+    bool encode)
+{
+    auto const& cameras = config.getInputPipelines();
+    if (cameras.empty()) {
+        throw std::runtime_error(
+            "Invalid config. output_engine 'gstreamer' needs at least one "
+            "camera pipeline");
+    }
+
+    auto const& dim = config.getOutputDimensions();
+    cv::Size canvas(int(dim.width), int(dim.height));
+
+    // live cameras drop the frames the compositor has no time for, like
+    // their appsink did. Replayed files lose no frame.
+    std::string queue = config.getFileIngest().enabled ?
+        "queue max-size-buffers=2" :
+        "queue max-size-buffers=1 leaky=downstream";
+
+    std::string branches;
+    std::string mixer =
+        std::string("compositor name=") + MIXER_NAME + " background=black";
+
+    for (size_t i = 0; i < cameras.size(); i++) {
+        auto elements = splitElements(cameras[i]);
+        if (elements.size() < 2 ||
+            not boost::starts_with(elements.back(), "appsink")) {
+            throw std::runtime_error(
+                "Invalid config. camera pipeline " + std::to_string(i) +
+                " must end with an appsink to be composed by output_engine "
+                "'gstreamer'");
+        }
+        elements.pop_back();
+
+        auto tile = getMosaicTileRect(
+            i, cameras.size(), canvas, config.getMosaicColumns());
+        auto pad = "sink_" + std::to_string(i);
+
+        elements.push_back("videoscale");
+        elements.push_back(
+            "video/x-raw,width=" + std::to_string(tile.width) +
+            ",height=" + std::to_string(tile.height) +
+            ",pixel-aspect-ratio=1/1");
+        elements.push_back(queue);
+        branches += joinElements(elements) + " ! " + MIXER_NAME + "." +
+            pad + " ";
+
+        mixer += " " + pad + "::xpos=" + std::to_string(tile.x) +
+            " " + pad + "::ypos=" + std::to_string(tile.y);
+    }
+
+    std::string mosaic = mixer +
+        " ! video/x-raw,width=" + std::to_string(dim.width) +
+        ",height=" + std::to_string(dim.height) +
+        ",framerate=" + std::to_string(config.getOutputFps()) + "/1";
+
+    if (not encode) {
+        return branches + mosaic + " ! " + sink;
+    }
+
+    // the mosaic replaces the appsrc the processor would push frames into
+    auto output = splitElements(config.getOutputPipeline());
+    if (output.size() < 2 || not boost::starts_with(output.front(), "appsrc")) {
+        throw std::runtime_error(
+            "Invalid config. output_gst_rtsp_pipeline must start with an "
+            "appsrc to be used by output_engine 'gstreamer'");
+    }
+    output.erase(output.begin());
+    if (not sink.empty()) {
+        output.back() = sink;
+    }
+
+    auto launch = branches + mosaic + " ! " + joinElements(output);
+    #if DEBUG_COMPOSITOR_PIPELINE
+        printf("compositor pipeline: '%s'\n", launch.c_str());
+    #endif
+    return launch;
+}
+
+std::string
+CompositorPipeline::replaceLastElement(
+    std::string const& pipeline,
+    std::string const& element)
+{
+    auto elements = splitElements(pipeline);
+    elements.back() = element;
+    return joinElements(elements);
+}
+
+CompositorPipeline::CompositorPipeline(
+    GstElement* bin,
+    GstPad* end,
+    FrameLatencyProbe::Callback callback)
+    :
+    m_latency(end, std::move(callback))
+{
+    GstElement* mixer = gst_bin_get_by_name(GST_BIN(bin), MIXER_NAME);
+    if (not mixer) {
+        throw std::runtime_error(
+            "ERROR: compositor not found in the mosaic pipeline");
+    }
+
+    // the request pads were named by the launch string
+    for (uint i = 0;; i++) {
+        auto name = "sink_" + std::to_string(i);
+        GstPad* pad = gst_element_get_static_pad(mixer, name.c_str());
+        if (not pad) {
+            break;
+        }
+        auto id = gst_pad_add_probe(
+            pad,
+            GST_PAD_PROBE_TYPE_BUFFER,
+            reinterpret_cast<GstPadProbeCallback>(
+                &CompositorPipeline::onInputBuffer),
+            this,
+            nullptr);
+        m_probes.push_back(std::make_pair(pad, id));
+    }
+
+    GstPad* src = gst_element_get_static_pad(mixer, "src");
+    if (src) {
+        auto id = gst_pad_add_probe(
+            src,
+            GST_PAD_PROBE_TYPE_BUFFER,
+            reinterpret_cast<GstPadProbeCallback>(
+                &CompositorPipeline::onOutputBuffer),
+            this,
+            nullptr);
+        m_probes.push_back(std::make_pair(src, id));
+    }
+    gst_object_unref(mixer);
+}
+
+CompositorPipeline::~CompositorPipeline()
+{
+    for (auto& probe : m_probes) {
+        gst_pad_remove_probe(probe.first, probe.second);
+        gst_object_unref(probe.first);
+    }
+}
+
+GstPadProbeReturn
+CompositorPipeline::onInputBuffer(
+    GstPad*,
+    GstPadProbeInfo*,
+    CompositorPipeline* pipeline)
+{
+    pipeline->m_lastInputNs = toNs(std::chrono::steady_clock::now());
+    return GST_PAD_PROBE_OK;
+}
+
+GstPadProbeReturn
+CompositorPipeline::onOutputBuffer(
+    GstPad*,
+    GstPadProbeInfo* info,
+    CompositorPipeline* pipeline)
+{
+    auto now = std::chrono::steady_clock::now();
+    auto& metrics = ProxyMetrics::instance();
+
+    // the compositor starts a frame once the last camera frame it waits for
+    // arrived. Without a new camera frame it repeats the previous tiles.
+    auto input = pipeline->m_lastInputNs.load();
+    auto start = now;
+    if (input > pipeline->m_lastOutputNs) {
+        start = std::chrono::steady_clock::time_point(
+            std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::nanoseconds(input)));
+    } else {
+        metrics.add("compositor.repeated_frames");
+    }
+    pipeline->m_lastOutputNs = toNs(now);
+    metrics.add("compositor.frames");
+
+    pipeline->m_latency.start(
+        GST_BUFFER_PTS(GST_PAD_PROBE_INFO_BUFFER(info)), start);
+    return GST_PAD_PROBE_OK;
+}
+
+} // end of namespace
@@ -0,0 +1,81 @@
+// Project headers
+#include <FrameLatencyProbe.hpp>
+
+namespace rtsp_proxy_server {
+
+namespace {
+
+/**
+ * frames in flight never pile up in an output pipeline, don't grow
+ * unbounded if some are dropped before the pad
+ */
+const size_t MAX_STARTS = 64;
+
+}
+
+FrameLatencyProbe::FrameLatencyProbe(GstPad* pad, Callback callback)
+    :
+    m_pad(GST_PAD(gst_object_ref(pad))),
+    m_callback(std::move(callback))
+{
+    m_probeId = gst_pad_add_probe(
+        m_pad,
+        GST_PAD_PROBE_TYPE_BUFFER,
+        reinterpret_cast<GstPadProbeCallback>(&FrameLatencyProbe::onBuffer),
+        this,
+        nullptr);
+}
+
+FrameLatencyProbe::~FrameLatencyProbe()
+{
+    if (m_probeId) {
+        gst_pad_remove_probe(m_pad, m_probeId);
+    }
+    gst_object_unref(m_pad);
+}
+
+void
+FrameLatencyProbe::start(
+    GstClockTime pts,
+    std::chrono::steady_clock::time_point time)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_starts.push_back(std::make_pair(pts, time));
+    while (m_starts.size() > MAX_STARTS) {
+        m_starts.pop_front();
+    }
+}
+
+GstPadProbeReturn
+FrameLatencyProbe::onBuffer(
+    GstPad*,
+    GstPadProbeInfo* info,
+    FrameLatencyProbe* probe)
+{
+    auto pts = GST_BUFFER_PTS(GST_PAD_PROBE_INFO_BUFFER(info));
+    auto now = std::chrono::steady_clock::now();
+    probe->m_frames++;
+
+    std::chrono::steady_clock::time_point started;
+    bool found = false;
+    {
+        std::lock_guard<std::mutex> lock(probe->m_mutex);
+        auto& starts = probe->m_starts;
+
+        // frames leave in order, older unmatched frames were dropped
+        while (not starts.empty() && starts.front().first <= pts) {
+            if (starts.front().first == pts) {
+                started = starts.front().second;
+                found = true;
+            }
+            starts.pop_front();
+        }
+    }
+    if (found && probe->m_callback) {
+        probe->m_callback(
+            std::chrono::duration<double, std::milli>(now - started).count());
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+} // end of namespace
@@ -0,0 +1,206 @@
+// System headers
+#include <pthread.h>
+#include <stdio.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// STL headers
+#include <algorithm>
+
+// Project headers
+#include <FrameTracer.hpp>
+
+namespace rtsp_proxy_server {
+
+std::atomic<bool> FrameTracer::s_enabled = {false};
+
+thread_local FrameTracer::ThreadRingHolder FrameTracer::t_ring;
+
+FrameTracer::ThreadRingHolder::~ThreadRingHolder()
+{
+    if (ring) {
+        ring->free = true;
+    }
+}
+
+FrameTracer&
+FrameTracer::instance()
+{
+    static FrameTracer tracer;
+    return tracer;
+}
+
+void
+FrameTracer::enable(size_t eventsPerThread)
+{
+    m_eventsPerThread = eventsPerThread;
+    s_enabled = eventsPerThread > 0;
+
+    printf(
+        "Frame tracing enabled, %zu events per thread\n", eventsPerThread);
+    fflush(stdout);
+}
+
+FrameTracer::ThreadRing*
+FrameTracer::acquireRing()
+{
+    char name[16] = "";
+    pthread_getname_np(pthread_self(), name, sizeof(name));
+    int tid = int(syscall(SYS_gettid));
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_threadNames[tid] = name;
+
+    // media and readers come and go with their threads, their rings are
+    // taken over by new threads instead of growing without bound
+    for (auto& r : m_rings) {
+        bool expected = true;
+        if (r->free.compare_exchange_strong(expected, false)) {
+            return r.get();
+        }
+    }
+    m_rings.emplace_back(new ThreadRing(m_eventsPerThread));
+    return m_rings.back().get();
+}
+
+void
+FrameTracer::record(TraceEvent const& event)
+{
+    auto* ring = t_ring.ring;
+    if (not ring) {
+        ring = acquireRing();
+        t_ring.ring = ring;
+    }
+
+    static thread_local int tid = int(syscall(SYS_gettid));
+
+    auto head = ring->head.load(std::memory_order_relaxed);
+    auto& slot = ring->events[head % ring->events.size()];
+    slot = event;
+    slot.tid = tid;
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+std::string
+FrameTracer::formatJson()
+{
+    // copy the rings, then drop the events that may have been overwritten
+    // while copying
+    std::vector<TraceEvent> events;
+    std::map<int, std::string> names;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        names = m_threadNames;
+
+        for (auto const& r : m_rings) {
+            auto size = uint64_t(r->events.size());
+            auto head = r->head.load(std::memory_order_acquire);
+            auto first = (head > size) ? head - size : 0;
+
+            std::vector<TraceEvent> copy;
+            copy.reserve(size_t(head - first));
+            for (auto i = first; i < head; i++) {
+                copy.push_back(r->events[i % size]);
+            }
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            auto after = r->head.load(std::memory_order_relaxed);
+            auto valid = (after >= size) ? after - size + 1 : 0;
+            for (auto i = std::max(first, valid); i < head; i++) {
+                events.push_back(copy[size_t(i - first)]);
+            }
+        }
+    }
+
+    std::sort(
+        events.begin(),
+        events.end(),
+        [](TraceEvent const& a, TraceEvent const& b) {
+            return a.startNs < b.startNs;
+        });
+
+    int pid = int(getpid());
+    std::string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    char line[512];
+    bool first = true;
+    auto append = [&](int len) {
+        if (len <= 0) {
+            return;
+        }
+        if (not first) {
+            out += ",\n";
+        }
+        first = false;
+        out.append(line, std::min(size_t(len), sizeof(line) - 1));
+    };
+
+    for (auto const& n : names) {
+        append(snprintf(
+            line,
+            sizeof(line),
+            "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+            "\"args\":{\"name\":\"%s\"}}",
+            pid,
+            n.first,
+            n.second.c_str()));
+    }
+
+    for (auto const& e : events) {
+        double ts = double(e.startNs) / 1000.;
+        append(snprintf(
+            line,
+            sizeof(line),
+            "{\"name\":\"%s\",\"cat\":\"frame\",\"ph\":\"X\",\"pid\":%d,"
+            "\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,"
+            "\"args\":{\"frame\":%llu,\"cam\":%d}}",
+            e.name,
+            pid,
+            e.tid,
+            ts,
+            double(e.endNs - e.startNs) / 1000.,
+            static_cast<unsigned long long>(e.frame),
+            e.cam));
+
+        // flow arrows bind to the slice enclosing their timestamp
+        if (e.flowIn) {
+            append(snprintf(
+                line,
+                sizeof(line),
+                "{\"name\":\"frame\",\"cat\":\"frame\",\"ph\":\"f\","
+                "\"bp\":\"e\",\"id\":%llu,\"pid\":%d,\"tid\":%d,\"ts\":%.3f}",
+                static_cast<unsigned long long>(e.flowIn),
+                pid,
+                e.tid,
+                ts));
+        }
+        if (e.flowOut) {
+            append(snprintf(
+                line,
+                sizeof(line),
+                "{\"name\":\"frame\",\"cat\":\"frame\",\"ph\":\"s\","
+                "\"id\":%llu,\"pid\":%d,\"tid\":%d,\"ts\":%.3f}",
+                static_cast<unsigned long long>(e.flowOut),
+                pid,
+                e.tid,
+                ts));
+        }
+    }
+    out += "\n]}\n";
+    return out;
+}
+
+bool
+FrameTracer::writeJson(std::string const& path)
+{
+    auto json = formatJson();
+
+    FILE* f = fopen(path.c_str(), "w");
+    if (not f) {
+        return false;
+    }
+    bool ok = fwrite(json.data(), 1, json.size(), f) == json.size();
+    ok = (fclose(f) == 0) && ok;
+    return ok;
+}
+
+} // end of namespace
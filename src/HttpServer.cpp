@@ -0,0 +1,290 @@
+// System headers
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// STL headers
+#include <stdexcept>
+
+// Project headers
+#include <HttpServer.hpp>
+
+namespace rtsp_proxy_server {
+
+#define DEBUG_HTTP_SERVER 0
+
+namespace {
+
+/** maximum size of request headers we accept */
+constexpr size_t MAX_REQUEST_SIZE = 8192;
+
+/** maximum number of connections waiting for a worker */
+constexpr size_t MAX_PENDING = 256;
+
+const char*
+statusText(int status)
+{
+    switch (status) {
+        case 200: return "OK";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 503: return "Service Unavailable";
+        default: return "Internal Server Error";
+    }
+}
+
+bool
+sendAll(int fd, const void* data, size_t size)
+{
+    auto* ptr = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t n = send(fd, ptr, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        ptr += n;
+        size -= size_t(n);
+    }
+    return true;
+}
+
+}
+
+HttpResponse
+HttpResponse::text(int status, std::string const& text)
+{
+    HttpResponse res;
+    res.status = status;
+    res.body = std::make_shared<const std::vector<uint8_t>>(
+        text.begin(), text.end());
+    return res;
+}
+
+HttpServer::HttpServer(
+    std::string const& address,
+    ushort port,
+    uint threads)
+{
+    m_listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (m_listenFd < 0) {
+        throw std::runtime_error(
+            std::string("Failed to create HTTP socket: ") + strerror(errno));
+    }
+
+    int one = 1;
+    setsockopt(m_listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, address.c_str(), &addr.sin_addr) != 1) {
+        close(m_listenFd);
+        throw std::runtime_error("Invalid HTTP address '" + address + "'");
+    }
+
+    if (bind(m_listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) ||
+        listen(m_listenFd, 128)) {
+        auto err = std::string(strerror(errno));
+        close(m_listenFd);
+        throw std::runtime_error(
+            "Failed to listen on HTTP " + address + ":" +
+            std::to_string(port) + ": " + err);
+    }
+
+    m_running = true;
+    m_acceptThread = std::thread(&HttpServer::acceptThread, this);
+    for (uint i = 0; i < threads; i++) {
+        m_workers.emplace_back(&HttpServer::workerThread, this);
+    }
+
+    printf("HTTP server listening on %s:%u\n", address.c_str(), port);
+}
+
+HttpServer::~HttpServer()
+{
+    m_running = false;
+
+    // wake up accept()
+    shutdown(m_listenFd, SHUT_RDWR);
+    if (m_acceptThread.joinable()) {
+        m_acceptThread.join();
+    }
+    close(m_listenFd);
+
+    m_pendingCv.notify_all();
+    for (auto& t : m_workers) {
+        if (t.joinable()) {
+            t.join();
+        }
+    }
+    for (int fd : m_pending) {
+        close(fd);
+    }
+}
+
+void
+HttpServer::addHandler(std::string const& path, HttpHandler handler)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_handlers[path] = handler;
+}
+
+bool
+HttpServer::getQueryParam(
+    std::string const& query,
+    std::string const& name,
+    std::string& value)
+{
+    size_t pos = 0;
+    while (pos <= query.size()) {
+        size_t end = query.find('&', pos);
+        if (end == std::string::npos) {
+            end = query.size();
+        }
+        auto param = query.substr(pos, end - pos);
+        auto eq = param.find('=');
+        if (param.substr(0, eq) == name) {
+            value = (eq == std::string::npos) ? "" : param.substr(eq + 1);
+            return true;
+        }
+        pos = end + 1;
+    }
+    return false;
+}
+
+void
+HttpServer::acceptThread()
+{
+    while (m_running) {
+        int fd = accept(m_listenFd, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            break;
+        }
+
+        // don't let a slow client hold a worker forever
+        struct timeval tv = {5, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_pending.size() >= MAX_PENDING) {
+            lock.unlock();
+            close(fd);
+            continue;
+        }
+        m_pending.push_back(fd);
+        lock.unlock();
+        m_pendingCv.notify_one();
+    }
+}
+
+void
+HttpServer::workerThread()
+{
+    while (m_running) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_pendingCv.wait(lock, [this] {
+            return not m_running || not m_pending.empty();
+        });
+        if (not m_running) {
+            break;
+        }
+        int fd = m_pending.front();
+        m_pending.pop_front();
+        lock.unlock();
+
+        serve(fd);
+        close(fd);
+    }
+}
+
+void
+HttpServer::serve(int fd)
+{
+    // read request headers
+    std::string request;
+    char buf[1024];
+    while (request.find("\r\n\r\n") == std::string::npos) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0 || request.size() + size_t(n) > MAX_REQUEST_SIZE) {
+            return;
+        }
+        request.append(buf, size_t(n));
+    }
+
+    // request line: METHOD SP TARGET SP VERSION
+    auto lineEnd = request.find("\r\n");
+    auto line = request.substr(0, lineEnd);
+    auto sp1 = line.find(' ');
+    auto sp2 = line.find(' ', sp1 + 1);
+
+    HttpResponse res;
+    if (sp1 == std::string::npos || sp2 == std::string::npos) {
+        res = HttpResponse::text(400, "bad request\n");
+    } else if (line.substr(0, sp1) != "GET") {
+        res = HttpResponse::text(405, "only GET is supported\n");
+    } else {
+        auto target = line.substr(sp1 + 1, sp2 - sp1 - 1);
+        auto q = target.find('?');
+        auto path = target.substr(0, q);
+        auto query = (q == std::string::npos) ? "" : target.substr(q + 1);
+
+        #if DEBUG_HTTP_SERVER
+            printf("http: GET %s ? %s\n", path.c_str(), query.c_str());
+        #endif
+
+        HttpHandler handler;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto it = m_handlers.find(path);
+            if (it != m_handlers.end()) {
+                handler = it->second;
+            }
+        }
+
+        if (not handler) {
+            res = HttpResponse::text(404, "not found\n");
+        } else {
+            try {
+                res = handler(query);
+            } catch (std::exception const& e) {
+                res = HttpResponse::text(500, std::string(e.what()) + "\n");
+            }
+        }
+    }
+
+    size_t bodySize = res.body ? res.body->size() : 0;
+
+    char header[512];
+    int len = snprintf(
+        header,
+        sizeof(header),
+        "HTTP/1.0 %d %s\r\n"
+        "Content-Type: %s\r\n"
+        "Content-Length: %zu\r\n"
+        "Cache-Control: no-cache\r\n"
+        "Connection: close\r\n"
+        "\r\n",
+        res.status,
+        statusText(res.status),
+        res.contentType.c_str(),
+        bodySize);
+
+    if (sendAll(fd, header, size_t(len)) && bodySize > 0) {
+        sendAll(fd, res.body->data(), bodySize);
+    }
+}
+
+} // end of namespace
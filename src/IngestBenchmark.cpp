@@ -0,0 +1,502 @@
+// System headers
+#include <stdio.h>
+#include <sys/resource.h>
+
+// STL headers
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+// gstreamer headers
+#include <gst/gst.h>
+
+// Project headers
+#include <IngestBenchmark.hpp>
+#include <CompositorPipeline.hpp>
+#include <FrameLatencyProbe.hpp>
+#include <FrameTracer.hpp>
+#include <ProxyMetrics.hpp>
+#include <RtspProxyProcessor.hpp>
+
+namespace rtsp_proxy_server {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+using Seconds = std::chrono::duration<double>;
+
+/** element ending the output path instead of the payloader */
+const char* SINK = "fakesink name=sink sync=false";
+
+/** how long to wait for the encoder to drain at the end of a run */
+const GstClockTime DRAIN_TIMEOUT = 5 * GST_SECOND;
+
+/**
+ * \brief Get the user and system CPU time of the process, in seconds
+ */
+double
+getCpuSeconds()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return double(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+        double(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+/**
+ * \brief Create a pipeline from a launch string
+ *
+ * \return pipeline, or nullptr after printing the error
+ */
+GstElement*
+launch(std::string const& pipeline)
+{
+    GError* error = nullptr;
+    GstElement* element = gst_parse_launch(pipeline.c_str(), &error);
+    if (error) {
+        fprintf(
+            stderr,
+            "Failed to create pipeline '%s': %s\n",
+            pipeline.c_str(),
+            error->message);
+        g_error_free(error);
+        if (element) {
+            gst_object_unref(element);
+        }
+        return nullptr;
+    }
+    return element;
+}
+
+/**
+ * \brief Get the sink pad of the element named "sink" of a pipeline
+ */
+GstPad*
+getSinkPad(GstElement* pipeline)
+{
+    GstElement* sink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+    GstPad* pad = gst_element_get_static_pad(sink, "sink");
+    gst_object_unref(sink);
+    return pad;
+}
+
+/**
+ * \brief Pop an EOS or error message of a pipeline
+ *
+ * \return false on an error
+ */
+bool
+popBusMessage(GstElement* pipeline, GstClockTime timeout, bool* eos)
+{
+    GstBus* bus = gst_element_get_bus(pipeline);
+    GstMessage* msg = gst_bus_timed_pop_filtered(
+        bus,
+        timeout,
+        GstMessageType(GST_MESSAGE_EOS | GST_MESSAGE_ERROR));
+    gst_object_unref(bus);
+
+    bool ok = true;
+    if (msg && GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR) {
+        GError* error = nullptr;
+        gst_message_parse_error(msg, &error, nullptr);
+        fprintf(stderr, "Pipeline error: %s\n", error->message);
+        g_error_free(error);
+        ok = false;
+    }
+    *eos = msg != nullptr;
+    if (msg) {
+        gst_message_unref(msg);
+    }
+    return ok;
+}
+
+double
+percentile(std::vector<double> sorted, double p)
+{
+    if (sorted.empty()) {
+        return 0.;
+    }
+    std::sort(sorted.begin(), sorted.end());
+    auto idx = std::min(sorted.size() - 1, size_t(p * double(sorted.size())));
+    return sorted[idx];
+}
+
+}
+
+IngestBenchmark::IngestBenchmark(
+    std::shared_ptr<const RtspProxyConfig> config)
+    :
+    m_config(config)
+{
+}
+
+int
+IngestBenchmark::run()
+{
+    auto const& files = m_config->getFileIngest();
+    bool compositor = m_config->getOutputEngine() == OutputEngine::GStreamer;
+    printf(
+        "\nIngest benchmark: %zu files, %ux%u output, %s engine%s, %s\n\n",
+        m_config->getInputPipelinesNum(),
+        m_config->getOutputDimensions().width,
+        m_config->getOutputDimensions().height,
+        compositor ? "gstreamer" : "opencv",
+        files.encode ? " with encoding" : "",
+        files.duration > 0 ?
+            ("for " + std::to_string(files.duration) + " s").c_str() :
+            "until all files end");
+    if (not compositor && m_config->getGovernor().enabled) {
+        fprintf(
+            stderr,
+            "WARNING: the overload governor is enabled and may degrade the "
+            "composed frames\n");
+    }
+
+    // the RTSP server is not there to initialize gstreamer
+    gst_init(nullptr, nullptr);
+
+    Measurement m;
+    bool ok = compositor ? runCompositor(m) : runProcessor(m);
+    if (not ok) {
+        return 1;
+    }
+    if (m.elapsed <= 0.) {
+        printf("\nIngest benchmark results:\n  no frame was composed\n");
+        return 1;
+    }
+    printResults(m);
+    return 0;
+}
+
+bool
+IngestBenchmark::runProcessor(Measurement& m)
+{
+    auto const& files = m_config->getFileIngest();
+    RtspProxyProcessor processor(m_config);
+
+    // the composed frames are pushed into the output pipeline like the
+    // media pushes them, which blocks while the encoder is behind
+    GstElement* pipeline = nullptr;
+    GstElement* appsrc = nullptr;
+    std::unique_ptr<FrameLatencyProbe> probe;
+    std::mutex latencyMutex;
+    bool started = false;
+
+    if (files.encode) {
+        pipeline = launch(
+            CompositorPipeline::replaceLastElement(
+                m_config->getOutputPipeline(), SINK));
+        if (not pipeline) {
+            return false;
+        }
+        appsrc = gst_bin_get_by_name(GST_BIN(pipeline), "source");
+        if (not appsrc) {
+            fprintf(
+                stderr, "appsrc 'source' not found in the output pipeline\n");
+            gst_object_unref(pipeline);
+            return false;
+        }
+        auto const& dim = m_config->getOutputDimensions();
+        g_object_set(
+            appsrc,
+            "block", TRUE,
+            "max-bytes", guint64(2) * dim.width * dim.height * 3,
+            NULL);
+
+        GstPad* pad = getSinkPad(pipeline);
+        probe.reset(
+            new FrameLatencyProbe(
+                pad,
+                [&](double latencyMs) {
+                    std::lock_guard<std::mutex> lock(latencyMutex);
+                    if (started) {
+                        m.latencyMs.push_back(latencyMs);
+                    }
+                }));
+        gst_object_unref(pad);
+        gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    }
+
+    auto frameDuration =
+        GstClockTime(GST_SECOND / std::max(1u, m_config->getOutputFps()));
+    GstClockTime pts = 0;
+
+    auto& metrics = ProxyMetrics::instance();
+    const char* stages[] = {
+        "input.read_sec",
+        "input.read_frames",
+        "processor.wait_sec",
+        "processor.compose_sec",
+        "processor.publish_sec",
+        "processor.composed_frames",
+        "output.dropped_frames",
+    };
+    std::map<std::string, double> base;
+
+    // measure from the first composed frame, opening the files doesn't count
+    Clock::time_point start;
+    Clock::time_point lastProgress;
+    double cpuStart = 0.;
+    uint64_t lastFrames = 0;
+    bool failed = false;
+
+    for (;;) {
+        uint64_t frameId = 0;
+        auto frame = processor.getFrame(&frameId);
+        auto now = Clock::now();
+
+        if (frame) {
+            if (not started) {
+                std::lock_guard<std::mutex> lock(latencyMutex);
+                started = true;
+                start = now;
+                lastProgress = now;
+                cpuStart = getCpuSeconds();
+                for (auto name : stages) {
+                    base[name] = metrics.get(name);
+                }
+            }
+            m.frames++;
+
+            auto composed = processor.getComposeTime(frameId);
+            auto composeTime = Clock::time_point(
+                std::chrono::duration_cast<Clock::duration>(
+                    std::chrono::nanoseconds(composed)));
+
+            if (appsrc) {
+                auto dataSize = frame->total() * frame->elemSize();
+                auto* buf = gst_buffer_new_and_alloc(dataSize);
+                gst_buffer_fill(buf, 0, frame->data, dataSize);
+                GST_BUFFER_PTS(buf) = pts;
+                GST_BUFFER_DTS(buf) = pts;
+                GST_BUFFER_DURATION(buf) = frameDuration;
+                if (composed > 0) {
+                    probe->start(pts, composeTime);
+                }
+                pts += frameDuration;
+
+                GstFlowReturn ret = GST_FLOW_ERROR;
+                g_signal_emit_by_name(appsrc, "push-buffer", buf, &ret);
+                gst_buffer_unref(buf);
+                if (ret != GST_FLOW_OK) {
+                    fprintf(stderr, "The output pipeline stopped\n");
+                    failed = true;
+                    break;
+                }
+            } else if (composed > 0) {
+                m.latencyMs.push_back(
+                    std::chrono::duration<double, std::milli>(
+                        now - composeTime).count());
+            }
+        } else if (processor.isInputFinished()) {
+            break;
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+
+        if (not started) {
+            continue;
+        }
+        if (files.duration > 0 &&
+            now - start >= std::chrono::seconds(files.duration)) {
+            break;
+        }
+        if (now - lastProgress >= std::chrono::seconds(5)) {
+            printf(
+                "  %.0f s: %.1f fps\n",
+                Seconds(now - start).count(),
+                double(m.frames - lastFrames) /
+                    Seconds(now - lastProgress).count());
+            fflush(stdout);
+            lastProgress = now;
+            lastFrames = m.frames;
+        }
+    }
+
+    if (started) {
+        m.elapsed = Seconds(Clock::now() - start).count();
+        m.cpu = getCpuSeconds() - cpuStart;
+        for (auto name : stages) {
+            m.stages[name] = metrics.get(name) - base[name];
+        }
+    }
+
+    if (pipeline) {
+        // the frames still in the encoder are measured too
+        g_signal_emit_by_name(appsrc, "end-of-stream", nullptr);
+        bool eos = false;
+        if (not failed && not popBusMessage(pipeline, DRAIN_TIMEOUT, &eos)) {
+            failed = true;
+        }
+        gst_element_set_state(pipeline, GST_STATE_NULL);
+        probe.reset();
+        gst_object_unref(appsrc);
+        gst_object_unref(pipeline);
+    }
+    return not failed;
+}
+
+bool
+IngestBenchmark::runCompositor(Measurement& m)
+{
+    auto const& files = m_config->getFileIngest();
+    if (files.loop && files.duration == 0) {
+        fprintf(
+            stderr,
+            "WARNING: the GStreamer engine doesn't loop the files, the run "
+            "ends with the shortest file\n");
+    }
+
+    GstElement* pipeline = launch(
+        CompositorPipeline::build(*m_config, SINK, files.encode));
+    if (not pipeline) {
+        return false;
+    }
+
+    std::mutex mutex;
+    bool started = false;
+    Clock::time_point start;
+    double cpuStart = 0.;
+
+    GstPad* pad = getSinkPad(pipeline);
+    std::unique_ptr<CompositorPipeline> compositor(
+        new CompositorPipeline(
+            pipeline,
+            pad,
+            [&](double latencyMs) {
+                std::lock_guard<std::mutex> lock(mutex);
+                // measure from the first composed frame, like the processor
+                if (not started) {
+                    started = true;
+                    start = Clock::now();
+                    cpuStart = getCpuSeconds();
+                }
+                m.frames++;
+                m.latencyMs.push_back(latencyMs);
+            }));
+    gst_object_unref(pad);
+
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+
+    Clock::time_point lastProgress = Clock::now();
+    uint64_t lastFrames = 0;
+    bool failed = false;
+
+    for (;;) {
+        bool eos = false;
+        if (not popBusMessage(pipeline, 100 * GST_MSECOND, &eos)) {
+            failed = true;
+            break;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        auto now = Clock::now();
+        if (eos) {
+            m.elapsed = started ? Seconds(now - start).count() : 0.;
+            break;
+        }
+        if (not started) {
+            lastProgress = now;
+            continue;
+        }
+        if (files.duration > 0 &&
+            now - start >= std::chrono::seconds(files.duration)) {
+            m.elapsed = Seconds(now - start).count();
+            break;
+        }
+        if (now - lastProgress >= std::chrono::seconds(5)) {
+            printf(
+                "  %.0f s: %.1f fps\n",
+                Seconds(now - start).count(),
+                double(m.frames - lastFrames) /
+                    Seconds(now - lastProgress).count());
+            fflush(stdout);
+            lastProgress = now;
+            lastFrames = m.frames;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        m.cpu = started ? getCpuSeconds() - cpuStart : 0.;
+    }
+
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    compositor.reset();
+    gst_object_unref(pipeline);
+    return not failed;
+}
+
+void
+IngestBenchmark::printResults(Measurement& m) const
+{
+    auto perFrameMs = [&](const char* name, double count) {
+        return count > 0. ? 1000. * m.stages[name] / count : 0.;
+    };
+
+    double mean = 0.;
+    for (auto latency : m.latencyMs) {
+        mean += latency;
+    }
+    if (not m.latencyMs.empty()) {
+        mean /= double(m.latencyMs.size());
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    printf("\nIngest benchmark results:\n");
+    printf(
+        "  composed frames     %llu in %.1f s, %.1f fps\n",
+        static_cast<unsigned long long>(m.frames),
+        m.elapsed,
+        double(m.frames) / m.elapsed);
+    printf(
+        "  CPU                 %.2f ms per frame, %.2f cores\n",
+        m.frames ? 1000. * m.cpu / double(m.frames) : 0.,
+        m.cpu / m.elapsed);
+    printf(
+        "  latency             mean %.2f ms, p50 %.2f ms, p99 %.2f ms "
+        "(compose to %s)\n",
+        mean,
+        percentile(m.latencyMs, 0.5),
+        percentile(m.latencyMs, 0.99),
+        m_config->getFileIngest().encode ? "encoded" : "consumer");
+
+    if (not m.stages.empty()) {
+        double composed = m.stages["processor.composed_frames"];
+        double read = m.stages["input.read_frames"];
+        printf(
+            "  input frames        %.0f, %.1f fps over all files\n",
+            read,
+            read / m.elapsed);
+        printf(
+            "  per input frame     read+decode %.2f ms (reader threads)\n",
+            perFrameMs("input.read_sec", read));
+        printf(
+            "  per composed frame  wait %.2f ms, compose %.2f ms, "
+            "publish %.2f ms\n",
+            perFrameMs("processor.wait_sec", composed),
+            perFrameMs("processor.compose_sec", composed),
+            perFrameMs("processor.publish_sec", composed));
+        printf(
+            "  dropped frames      %.0f\n",
+            m.stages["output.dropped_frames"]);
+    }
+    printf(
+        "  peak RSS            %.1f MB\n",
+        double(usage.ru_maxrss) / 1024.);
+
+    auto const& trace = m_config->getTrace();
+    if (trace.enabled) {
+        if (FrameTracer::instance().writeJson(trace.path)) {
+            printf("  frame trace         %s\n", trace.path.c_str());
+        } else {
+            fprintf(stderr, "Failed to write '%s'\n", trace.path.c_str());
+        }
+    }
+    fflush(stdout);
+}
+
+} // end of namespace
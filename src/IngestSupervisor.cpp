@@ -0,0 +1,296 @@
+// System headers
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// STL headers
+#include <cstdio>
+#include <utility>
+
+// Project headers
+#include <IngestSupervisor.hpp>
+#include <IngestWorker.hpp>
+#include <ProxyMetrics.hpp>
+#include <ShmFrameRing.hpp>
+
+namespace rtsp_proxy_server {
+
+#define DEBUG_INGEST_SUPERVISOR 0
+
+namespace {
+
+/** how often the workers are checked */
+const auto POLL_INTERVAL = std::chrono::milliseconds(100);
+
+/** how long terminated workers get to exit before they are killed */
+const auto TERMINATE_TIMEOUT = std::chrono::seconds(2);
+
+/**
+ * \brief Check if a worker decodes the same cameras, from the same
+ *        locations, with both configurations
+ */
+bool
+hasSameCameras(
+    RtspProxyConfig const& a,
+    RtspProxyConfig const& b,
+    uint index)
+{
+    size_t firstA = 0;
+    size_t lastA = 0;
+    size_t firstB = 0;
+    size_t lastB = 0;
+    IngestWorker::getCameras(a, index, firstA, lastA);
+    IngestWorker::getCameras(b, index, firstB, lastB);
+    if (firstA != firstB || lastA != lastB || firstA == lastA) {
+        return false;
+    }
+    for (size_t cam = firstA; cam < lastA; cam++) {
+        if (a.getInputPipelines()[cam] != b.getInputPipelines()[cam] ||
+            a.getInputBackupPipelines()[cam] !=
+                b.getInputBackupPipelines()[cam]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+}
+
+IngestSupervisor::IngestSupervisor(
+    std::string const& configFile,
+    std::shared_ptr<const RtspProxyConfig> config)
+    :
+    m_configFile(configFile),
+    m_config(config),
+    m_restartDelay(
+        std::chrono::milliseconds(config->getIngestWorkers().restartMs)),
+    m_workers(IngestWorker::getWorkersNum(*config))
+{
+    // the workers are started by the supervisor thread, see spawn()
+    m_thread = std::thread(&IngestSupervisor::supervisorThread, this);
+}
+
+IngestSupervisor::~IngestSupervisor()
+{
+    m_running = false;
+    m_thread.join();
+}
+
+void
+IngestSupervisor::restart(std::shared_ptr<const RtspProxyConfig> config)
+{
+    std::lock_guard<std::mutex> lock(m_pendingMutex);
+    m_pendingConfig = config;
+}
+
+void
+IngestSupervisor::spawn(uint index, Worker& worker)
+{
+    // everything the child needs is prepared before the fork, the child of
+    // a threaded process may only make async-signal-safe calls
+    pid_t proxy = getpid();
+    std::string indexArg = std::to_string(index);
+    std::string proxyArg = std::to_string(proxy);
+    const char* argv[] = {
+        "/proc/self/exe",
+        m_configFile.c_str(),
+        IngestWorker::OPTION,
+        indexArg.c_str(),
+        proxyArg.c_str(),
+        nullptr
+    };
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        // terminated when the supervisor thread, or the proxy, is gone
+        prctl(PR_SET_PDEATHSIG, SIGTERM);
+        if (getppid() != proxy) {
+            _exit(1);
+        }
+        // the sockets and files of the proxy stay with the proxy
+        #ifdef SYS_close_range
+            syscall(SYS_close_range, 3U, ~0U, 0U);
+        #else
+            for (int fd = 3; fd < 1024; fd++) {
+                close(fd);
+            }
+        #endif
+        execv(argv[0], const_cast<char* const*>(argv));
+        _exit(127);
+    }
+
+    if (pid < 0) {
+        fprintf(
+            stderr,
+            "Failed to start ingest worker %u: %s\n",
+            index,
+            strerror(errno));
+        fflush(stderr);
+        worker.startAt = Clock::now() + m_restartDelay;
+        return;
+    }
+
+    printf("Started ingest worker %u, pid %d\n", index, int(pid));
+    fflush(stdout);
+    worker.pid = pid;
+}
+
+void
+IngestSupervisor::reap()
+{
+    auto& metrics = ProxyMetrics::instance();
+    for (size_t i = 0; i < m_workers.size(); i++) {
+        auto& worker = m_workers[i];
+        int status = 0;
+        if (worker.pid <= 0 || waitpid(worker.pid, &status, WNOHANG) <= 0) {
+            continue;
+        }
+        if (WIFSIGNALED(status)) {
+            fprintf(
+                stderr,
+                "Ingest worker %zu (pid %d) killed by signal %d, restarting\n",
+                i,
+                int(worker.pid),
+                WTERMSIG(status));
+        } else {
+            fprintf(
+                stderr,
+                "Ingest worker %zu (pid %d) exited with %d, restarting\n",
+                i,
+                int(worker.pid),
+                WEXITSTATUS(status));
+        }
+        fflush(stderr);
+        metrics.add("input.worker_restarts");
+        closeRings(uint(i));
+        worker.pid = -1;
+        worker.startAt = Clock::now() + m_restartDelay;
+    }
+}
+
+void
+IngestSupervisor::terminateAll()
+{
+    std::vector<uint> all;
+    for (size_t i = 0; i < m_workers.size(); i++) {
+        all.push_back(uint(i));
+    }
+    terminate(all);
+}
+
+void
+IngestSupervisor::terminate(std::vector<uint> const& indexes)
+{
+    for (auto i : indexes) {
+        if (m_workers[i].pid > 0) {
+            kill(m_workers[i].pid, SIGTERM);
+        }
+    }
+
+    auto deadline = Clock::now() + TERMINATE_TIMEOUT;
+    for (auto i : indexes) {
+        auto& worker = m_workers[i];
+        while (worker.pid > 0) {
+            if (waitpid(worker.pid, nullptr, WNOHANG) != 0) {
+                worker.pid = -1;
+            } else if (Clock::now() >= deadline) {
+                fprintf(
+                    stderr,
+                    "Ingest worker (pid %d) did not exit, killing it\n",
+                    int(worker.pid));
+                fflush(stderr);
+                kill(worker.pid, SIGKILL);
+                waitpid(worker.pid, nullptr, 0);
+                closeRings(i);
+                worker.pid = -1;
+            } else {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+        }
+    }
+}
+
+void
+IngestSupervisor::closeRings(uint index)
+{
+    // the ring names are those of the configuration the worker ran with,
+    // the worker restarted in its place creates them again
+    auto names = IngestWorker::getRingNames(*m_config, getpid(), index);
+    for (auto const& name : names) {
+        closeShmFrameRing(name);
+    }
+}
+
+void
+IngestSupervisor::supervisorThread()
+{
+    auto& metrics = ProxyMetrics::instance();
+    for (auto& worker : m_workers) {
+        worker.startAt = Clock::now();
+    }
+
+    while (m_running) {
+        std::shared_ptr<const RtspProxyConfig> pending;
+        {
+            std::lock_guard<std::mutex> lock(m_pendingMutex);
+            std::swap(pending, m_pendingConfig);
+        }
+        if (pending) {
+            // workers keep running while their cameras are unchanged, the
+            // others are started again with the new configuration
+            auto workers = IngestWorker::getWorkersNum(*pending);
+            std::vector<uint> changed;
+            for (size_t i = 0; i < m_workers.size(); i++) {
+                if (not hasSameCameras(*m_config, *pending, uint(i))) {
+                    changed.push_back(uint(i));
+                }
+            }
+            printf(
+                "Restarting %zu of %zu ingest workers, %u wanted\n",
+                changed.size(),
+                m_workers.size(),
+                workers);
+            fflush(stdout);
+            terminate(changed);
+            m_config = pending;
+            m_workers.resize(workers);
+            m_restartDelay = std::chrono::milliseconds(
+                m_config->getIngestWorkers().restartMs);
+            for (auto i : changed) {
+                if (i < m_workers.size()) {
+                    m_workers[i].startAt = Clock::now();
+                }
+            }
+        }
+
+        reap();
+
+        uint running = 0;
+        for (size_t i = 0; i < m_workers.size(); i++) {
+            auto& worker = m_workers[i];
+            if (worker.pid <= 0 && Clock::now() >= worker.startAt) {
+                spawn(uint(i), worker);
+            }
+            if (worker.pid > 0) {
+                running++;
+            }
+        }
+        metrics.set("input.workers_running", running);
+
+        #if DEBUG_INGEST_SUPERVISOR
+            printf("ingest workers: %u of %zu running\n",
+                running, m_workers.size());
+        #endif
+
+        std::this_thread::sleep_for(POLL_INTERVAL);
+    }
+
+    terminateAll();
+    metrics.set("input.workers_running", 0);
+}
+
+} // end of namespace
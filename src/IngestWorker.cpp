@@ -0,0 +1,177 @@
+// System headers
+#include <semaphore.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+
+// STL headers
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+// Project headers
+#include <IngestWorker.hpp>
+#include <OpenCvReader.hpp>
+#include <ShmOutput.hpp>
+
+namespace rtsp_proxy_server {
+
+#define DEBUG_INGEST_WORKER 0
+
+namespace {
+
+/** set by SIGTERM and SIGINT */
+volatile sig_atomic_t g_stop = 0;
+
+void
+onStopSignal(int)
+{
+    g_stop = 1;
+}
+
+}
+
+const char* const IngestWorker::OPTION = "--ingest-worker";
+
+IngestWorker::IngestWorker(
+    std::shared_ptr<const RtspProxyConfig> config,
+    uint index,
+    pid_t proxy)
+    :
+    m_config(config),
+    m_index(index),
+    m_proxy(proxy)
+{
+}
+
+std::string
+IngestWorker::getRingPrefix(pid_t proxy)
+{
+    // rings of two proxies on the same host never collide
+    return "/rtsp-proxy-ingest-" + std::to_string(proxy);
+}
+
+std::string
+IngestWorker::getRingName(pid_t proxy, size_t cam)
+{
+    // the camera rings of ShmOutput
+    return getRingPrefix(proxy) + "-cam" + std::to_string(cam);
+}
+
+void
+IngestWorker::getCameras(
+    RtspProxyConfig const& config,
+    uint index,
+    size_t& first,
+    size_t& last)
+{
+    auto cameras = config.getIngestWorkers().cameras;
+    first = std::min(
+        size_t(index) * cameras, config.getInputPipelinesNum());
+    last = std::min(first + cameras, config.getInputPipelinesNum());
+}
+
+std::vector<std::string>
+IngestWorker::getRingNames(
+    RtspProxyConfig const& config,
+    pid_t proxy,
+    uint index)
+{
+    size_t first = 0;
+    size_t last = 0;
+    getCameras(config, index, first, last);
+    std::vector<std::string> names;
+    for (size_t cam = first; cam < last; cam++) {
+        names.push_back(getRingName(proxy, cam));
+    }
+    return names;
+}
+
+uint
+IngestWorker::getWorkersNum(RtspProxyConfig const& config)
+{
+    auto cameras = config.getIngestWorkers().cameras;
+    return uint((config.getInputPipelinesNum() + cameras - 1) / cameras);
+}
+
+int
+IngestWorker::run()
+{
+    signal(SIGTERM, onStopSignal);
+    signal(SIGINT, onStopSignal);
+
+    auto const& pipelines = m_config->getInputPipelines();
+    auto const& workers = m_config->getIngestWorkers();
+    size_t first = 0;
+    size_t last = 0;
+    getCameras(*m_config, m_index, first, last);
+    if (first >= last) {
+        fprintf(stderr, "Ingest worker %u has no cameras\n", m_index);
+        return 1;
+    }
+
+    ShmOutputConfig shm;
+    shm.enabled = true;
+    shm.name = getRingPrefix(m_proxy);
+    shm.slots = workers.slots;
+    shm.cameras = true;
+    ShmOutput output(shm);
+
+    sem_t frameReady;
+    sem_init(&frameReady, 0, 0);
+
+    // the readers are gone before the semaphore and the rings
+    {
+        std::vector<std::unique_ptr<OpenCvReader>> readers;
+        for (size_t i = first; i < last; i++) {
+            readers.emplace_back(
+                new OpenCvReader(
+                    pipelines[i],
+                    m_config->getInputBufferSize(),
+                    &frameReady,
+                    m_config->getPlacement().input,
+                    -1,
+                    FileIngestConfig(),
+                    m_config->getJitterBuffer(),
+                    m_config->getInputBackupPipelines()[i],
+                    m_config->getReconnect()));
+        }
+        printf(
+            "Ingest worker %u (pid %d) decoding cameras %zu to %zu\n",
+            m_index,
+            int(getpid()),
+            first,
+            last - 1);
+        fflush(stdout);
+
+        // the proxy may be gone before the death signal was set up
+        while (not g_stop && getppid() == m_proxy) {
+            timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += 200 * 1000 * 1000;
+            if (deadline.tv_nsec >= 1000 * 1000 * 1000) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000 * 1000 * 1000;
+            }
+            sem_timedwait(&frameReady, &deadline);
+
+            for (size_t k = 0; k < readers.size(); k++) {
+                while (auto frame = readers[k]->getFrame()) {
+                    output.publishCamera(
+                        first + k, *frame, std::chrono::steady_clock::now());
+                    #if DEBUG_INGEST_WORKER
+                        printf("worker %u: camera %zu frame\n",
+                            m_index, first + k);
+                    #endif
+                }
+            }
+        }
+    }
+    sem_destroy(&frameReady);
+
+    printf("Ingest worker %u stopped\n", m_index);
+    fflush(stdout);
+    return 0;
+}
+
+} // end of namespace
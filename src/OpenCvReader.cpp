@@ -1,21 +1,121 @@
+// STL headers
+#include <algorithm>
+#include <chrono>
+
+// gstreamer headers
+#include <gst/app/app.h>
+#include <gst/video/video.h>
+
 // Project headers
 #include <OpenCvReader.hpp>
+#include <FrameTracer.hpp>
+#include <ProxyMetrics.hpp>
+#include <ThreadPlacement.hpp>
 
 namespace rtsp_proxy_server {
 
 #define DEBUG_OPEN_CV_READER 0
 
+namespace {
+
+/**
+ * \brief Find the first element created by a factory inside a bin
+ *
+ * \return referenced element, or nullptr
+ */
+GstElement*
+findElement(GstElement* bin, const char* factoryName)
+{
+    GstIterator* it = gst_bin_iterate_recurse(GST_BIN(bin));
+    GValue item = G_VALUE_INIT;
+    GstElement* found = nullptr;
+    bool done = false;
+
+    while (not done && not found) {
+        switch (gst_iterator_next(it, &item)) {
+            case GST_ITERATOR_OK: {
+                auto element = GST_ELEMENT(g_value_get_object(&item));
+                GstElementFactory* factory = gst_element_get_factory(element);
+                if (factory &&
+                    g_strcmp0(GST_OBJECT_NAME(factory), factoryName) == 0) {
+                    found = GST_ELEMENT(gst_object_ref(element));
+                }
+                g_value_reset(&item);
+                break;
+            }
+            case GST_ITERATOR_RESYNC:
+                gst_iterator_resync(it);
+                break;
+            default:
+                done = true;
+                break;
+        }
+    }
+    g_value_unset(&item);
+    gst_iterator_free(it);
+    return found;
+}
+
+}
+
 OpenCvReader::OpenCvReader(
     std::string const& gstPipeline,
     uint bufferSize,
-    sem_t *sem)
+    sem_t *sem,
+    ThreadRoleConfig const& placement,
+    int frameNode,
+    FileIngestConfig const& fileIngest,
+    JitterBufferConfig const& jitterBuffer,
+    CameraPipelines const& backupPipelines,
+    ReconnectConfig const& reconnect,
+    std::string const& shmRing)
     :
     m_gstPipeline(gstPipeline),
+    m_reconnect(reconnect),
+    m_random(std::random_device()()),
     m_videoFrameReadySemaphore(sem),
-    m_buffer(bufferSize)
+    m_buffer(bufferSize),
+    m_fileIngest(fileIngest),
+    m_placement(placement),
+    m_frameNode(frameNode),
+    // frames in the ring, the consumer's current frame, a snapshot, and
+    // the one being decoded
+    m_framePool(std::make_shared<FramePool>()),
+    m_framePoolSize(bufferSize + 3),
+    m_jitterBuffer(jitterBuffer),
+    m_shmRing(shmRing)
 {
     assert(m_videoFrameReadySemaphore != nullptr);
 
+    m_pipelines.push_back(m_gstPipeline);
+    m_pipelines.insert(
+        m_pipelines.end(), backupPipelines.begin(), backupPipelines.end());
+
+    // replayed files are looped or end, they are never reconnected
+    if (m_fileIngest.enabled) {
+        m_reconnect.enabled = false;
+    }
+
+    // the ring of a worker is always followed, the worker tries the backups
+    if (not m_shmRing.empty()) {
+        m_reconnect.enabled = true;
+        m_pipelines.resize(1);
+    }
+
+    // replayed files have no jitter buffer to adapt, and a worker adapts
+    // the jitter buffer of the cameras it decodes
+    if (m_jitterBuffer.enabled && not m_fileIngest.enabled &&
+        m_shmRing.empty()) {
+        m_jitterController.reset(new AdaptiveJitterController(jitterBuffer));
+    }
+
+    // a silent camera blocks VideoCapture::read() until rtspsrc gives up,
+    // if ever. Pulled from the appsink the read returns every second, so
+    // the watchdog sees the stall.
+    m_appsinkRead = m_jitterController ||
+        (m_reconnect.enabled && not m_fileIngest.enabled &&
+            m_shmRing.empty());
+
     // start the reader's thread
     start();
 }
@@ -58,6 +158,15 @@ OpenCvReader::stop() {
 bool
 OpenCvReader::openCam()
 {
+    if (not m_shmRing.empty()) {
+        m_connected = openShm();
+        return m_connected;
+    }
+    if (m_appsinkRead) {
+        m_connected = openPipeline();
+        return m_connected;
+    }
+
     bool success = true;
 
     printf("\nConnecting to GST pipeline:\n\t'%s'...\n", m_gstPipeline.c_str());
@@ -73,67 +182,697 @@ OpenCvReader::openCam()
         printf("\nOpened VideoCapture for:\n\t'%s'\n\n", m_gstPipeline.c_str());
         cv::waitKey(1);
     }
+    m_connected = success;
     return success;
 }
 
 void
 OpenCvReader::closeCam()
 {
+    m_connected = false;
+    m_shmReader.reset();
+    closePipeline();
+
     if (m_videoCapture.isOpened()) {
         printf("\nReleasing VideoCapture:\n\t%s\n", m_gstPipeline.c_str());
         m_videoCapture.release();
     }
 }
 
+bool
+OpenCvReader::openShm()
+{
+    try {
+        m_shmReader.reset(new ShmFrameReader(m_shmRing));
+    } catch (std::runtime_error const& e) {
+        #if DEBUG_OPEN_CV_READER
+            fprintf(stderr, "%s\n", e.what());
+        #endif
+        return false;
+    }
+
+    // a crashed worker leaves its ring open, reattaching to it is no
+    // reconnect: wait for the ring of the restarted worker
+    if (m_shmReader->isClosed() || not m_shmReader->isWriterAlive()) {
+        m_shmReader.reset();
+        return false;
+    }
+    printf(
+        "\nReading camera from '%s':\n\t'%s'\n",
+        m_shmRing.c_str(),
+        m_gstPipeline.c_str());
+    return true;
+}
+
+bool
+OpenCvReader::readShm(cv::Mat& frame)
+{
+    using Clock = std::chrono::steady_clock;
+
+    // like an appsink, wait up to a second for the next frame
+    auto deadline = Clock::now() + std::chrono::seconds(1);
+    while (m_running && Clock::now() < deadline) {
+        if (not m_shmReader && not openShm()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            continue;
+        }
+
+        ShmFrame shmFrame;
+        if (not m_shmReader->next(shmFrame)) {
+            // a restarted worker, or a camera changing its resolution,
+            // replaces the ring. A crashed worker never closes it.
+            if (m_shmReader->isClosed() ||
+                not m_shmReader->isWriterAlive()) {
+                m_shmReader.reset();
+                continue;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+        if (shmFrame.format != SHM_FORMAT_BGR) {
+            return false;
+        }
+
+        // the frame is kept by the compositor for longer than the worker
+        // leaves it in its slot, so it is copied like an appsink buffer
+        cv::Mat(
+            int(shmFrame.height),
+            int(shmFrame.width),
+            CV_8UC3,
+            const_cast<uint8_t*>(shmFrame.data),
+            size_t(shmFrame.stride)).copyTo(frame);
+        if (m_shmReader->isIntact(shmFrame)) {
+            return true;
+        }
+        ProxyMetrics::instance().add("input.torn_frames");
+    }
+    return false;
+}
+
+bool
+OpenCvReader::openPipeline()
+{
+    printf("\nStarting GST pipeline:\n\t'%s'...\n", m_gstPipeline.c_str());
+
+    if (not gst_is_initialized()) {
+        gst_init(nullptr, nullptr);
+    }
+
+    GError* err = nullptr;
+    m_pipeline = gst_parse_launch(m_gstPipeline.c_str(), &err);
+    if (not m_pipeline) {
+        fprintf(
+            stderr,
+            "\nERROR: Unable to create pipeline:\n\t'%s'\n\t%s\n",
+            m_gstPipeline.c_str(),
+            err ? err->message : "unknown error");
+        g_clear_error(&err);
+        return false;
+    }
+    g_clear_error(&err);
+
+    m_appsink = findElement(m_pipeline, "appsink");
+    if (not m_appsink) {
+        fprintf(
+            stderr,
+            "\nERROR: pipeline has no appsink:\n\t'%s'\n",
+            m_gstPipeline.c_str());
+        closePipeline();
+        return false;
+    }
+
+    // frames are handed over in the same format OpenCV uses
+    GstCaps* caps = gst_caps_from_string("video/x-raw,format=BGR");
+    gst_app_sink_set_caps(GST_APP_SINK(m_appsink), caps);
+    gst_caps_unref(caps);
+
+    // the jitter buffer latency is only adapted by the jitter controller
+    m_rtspsrc = m_jitterController ?
+        findElement(m_pipeline, "rtspsrc") : nullptr;
+    if (m_rtspsrc) {
+        // the latency of the pipeline description is replaced by the
+        // adapted one
+        g_object_set(
+            m_rtspsrc,
+            "latency", guint(m_jitterController->getLatency()),
+            NULL);
+        g_signal_connect(
+            m_rtspsrc,
+            "new-manager",
+            G_CALLBACK(&OpenCvReader::onNewManager),
+            static_cast<gpointer>(this));
+    } else if (m_jitterController) {
+        fprintf(
+            stderr,
+            "WARNING: pipeline has no rtspsrc, its latency is not adapted:"
+            "\n\t'%s'\n",
+            m_gstPipeline.c_str());
+    }
+
+    if (gst_element_set_state(m_pipeline, GST_STATE_PLAYING) ==
+        GST_STATE_CHANGE_FAILURE) {
+        fprintf(
+            stderr,
+            "\nERROR: Unable to start pipeline:\n\t'%s'\n",
+            m_gstPipeline.c_str());
+        drainBus();
+        closePipeline();
+        return false;
+    }
+
+    printf("\nStarted pipeline:\n\t'%s'\n\n", m_gstPipeline.c_str());
+    return true;
+}
+
+void
+OpenCvReader::closePipeline()
+{
+    if (not m_pipeline) {
+        return;
+    }
+
+    printf("\nStopping pipeline:\n\t%s\n", m_gstPipeline.c_str());
+    gst_element_set_state(m_pipeline, GST_STATE_NULL);
+
+    {
+        std::lock_guard<std::mutex> lock(m_jitterBuffersMutex);
+        for (auto jb : m_jitterBuffers) {
+            gst_object_unref(jb);
+        }
+        m_jitterBuffers.clear();
+    }
+    m_jitterTotals = JitterSample();
+
+    if (m_rtspsrc) {
+        gst_object_unref(m_rtspsrc);
+        m_rtspsrc = nullptr;
+    }
+    if (m_appsink) {
+        gst_object_unref(m_appsink);
+        m_appsink = nullptr;
+    }
+    gst_object_unref(m_pipeline);
+    m_pipeline = nullptr;
+}
+
+bool
+OpenCvReader::readPipeline(cv::Mat& frame)
+{
+    // nobody else watches the bus, don't let messages pile up
+    drainBus();
+
+    GstSample* sample =
+        gst_app_sink_try_pull_sample(GST_APP_SINK(m_appsink), GST_SECOND);
+    if (not sample) {
+        return false;
+    }
+
+    GstVideoInfo info;
+    GstMapInfo map;
+    GstBuffer* buf = gst_sample_get_buffer(sample);
+    bool success =
+        buf &&
+        gst_video_info_from_caps(&info, gst_sample_get_caps(sample)) &&
+        gst_buffer_map(buf, &map, GST_MAP_READ);
+
+    if (success) {
+        cv::Mat(
+            GST_VIDEO_INFO_HEIGHT(&info),
+            GST_VIDEO_INFO_WIDTH(&info),
+            CV_8UC3,
+            map.data,
+            size_t(GST_VIDEO_INFO_PLANE_STRIDE(&info, 0))).copyTo(frame);
+        gst_buffer_unmap(buf, &map);
+    }
+    gst_sample_unref(sample);
+    return success;
+}
+
+void
+OpenCvReader::drainBus()
+{
+    GstBus* bus = gst_element_get_bus(m_pipeline);
+    GstMessage* msg = nullptr;
+    while ((msg = gst_bus_pop(bus)) != nullptr) {
+        if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR ||
+            GST_MESSAGE_TYPE(msg) == GST_MESSAGE_WARNING) {
+            GError* err = nullptr;
+            gchar* debug = nullptr;
+            if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR) {
+                gst_message_parse_error(msg, &err, &debug);
+            } else {
+                gst_message_parse_warning(msg, &err, &debug);
+            }
+            fprintf(
+                stderr,
+                "Pipeline '%s'\n\t%s: %s\n",
+                m_gstPipeline.c_str(),
+                GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR ?
+                    "ERROR" : "WARNING",
+                err ? err->message : "unknown");
+            g_clear_error(&err);
+            g_free(debug);
+        }
+        gst_message_unref(msg);
+    }
+    gst_object_unref(bus);
+}
+
+void
+OpenCvReader::onNewManager(
+    GstElement*,
+    GstElement* manager,
+    OpenCvReader* reader)
+{
+    g_signal_connect(
+        manager,
+        "new-jitterbuffer",
+        G_CALLBACK(&OpenCvReader::onNewJitterBuffer),
+        static_cast<gpointer>(reader));
+}
+
+void
+OpenCvReader::onNewJitterBuffer(
+    GstElement*,
+    GstElement* jitterBuffer,
+    guint,
+    guint,
+    OpenCvReader* reader)
+{
+    std::lock_guard<std::mutex> lock(reader->m_jitterBuffersMutex);
+    reader->m_jitterBuffers.push_back(
+        GST_ELEMENT(gst_object_ref(jitterBuffer)));
+}
+
+void
+OpenCvReader::sampleJitterBuffers()
+{
+    JitterSample totals;
+    uint latency = m_jitterController->getLatency();
+    bool changed = false;
+    {
+        std::lock_guard<std::mutex> lock(m_jitterBuffersMutex);
+        for (auto jb : m_jitterBuffers) {
+            GstStructure* stats = nullptr;
+            g_object_get(jb, "stats", &stats, NULL);
+            if (not stats) {
+                continue;
+            }
+            guint64 pushed = 0;
+            guint64 lost = 0;
+            guint64 late = 0;
+            guint64 jitterNs = 0;
+            gst_structure_get_uint64(stats, "num-pushed", &pushed);
+            gst_structure_get_uint64(stats, "num-lost", &lost);
+            gst_structure_get_uint64(stats, "num-late", &late);
+            // avg-jitter is reported since gstreamer 1.18, older jitter
+            // buffers are adapted on the late and lost packets only
+            if (not gst_structure_get_uint64(stats, "avg-jitter", &jitterNs) &&
+                not m_noAvgJitter) {
+                m_noAvgJitter = true;
+                fprintf(
+                    stderr,
+                    "Camera '%s'\n\tjitter buffer doesn't report its jitter, "
+                    "adapting on late and lost packets only\n",
+                    m_gstPipeline.c_str());
+                fflush(stderr);
+            }
+            gst_structure_free(stats);
+
+            totals.pushed += pushed;
+            totals.lost += lost;
+            totals.late += late;
+            totals.jitterMs = std::max(totals.jitterMs, double(jitterNs) / 1e6);
+        }
+
+        // the controller works on what happened since the previous sample
+        auto delta = [](uint64_t now, uint64_t prev) {
+            return now >= prev ? now - prev : now;
+        };
+        JitterSample sample;
+        sample.pushed = delta(totals.pushed, m_jitterTotals.pushed);
+        sample.lost = delta(totals.lost, m_jitterTotals.lost);
+        sample.late = delta(totals.late, m_jitterTotals.late);
+        sample.jitterMs = totals.jitterMs;
+        m_jitterTotals = totals;
+
+        if (m_jitterController->update(sample)) {
+            changed = true;
+            for (auto jb : m_jitterBuffers) {
+                g_object_set(
+                    jb, "latency", guint(m_jitterController->getLatency()),
+                    NULL);
+            }
+        }
+    }
+
+    if (changed) {
+        // streams set up later start with the adapted latency as well
+        if (m_rtspsrc) {
+            g_object_set(
+                m_rtspsrc,
+                "latency", guint(m_jitterController->getLatency()),
+                NULL);
+        }
+        printf(
+            "Camera '%s'\n\tjitter buffer latency %u -> %u ms "
+            "(jitter %.1f ms, %zu late, %zu lost)\n",
+            m_gstPipeline.c_str(),
+            latency,
+            m_jitterController->getLatency(),
+            totals.jitterMs,
+            size_t(totals.late),
+            size_t(totals.lost));
+        fflush(stdout);
+    }
+
+    std::lock_guard<std::mutex> lock(m_ingestStatsMutex);
+    m_ingestStats.available = true;
+    m_ingestStats.latencyMs = m_jitterController->getLatency();
+    m_ingestStats.jitterMs = totals.jitterMs;
+    m_ingestStats.pushed = totals.pushed;
+    m_ingestStats.lost = totals.lost;
+    m_ingestStats.late = totals.late;
+}
+
+IngestStats
+OpenCvReader::getIngestStats() const
+{
+    std::lock_guard<std::mutex> lock(m_ingestStatsMutex);
+    return m_ingestStats;
+}
+
+void
+OpenCvReader::setFrameListener(FrameListener listener)
+{
+    std::lock_guard<std::mutex> lock(m_frameListenerMutex);
+    m_frameListener = std::move(listener);
+}
+
+CvMatPtr
+OpenCvReader::getPoolFrame(PoolFrame*& pooled)
+{
+    std::unique_ptr<PoolFrame> p;
+    {
+        std::lock_guard<std::mutex> lock(m_framePool->mutex);
+        if (not m_framePool->free.empty()) {
+            p = std::move(m_framePool->free.back());
+            m_framePool->free.pop_back();
+        }
+    }
+    if (not p) {
+        if (m_framePoolAllocated >= m_framePoolSize) {
+            pooled = nullptr;
+            return std::make_shared<cv::Mat>();
+        }
+        p.reset(new PoolFrame());
+        m_framePoolAllocated++;
+    }
+
+    // the last user of the frame puts it back
+    auto* frame = p.release();
+    auto pool = m_framePool;
+    pooled = frame;
+    return CvMatPtr(&frame->frame, [pool, frame](cv::Mat*) {
+        std::lock_guard<std::mutex> lock(pool->mutex);
+        pool->free.emplace_back(frame);
+    });
+}
+
 CvMatPtr
-OpenCvReader::getFrame()
+OpenCvReader::getFrame(uint64_t* frameId)
 {
     CvMatPtr currFrame;
-    m_buffer.pop(currFrame);
+    if (m_buffer.pop(currFrame)) {
+        // frames leave the queue in the order they entered it
+        if (frameId) {
+            *frameId = m_poppedFrames;
+        }
+        m_poppedFrames++;
+    }
     return currFrame;
 }
 
+bool
+OpenCvReader::sleepWhileRunning(std::chrono::steady_clock::duration duration)
+{
+    auto until = std::chrono::steady_clock::now() + duration;
+    while (m_running && std::chrono::steady_clock::now() < until) {
+        std::this_thread::sleep_for(
+            std::min<std::chrono::steady_clock::duration>(
+                until - std::chrono::steady_clock::now(),
+                std::chrono::milliseconds(100)));
+    }
+    return m_running;
+}
+
+bool
+OpenCvReader::reconnect(std::chrono::steady_clock::time_point outageStart)
+{
+    using Clock = std::chrono::steady_clock;
+
+    {
+        std::lock_guard<std::mutex> lock(m_ingestStatsMutex);
+        m_ingestStats.down = true;
+    }
+
+    std::uniform_real_distribution<double> jitter(0., m_reconnect.jitter);
+    auto delay = std::chrono::milliseconds(m_reconnect.backoffMinMs);
+    auto maxDelay = std::chrono::milliseconds(m_reconnect.backoffMaxMs);
+    size_t source = 0;
+    uint attempts = 0;
+
+    while (m_running) {
+        auto wait = std::chrono::duration_cast<Clock::duration>(
+            delay * (1. - jitter(m_random)));
+        if (not sleepWhileRunning(wait)) {
+            break;
+        }
+
+        m_gstPipeline = m_pipelines[source];
+        attempts++;
+        ProxyMetrics::instance().add("input.reconnect_attempts");
+        if (openCam()) {
+            std::chrono::duration<double> outage = Clock::now() - outageStart;
+            printf(
+                "Camera reconnected after %.1f s and %u attempts%s:\n\t'%s'\n",
+                outage.count(),
+                attempts,
+                source > 0 ? ", on a backup" : "",
+                m_gstPipeline.c_str());
+            fflush(stdout);
+
+            auto& metrics = ProxyMetrics::instance();
+            metrics.add("input.reconnects");
+            metrics.add("input.outage_sec", outage.count());
+            if (source > 0) {
+                metrics.add("input.failovers");
+            }
+
+            std::lock_guard<std::mutex> lock(m_ingestStatsMutex);
+            m_ingestStats.down = false;
+            m_ingestStats.reconnects++;
+            m_ingestStats.outageSec += outage.count();
+            m_ingestStats.source = source;
+            return true;
+        }
+
+        // each attempt tries the next backup, the delay grows once all
+        // of them failed
+        source = (source + 1) % m_pipelines.size();
+        if (source == 0) {
+            delay = std::min(delay * 2, maxDelay);
+        }
+    }
+    return false;
+}
+
 void
 OpenCvReader::cvReaderThread()
 {
-    // connect to the input camera
-    openCam();
+    // place the thread before opening the camera, so decoder threads
+    // started by the capture inherit the placement
+    ThreadPlacement::apply("cam-reader", m_placement);
 
-    if (not isConnected()) {
+    using Clock = std::chrono::steady_clock;
+
+    // connect to the input camera, its backups may still work
+    if (not openCam() && m_reconnect.enabled) {
         fprintf(
             stderr,
-            "ERROR: pipeline %s\n"
-            " Attempted to start VideoCapture thread when not connected\n",
+            "Camera '%s'\n\tfailed to open, reconnecting\n",
             m_gstPipeline.c_str());
+        fflush(stderr);
+        reconnect(Clock::now());
+    }
+
+    if (not isConnected()) {
+        // not an error if the reader was stopped while reconnecting
+        if (m_running) {
+            fprintf(
+                stderr,
+                "ERROR: pipeline %s\n"
+                " Attempted to start VideoCapture thread when not connected\n",
+                m_gstPipeline.c_str());
+        }
         m_running = false;
         return;
     }
 
+    // replayed files are paced on their frame rate in real time mode
+    double fileFps = m_fileIngest.fps;
+    if (m_fileIngest.enabled && m_fileIngest.realtime && fileFps <= 0.) {
+        fileFps = m_videoCapture.get(cv::CAP_PROP_FPS);
+        if (fileFps <= 0.) {
+            fprintf(
+                stderr,
+                "WARNING: '%s' has no frame rate, replaying at 25 fps. "
+                "Set input_file_fps.\n",
+                m_gstPipeline.c_str());
+            fileFps = 25.;
+        }
+    }
+    auto fileStart = Clock::now();
+    uint64_t fileFrames = 0;
+
+    auto jitterInterval = std::chrono::milliseconds(m_jitterBuffer.intervalMs);
+    auto nextJitterSample = Clock::now() + jitterInterval;
+
+    // the watchdog reopens a camera without a new frame for stallTime
+    auto stallTime = std::chrono::milliseconds(m_reconnect.stallMs);
+    auto lastFrameTime = Clock::now();
+    bool readFailing = false;
+
     while (m_running) {
         /*--------------------------------------------*/
         /*-- Read in source video stream -------------*/
         /*--------------------------------------------*/
-        auto f = std::make_shared<cv::Mat>();
+        PoolFrame* pooled = nullptr;
+        auto f = (m_frameNode >= 0) ?
+            getPoolFrame(pooled) : std::make_shared<cv::Mat>();
 
-        bool success = m_videoCapture.read(*f); // read a new video frame
+        auto readStart = Clock::now();
+        bool success = not m_shmRing.empty() ?
+            readShm(*f) :
+            m_appsinkRead ?
+            readPipeline(*f) :
+            m_videoCapture.read(*f); // read a new video frame
+        auto readEnd = Clock::now();
+        std::chrono::duration<double> readTime = readEnd - readStart;
+
+        if (m_jitterController && Clock::now() >= nextJitterSample) {
+            sampleJitterBuffers();
+            nextJitterSample = Clock::now() + jitterInterval;
+        }
+
+        if ((!success || f->empty()) && m_fileIngest.enabled) {
+            // end of the replayed file
+            if (not m_fileIngest.loop) {
+                printf("Replay of '%s' ended\n", m_gstPipeline.c_str());
+                m_finished = true;
+                sem_post(m_videoFrameReadySemaphore);
+                break;
+            }
+            closeCam();
+            if (not openCam()) {
+                m_finished = true;
+                sem_post(m_videoFrameReadySemaphore);
+                break;
+            }
+            fileStart = Clock::now();
+            fileFrames = 0;
+            continue;
+        }
         if (!success || f->empty()) {
-            fprintf(
-                stderr,
-                "Pipeline '%s'\n\tFailed to read a frame\n",
-                m_gstPipeline.c_str());
-            fflush(stderr);
+            // reported once per run of failures
+            if (not readFailing) {
+                fprintf(
+                    stderr,
+                    "Pipeline '%s'\n\tFailed to read a frame\n",
+                    m_gstPipeline.c_str());
+                fflush(stderr);
+                readFailing = true;
+            }
+            std::chrono::duration<double> age = Clock::now() - lastFrameTime;
+            if (m_reconnect.enabled && age >= stallTime) {
+                fprintf(
+                    stderr,
+                    "Camera '%s'\n\tno frame for %.1f s, reconnecting\n",
+                    m_gstPipeline.c_str(),
+                    age.count());
+                fflush(stderr);
+
+                // the tile shows no signal while the camera is down
+                closeCam();
+                sem_post(m_videoFrameReadySemaphore);
+                if (not reconnect(lastFrameTime)) {
+                    break;
+                }
+                lastFrameTime = Clock::now();
+                readFailing = false;
+                continue;
+            }
+            // a pipeline at its end fails at once, don't spin on it
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
             continue;
         }
+        readFailing = false;
+        lastFrameTime = readEnd;
+
         #if DEBUG_OPEN_CV_READER
-            else {
-                printf("cv: got frame from %s\n", m_gstPipeline.c_str());
-                fflush(stdout);
-            }
+            printf("cv: got frame from %s\n", m_gstPipeline.c_str());
+            fflush(stdout);
         #endif
+        ProxyMetrics::instance().add("input.read_sec", readTime.count());
+        ProxyMetrics::instance().add("input.read_frames");
+
+        // move newly allocated frame buffers to the consumer's node
+        if (pooled && pooled->boundData != f->data) {
+            ThreadPlacement::bindToNode(
+                f->data, f->total() * f->elemSize(), m_frameNode);
+            pooled->boundData = f->data;
+        }
 
-        m_buffer.push(f);
+        if (m_fileIngest.enabled && m_fileIngest.realtime) {
+            fileFrames++;
+            std::this_thread::sleep_until(
+                fileStart + std::chrono::duration_cast<Clock::duration>(
+                    std::chrono::duration<double>(
+                        double(fileFrames) / fileFps)));
+        }
+
+        bool queued = false;
+        if (m_fileIngest.enabled && not m_fileIngest.realtime) {
+            // as fast as possible, but never lose a frame of the replay
+            while (m_running && not (queued = m_buffer.push(f))) {
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+            }
+        } else if (not (queued = m_buffer.push(f))) {
+            m_droppedFrames++;
+        }
         sem_post(m_videoFrameReadySemaphore); // notify the consumer
 
+        {
+            std::lock_guard<std::mutex> lock(m_frameListenerMutex);
+            if (m_frameListener) {
+                m_frameListener(f);
+            }
+        }
+
+        uint64_t frameId = m_pushedFrames;
+        if (queued) {
+            m_pushedFrames++;
+        }
+        if (FrameTracer::isEnabled()) {
+            TraceEvent event;
+            event.name = queued ? "decode" : "decode-dropped";
+            event.startNs = FrameTracer::toNs(readStart);
+            event.endNs = FrameTracer::toNs(readEnd);
+            event.frame = frameId;
+            event.flowOut = queued ? FrameTracer::flowId(this, frameId) : 0;
+            FrameTracer::instance().record(event);
+        }
+
         //cv::waitKey(1);
     }
 
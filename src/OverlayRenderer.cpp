@@ -0,0 +1,200 @@
+// System headers
+#include <time.h>
+
+// STL headers
+#include <algorithm>
+
+// Open CV headers
+#include <opencv2/imgproc/imgproc.hpp>  // cv::putText, cv::rectangle
+
+// Project headers
+#include <OverlayRenderer.hpp>
+#include <ProxyMetrics.hpp>
+
+namespace rtsp_proxy_server {
+
+namespace {
+
+/** opacity of the box behind a label */
+const int BOX_ALPHA = 96;
+
+/** distance of the labels from the tile borders, in pixels */
+const int MARGIN = 4;
+
+const int FONT = cv::FONT_HERSHEY_SIMPLEX;
+
+}
+
+OverlayRenderer::OverlayRenderer(OverlayConfig const& config)
+    :
+    m_config(config),
+    m_names(config.cameraNames)
+{
+    m_noSignalLabel = render("NO SIGNAL", cv::Scalar(64, 64, 255));
+}
+
+void
+OverlayRenderer::setCameraNames(std::vector<std::string> const& names)
+{
+    m_names = names;
+
+    // the names are rendered again when they are drawn next
+    m_nameLabels.clear();
+}
+
+OverlayRenderer::LabelPtr
+OverlayRenderer::render(std::string const& text, cv::Scalar const& color) const
+{
+    double scale = m_config.fontScale;
+    int thickness = std::max(1, int(scale * 2. + 0.5));
+    int baseline = 0;
+    auto textSize = cv::getTextSize(text, FONT, scale, thickness, &baseline);
+    int pad = std::max(2, textSize.height / 3);
+
+    cv::Size size(
+        textSize.width + 2 * pad, textSize.height + baseline + 2 * pad);
+    cv::Point origin(pad, pad + textSize.height);
+
+    // coverage of the text, and of a black outline keeping it readable on
+    // bright pictures
+    cv::Mat fill(size, CV_8UC1, cv::Scalar(0));
+    cv::putText(
+        fill, text, origin, FONT, scale, cv::Scalar(255), thickness,
+        cv::LINE_AA);
+    cv::Mat outline(size, CV_8UC1, cv::Scalar(0));
+    cv::putText(
+        outline, text, origin, FONT, scale, cv::Scalar(255), thickness + 2,
+        cv::LINE_AA);
+
+    auto label = std::make_shared<Label>();
+    label->premultiplied.create(size, CV_8UC3);
+    label->inverseAlpha.create(size, CV_8UC3);
+
+    for (int y = 0; y < size.height; y++) {
+        const uchar* f = fill.ptr(y);
+        const uchar* o = outline.ptr(y);
+        uchar* p = label->premultiplied.ptr(y);
+        uchar* ia = label->inverseAlpha.ptr(y);
+
+        for (int x = 0; x < size.width; x++) {
+            // the outline covers the box, the text covers the outline
+            int a = o[x] + (255 - o[x]) * BOX_ALPHA / 255;
+            a = std::max(a, int(f[x]));
+            for (int c = 0; c < 3; c++) {
+                p[3 * x + c] = uchar((int(color[c]) * f[x] + 127) / 255);
+                ia[3 * x + c] = uchar(255 - a);
+            }
+        }
+    }
+
+    ProxyMetrics::instance().add("processor.overlay_renders");
+    return label;
+}
+
+OverlayRenderer::Label const&
+OverlayRenderer::getNameLabel(size_t cam)
+{
+    if (cam >= m_nameLabels.size()) {
+        m_nameLabels.resize(cam + 1);
+    }
+    auto& label = m_nameLabels[cam];
+    if (not label) {
+        bool named = cam < m_names.size() && not m_names[cam].empty();
+        label = render(
+            named ? m_names[cam] : "Camera " + std::to_string(cam + 1),
+            cv::Scalar(255, 255, 255));
+    }
+    return *label;
+}
+
+void
+OverlayRenderer::blend(
+    cv::Mat& frame,
+    Label const& label,
+    cv::Point const& at,
+    cv::Rect const& tile)
+{
+    cv::Rect area =
+        cv::Rect(at.x, at.y, label.premultiplied.cols, label.premultiplied.rows)
+        & tile
+        & cv::Rect(0, 0, frame.cols, frame.rows);
+    if (area.area() == 0) {
+        return;
+    }
+
+    int lx = area.x - at.x;
+    int ly = area.y - at.y;
+    int n = area.width * 3;
+
+    for (int y = 0; y < area.height; y++) {
+        uchar* d = frame.ptr(area.y + y) + area.x * 3;
+        const uchar* p = label.premultiplied.ptr(ly + y) + lx * 3;
+        const uchar* ia = label.inverseAlpha.ptr(ly + y) + lx * 3;
+
+        // d * (255 - a) / 255 + premultiplied color, rounded. The loop has
+        // no branches or channel dependencies, so the compiler vectorizes
+        // it over 16 or 32 bytes at a time.
+        for (int i = 0; i < n; i++) {
+            unsigned v = unsigned(d[i]) * ia[i] + 128;
+            unsigned out = ((v + (v >> 8)) >> 8) + p[i];
+            d[i] = uchar(std::min(out, 255u));
+        }
+    }
+}
+
+void
+OverlayRenderer::draw(cv::Mat& frame, std::vector<TileOverlay> const& tiles)
+{
+    if (m_config.enabled && m_config.clock) {
+        std::time_t now = std::time(nullptr);
+        if (now != m_clockTime || not m_clockLabel) {
+            m_clockTime = now;
+            struct tm local;
+            localtime_r(&now, &local);
+            char text[32];
+            strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", &local);
+            m_clockLabel = render(text, cv::Scalar(255, 255, 255));
+        }
+    }
+
+    for (auto const& tile : tiles) {
+        auto const& r = tile.rect;
+
+        for (auto const& box : tile.motion) {
+            cv::rectangle(frame, box & r, cv::Scalar(0, 255, 0), 2);
+        }
+
+        if (not m_config.enabled) {
+            continue;
+        }
+
+        blend(
+            frame,
+            getNameLabel(tile.cam),
+            cv::Point(r.x + MARGIN, r.y + MARGIN),
+            r);
+
+        if (m_clockLabel) {
+            blend(
+                frame,
+                *m_clockLabel,
+                cv::Point(
+                    r.x + MARGIN,
+                    r.y + r.height - m_clockLabel->premultiplied.rows - MARGIN),
+                r);
+        }
+
+        if (tile.noSignal) {
+            auto const& label = *m_noSignalLabel;
+            blend(
+                frame,
+                label,
+                cv::Point(
+                    r.x + (r.width - label.premultiplied.cols) / 2,
+                    r.y + (r.height - label.premultiplied.rows) / 2),
+                r);
+        }
+    }
+}
+
+} // end of namespace
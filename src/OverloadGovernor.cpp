@@ -0,0 +1,100 @@
+#include <stdio.h>
+
+// Project headers
+#include <OverloadGovernor.hpp>
+#include <ProxyMetrics.hpp>
+
+namespace rtsp_proxy_server {
+
+// weight of a new sample in the moving averages
+static constexpr double COST_SMOOTHING = 0.1;
+
+OverloadGovernor::OverloadGovernor(
+    GovernorConfig const& config,
+    uint outputFps)
+    :
+    m_config(config),
+    m_frameInterval(1. / double(outputFps))
+{
+    if (m_config.levels.empty()) {
+        m_config.levels.push_back(GovernorLevel());
+    }
+    ProxyMetrics::instance().set("output.governor_level", 0);
+}
+
+void
+OverloadGovernor::reportEncodeCost(double seconds)
+{
+    double cost = m_encodeCost;
+    m_encodeCost = cost + COST_SMOOTHING * (seconds - cost);
+}
+
+void
+OverloadGovernor::reportComposeCost(double seconds)
+{
+    m_composeCost += COST_SMOOTHING * (seconds - m_composeCost);
+
+    auto const& level = getLevel();
+
+    // the compositor runs only every fpsDivisor frame interval, while the
+    // encoder still encodes every output frame
+    double cost = m_composeCost / double(level.fpsDivisor) + m_encodeCost;
+    double load = cost / m_frameInterval;
+
+    auto& metrics = ProxyMetrics::instance();
+    metrics.set("output.compose_ms", m_composeCost * 1000.);
+    metrics.set("output.encode_ms", m_encodeCost * 1000.);
+    metrics.set("output.load", load);
+
+    if (not m_config.enabled) {
+        return;
+    }
+
+    if (load >= m_config.overloadRatio) {
+        m_headroomCount = 0;
+        m_overloadedCount++;
+    } else if (load <= m_config.headroomRatio) {
+        m_overloadedCount = 0;
+        m_headroomCount++;
+    } else {
+        m_overloadedCount = 0;
+        m_headroomCount = 0;
+    }
+
+    size_t current = m_level;
+    size_t next = current;
+
+    if (m_overloadedCount >= m_config.downFrames &&
+        current + 1 < m_config.levels.size()) {
+        next = current + 1;
+    } else if (m_headroomCount >= m_config.upFrames && current > 0) {
+        next = current - 1;
+    }
+
+    if (next == current) {
+        return;
+    }
+
+    m_overloadedCount = 0;
+    m_headroomCount = 0;
+    m_level = next;
+
+    auto const& l = m_config.levels[next];
+    printf(
+        "Overload governor: level %zu -> %zu (load=%.2f, compose=%.1f ms, "
+        "encode=%.1f ms): fps/%u, scale %.2f, tiles 1/%u\n",
+        current,
+        next,
+        load,
+        m_composeCost * 1000.,
+        m_encodeCost * 1000.,
+        l.fpsDivisor,
+        l.composeScale,
+        l.tileSkip);
+    fflush(stdout);
+
+    metrics.set("output.governor_level", double(next));
+    metrics.add("output.governor_transitions");
+}
+
+} // end of namespace
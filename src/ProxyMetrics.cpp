@@ -0,0 +1,51 @@
+#include <stdio.h>
+
+// Project headers
+#include <ProxyMetrics.hpp>
+
+namespace rtsp_proxy_server {
+
+ProxyMetrics&
+ProxyMetrics::instance()
+{
+    static ProxyMetrics metrics;
+    return metrics;
+}
+
+void
+ProxyMetrics::set(std::string const& name, double value)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_values[name] = value;
+}
+
+void
+ProxyMetrics::add(std::string const& name, double delta)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_values[name] += delta;
+}
+
+double
+ProxyMetrics::get(std::string const& name) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_values.find(name);
+    return (it == m_values.end()) ? 0. : it->second;
+}
+
+std::string
+ProxyMetrics::format() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::string out;
+    char line[256];
+    for (auto const& v : m_values) {
+        snprintf(line, sizeof(line), "%s %.3f\n", v.first.c_str(), v.second);
+        out += line;
+    }
+    return out;
+}
+
+} // end of namespace
@@ -0,0 +1,74 @@
+// STL headers
+#include <chrono>
+
+// Project headers
+#include <Reaper.hpp>
+#include <ProxyMetrics.hpp>
+#include <ThreadPlacement.hpp>
+
+namespace rtsp_proxy_server {
+
+Reaper::Reaper(std::string const& metric)
+    :
+    m_metric(metric)
+{
+    m_thread = std::thread(&Reaper::reaperThread, this);
+}
+
+Reaper::~Reaper()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_pendingCond.notify_one();
+    m_thread.join();
+}
+
+void
+Reaper::retire(std::function<void()> destroy)
+{
+    size_t pending = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending.push_back(std::move(destroy));
+        pending = m_pending.size();
+    }
+    m_pendingCond.notify_one();
+    ProxyMetrics::instance().set(m_metric + "_pending", double(pending));
+}
+
+void
+Reaper::reaperThread()
+{
+    ThreadPlacement::apply("reaper", ThreadRoleConfig());
+
+    using Seconds = std::chrono::duration<double>;
+    auto& metrics = ProxyMetrics::instance();
+
+    while (true) {
+        std::function<void()> destroy;
+        size_t pending = 0;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_pendingCond.wait(
+                lock, [this] { return m_stopping || not m_pending.empty(); });
+            if (m_pending.empty()) {
+                return;
+            }
+            destroy = std::move(m_pending.front());
+            m_pending.pop_front();
+            pending = m_pending.size();
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        destroy();
+        Seconds elapsed = std::chrono::steady_clock::now() - start;
+
+        metrics.add(m_metric + "s");
+        metrics.add(m_metric + "_sec", elapsed.count());
+        metrics.set(m_metric + "_pending", double(pending));
+    }
+}
+
+} // end of namespace
@@ -0,0 +1,125 @@
+// gstreamer headers
+#include <gst/app/app.h>
+
+// Project headers
+#include <ReplayMedia.hpp>
+
+namespace rtsp_proxy_server {
+
+ReplayMedia::ReplayMedia(GstRTSPMedia* rtspMedia, SegmentRing& ring)
+    :
+    m_ring(ring)
+{
+    printf("Creating replay Media object for new RTSP client...\n");
+
+    GstElement* element = gst_rtsp_media_get_element(rtspMedia);
+    m_appsrc = gst_bin_get_by_name_recurse_up(GST_BIN(element), "source");
+    gst_object_unref(element);
+
+    if (not m_appsrc) {
+        throw std::runtime_error(
+            "ERROR: replay pipeline has no 'source' element");
+    }
+
+    uint64_t last = 0;
+    auto caps = m_ring.getCaps();
+    m_valid =
+        not caps.empty() &&
+        m_ring.getRange(m_origin, last) &&
+        m_ring.seek(m_origin, m_position);
+
+    if (m_valid) {
+        GstCaps* gstCaps = gst_caps_from_string(caps.c_str());
+        gst_app_src_set_caps(GST_APP_SRC(m_appsrc), gstCaps);
+        gst_caps_unref(gstCaps);
+
+        // make the media seekable, so clients can use the Range header
+        gst_app_src_set_stream_type(
+            GST_APP_SRC(m_appsrc), GST_APP_STREAM_TYPE_SEEKABLE);
+        gst_app_src_set_duration(
+            GST_APP_SRC(m_appsrc), GstClockTime(last - m_origin));
+
+        printf(
+            "Replay: %.1f s available\n",
+            double(last - m_origin) / double(GST_SECOND));
+    } else {
+        fprintf(stderr, "WARNING: replay requested, but nothing recorded\n");
+    }
+
+    g_signal_connect(
+        m_appsrc,
+        "need-data",
+        G_CALLBACK(&ReplayMedia::onNeedData),
+        static_cast<gpointer>(this));
+    g_signal_connect(
+        m_appsrc,
+        "seek-data",
+        G_CALLBACK(&ReplayMedia::onSeekData),
+        static_cast<gpointer>(this));
+}
+
+ReplayMedia::~ReplayMedia()
+{
+    gst_object_unref(m_appsrc);
+}
+
+gboolean
+ReplayMedia::onSeekData(
+    GstElement*,
+    guint64 offset,
+    ReplayMedia* media)
+{
+    if (not media->m_valid) {
+        return FALSE;
+    }
+    return media->m_ring.seek(media->m_origin + offset, media->m_position);
+}
+
+void
+ReplayMedia::onNeedData(
+    GstElement* gstSrc,
+    guint,
+    ReplayMedia* media)
+{
+    if (not media->m_valid) {
+        gst_app_src_end_of_stream(GST_APP_SRC(gstSrc));
+        return;
+    }
+
+    for (;;) {
+        GstBuffer* buf = nullptr;
+        uint64_t timestamp = 0;
+
+        auto res = media->m_ring.read(media->m_position, buf, timestamp);
+
+        if (res == SegmentRing::ReadResult::OK) {
+            GstClockTime pts = (timestamp > media->m_origin) ?
+                GstClockTime(timestamp - media->m_origin) : 0;
+            GST_BUFFER_PTS(buf) = pts;
+            GST_BUFFER_DTS(buf) = pts;
+
+            gst_app_src_push_buffer(GST_APP_SRC(gstSrc), buf);
+            return;
+        }
+
+        if (res == SegmentRing::ReadResult::LOST) {
+            // the writer overtook us, continue from the oldest keyframe
+            fprintf(stderr, "WARNING: replay fell behind the ring\n");
+            if (not media->m_ring.seek(0, media->m_position)) {
+                gst_app_src_end_of_stream(GST_APP_SRC(gstSrc));
+                return;
+            }
+            continue;
+        }
+
+        // at the live edge - wait for new data unless the pipeline is
+        // shutting down
+        if (GST_STATE_TARGET(gstSrc) < GST_STATE_PAUSED) {
+            return;
+        }
+        media->m_ring.waitForData(
+            media->m_position, std::chrono::milliseconds(100));
+    }
+}
+
+} // end of namespace
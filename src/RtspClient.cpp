@@ -11,18 +11,19 @@ RtspClient::RtspClient(GstRTSPClient* gstClient,
     m_gstClient = gstClient;
     m_server = rtspProxyServer;
 
-    m_mediaConstructedHandlerId = g_signal_connect(
-        rtspProxyServer->getFactory(),
-        "media-constructed",
-        G_CALLBACK(&RtspClient::onConstructRtspMedia),
-        static_cast<gpointer>(this));
-
     // Let the server know when client disconnects
     m_cliendClosedHandlerId = g_signal_connect(
         gstClient,
         "closed",
         onClientDisconnectCallback,
         rtspProxyServer);
+
+    // new clients of a shared media ask for a keyframe
+    m_playRequestHandlerId = g_signal_connect(
+        gstClient,
+        "play-request",
+        G_CALLBACK(&RtspClient::onPlayRequest),
+        this);
 }
 
 RtspClient::~RtspClient()
@@ -30,28 +31,33 @@ RtspClient::~RtspClient()
     //
     // disconnect all callbacks when connection closes
     //
-    if (m_mediaConstructedHandlerId > 0) {
-        g_signal_handler_disconnect(
-            m_server->getFactory(), m_mediaConstructedHandlerId);
-    }
-
     if (m_cliendClosedHandlerId > 0) {
         g_signal_handler_disconnect(m_gstClient, m_cliendClosedHandlerId);
     }
-
-    if (m_rtspMedia) {
-        delete m_rtspMedia;
+    if (m_playRequestHandlerId > 0) {
+        g_signal_handler_disconnect(m_gstClient, m_playRequestHandlerId);
     }
 }
 
 void
-RtspClient::onConstructRtspMedia(
-    GstRTSPMediaFactory*,
-    GstRTSPMedia* gstRtspMedia,
+RtspClient::onPlayRequest(
+    GstRTSPClient*,
+    GstRTSPContext* ctx,
     RtspClient* client)
 {
-    client->m_rtspMedia =
-        new RtspMedia(gstRtspMedia, client->m_server->getConfig());
+    // the signal is emitted once the session is playing, so the keyframe
+    // reaches this client. Replay media and the media of the GStreamer
+    // engine have no RtspMedia attached.
+    if (not ctx->media) {
+        return;
+    }
+    auto* ptr = static_cast<RtspMediaPtr*>(
+        g_object_get_data(G_OBJECT(ctx->media), "rtsp-proxy-media"));
+    if (ptr) {
+        RtspMediaPtr media = *ptr;
+        media->requestKeyframe();
+    }
+    client->m_server->retainMedia(ctx->media);
 }
 
 }
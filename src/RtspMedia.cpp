@@ -1,12 +1,27 @@
+// gstreamer headers
+#include <gst/video/video.h>
+
 #include <RtspMedia.hpp>
+#include <RtspServer.hpp>
+#include <FrameTracer.hpp>
+#include <ProxyMetrics.hpp>
+#include <ThreadPlacement.hpp>
+#include <ViewMediaFactory.hpp>
+
+#define DEBUG_RTSP_MEDIA 0
 
 namespace rtsp_proxy_server {
 
 RtspMedia::RtspMedia(
     GstRTSPMedia* rtspMedia,
-    std::shared_ptr<RtspProxyConfig> config) :
-    m_rtspProxyProcessor(config) // start proxy server processor
+    RtspServer* server) :
+    m_gstMedia(rtspMedia),
+    m_segmentRing(server->getSegmentRing()),
+    // start proxy server processor, or join the running one
+    m_rtspProxyProcessor(server->acquireProcessor())
 {
+    auto config = server->getConfig();
+
     m_frameDuration =
         GstClockTime(double(1. / double(config->getOutputFps())) * GST_SECOND);
 
@@ -27,9 +42,475 @@ RtspMedia::RtspMedia(
         throw std::runtime_error(
             "ERROR: failed to connect 'need-data' to 'source'");
     }
+    gst_object_unref(vsrc);
+
+    auto viewport = ViewMediaFactory::getViewport(rtspMedia);
+    if (viewport) {
+        auto const& view = config->getView();
+        m_view = m_rtspProxyProcessor->addView(
+            *viewport, cv::Size(int(view.width), int(view.height)));
+        printf("Streaming view '%s'\n", viewport->getKey().c_str());
+
+        // encoder cost, adaptive bitrate and replay follow the mosaic only
+        m_segmentRing = nullptr;
+    }
+
+    m_encoder = gst_bin_get_by_name(
+        GST_BIN(appsrc), config->getOutputEncoderName().c_str());
+
+    if (not m_encoder) {
+        fprintf(
+            stderr,
+            "WARNING: encoder '%s' not found in the output pipeline. "
+            "Encoder cost measurement, adaptive bitrate and forced "
+            "keyframes are disabled.\n",
+            config->getOutputEncoderName().c_str());
+    } else {
+        // measure how long the encoder spends on each frame, and when it
+        // produces keyframes
+        m_encoderSinkPad = gst_element_get_static_pad(m_encoder, "sink");
+        m_encoderSrcPad = gst_element_get_static_pad(m_encoder, "src");
+        if (m_encoderSinkPad && not m_view) {
+            m_encoderSinkProbeId = gst_pad_add_probe(
+                m_encoderSinkPad,
+                GST_PAD_PROBE_TYPE_BUFFER,
+                reinterpret_cast<GstPadProbeCallback>(
+                    &RtspMedia::onEncoderSinkBuffer),
+                this,
+                nullptr);
+        }
+        if (m_encoderSrcPad) {
+            m_encoderSrcProbeId = gst_pad_add_probe(
+                m_encoderSrcPad,
+                GstPadProbeType(
+                    GST_PAD_PROBE_TYPE_BUFFER |
+                    GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM),
+                reinterpret_cast<GstPadProbeCallback>(
+                    &RtspMedia::onEncoderSrcBuffer),
+                this,
+                nullptr);
+        }
+    }
+
+    m_lowLatency = config->getOutputLowLatency();
+    if (m_lowLatency && m_encoder) {
+        // slices of a frame are encoded in parallel, instead of frames
+        if (g_object_class_find_property(
+                G_OBJECT_GET_CLASS(m_encoder), "sliced-threads")) {
+            g_object_set(m_encoder, "sliced-threads", TRUE, NULL);
+        }
+    }
+
+    m_keyframeConfig = config->getKeyframe();
+    if (m_keyframeConfig.intraRefresh && m_encoder) {
+        // the media is not prepared yet, the encoder starts with it
+        if (g_object_class_find_property(
+                G_OBJECT_GET_CLASS(m_encoder), "intra-refresh")) {
+            g_object_set(m_encoder, "intra-refresh", TRUE, NULL);
+            m_keyframeConfig.onPlay = false;
+        } else {
+            fprintf(
+                stderr,
+                "WARNING: encoder '%s' has no intra refresh, keyframes are "
+                "used instead.\n",
+                config->getOutputEncoderName().c_str());
+        }
+    }
+
+    auto const& abr = config->getAdaptiveBitrate();
+    if (abr.enabled && m_encoder && not m_view) {
+        guint bitrate = 0;
+        g_object_get(m_encoder, "bitrate", &bitrate, NULL);
+
+        m_bitrateController.reset(new AdaptiveBitrateController(abr, bitrate));
+
+        if (m_bitrateController->getBitrate() != bitrate) {
+            g_object_set(
+                m_encoder,
+                "bitrate", guint(m_bitrateController->getBitrate()),
+                NULL);
+        }
+        ProxyMetrics::instance().set(
+            "output.bitrate_kbps", m_bitrateController->getBitrate());
+
+        m_bitrateTimerGuard = std::make_shared<TimerGuard>();
+        m_bitrateTimerGuard->media = this;
+        g_timeout_add_full(
+            G_PRIORITY_DEFAULT,
+            abr.intervalMs,
+            reinterpret_cast<GSourceFunc>(&RtspMedia::onAdaptiveBitrateTimer),
+            new TimerGuardPtr(m_bitrateTimerGuard),
+            [](gpointer data) { delete static_cast<TimerGuardPtr*>(data); });
+    }
+    auto const& placement = config->getPlacement().output;
+    if (placement.isSet()) {
+        // streaming threads announce themselves on the pipeline's bus, the
+        // media element is a bin inside that pipeline
+        GstObject* pipeline = GST_OBJECT(gst_object_ref(appsrc));
+        GstObject* parent = nullptr;
+        while ((parent = gst_object_get_parent(pipeline)) != nullptr) {
+            gst_object_unref(pipeline);
+            pipeline = parent;
+        }
+
+        GstBus* bus = gst_element_get_bus(GST_ELEMENT(pipeline));
+        gst_bus_set_sync_handler(
+            bus,
+            reinterpret_cast<GstBusSyncHandler>(&RtspMedia::onBusSync),
+            new ThreadRoleConfig(placement),
+            [](gpointer data) {
+                delete static_cast<ThreadRoleConfig*>(data);
+            });
+        gst_object_unref(bus);
+        gst_object_unref(pipeline);
+    }
+    gst_object_unref(appsrc);
 }
 
 RtspMedia::~RtspMedia() {
+    // in case the gstreamer media never detached it
+    detach();
+
+    if (m_encoderSinkPad) {
+        if (m_encoderSinkProbeId > 0) {
+            gst_pad_remove_probe(m_encoderSinkPad, m_encoderSinkProbeId);
+        }
+        gst_object_unref(m_encoderSinkPad);
+    }
+    if (m_encoderSrcPad) {
+        if (m_encoderSrcProbeId > 0) {
+            gst_pad_remove_probe(m_encoderSrcPad, m_encoderSrcProbeId);
+        }
+        gst_object_unref(m_encoderSrcPad);
+    }
+    if (m_encoder) {
+        gst_object_unref(m_encoder);
+    }
+    if (m_view) {
+        m_rtspProxyProcessor->removeView(m_view);
+    }
+}
+
+void
+RtspMedia::detach()
+{
+    // waits for a running timer, which removes itself on its next run
+    if (m_bitrateTimerGuard) {
+        std::lock_guard<std::mutex> lock(m_bitrateTimerGuard->mutex);
+        m_bitrateTimerGuard->media = nullptr;
+    }
+}
+
+GstPadProbeReturn
+RtspMedia::onEncoderSinkBuffer(
+    GstPad*,
+    GstPadProbeInfo* info,
+    RtspMedia* media)
+{
+    auto* buf = GST_PAD_PROBE_INFO_BUFFER(info);
+
+    EncodeStart start;
+    start.pts = GST_BUFFER_PTS(buf);
+    start.time = std::chrono::steady_clock::now();
+    // the frame number set by onNeedData, kept by the converter
+    start.frame = GST_BUFFER_OFFSET(buf);
+
+    std::lock_guard<std::mutex> lock(media->m_encodeStartsMutex);
+    media->m_encodeStarts.push_back(start);
+
+    // the encoder should never hold many frames, don't grow unbounded if it
+    // drops some
+    while (media->m_encodeStarts.size() > 64) {
+        media->m_encodeStarts.pop_front();
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+GstPadProbeReturn
+RtspMedia::onEncoderSrcBuffer(
+    GstPad*,
+    GstPadProbeInfo* info,
+    RtspMedia* media)
+{
+    if (GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM) {
+        auto* event = GST_PAD_PROBE_INFO_EVENT(info);
+        if (media->m_segmentRing && GST_EVENT_TYPE(event) == GST_EVENT_CAPS) {
+            GstCaps* caps = nullptr;
+            gst_event_parse_caps(event, &caps);
+
+            gchar* str = gst_caps_to_string(caps);
+            media->m_segmentRing->setCaps(str);
+            g_free(str);
+        }
+        return GST_PAD_PROBE_OK;
+    }
+
+    auto* buf = GST_PAD_PROBE_INFO_BUFFER(info);
+    auto pts = GST_BUFFER_PTS(buf);
+    auto now = std::chrono::steady_clock::now();
+
+    if (media->m_segmentRing) {
+        media->m_segmentRing->push(buf);
+    }
+
+    if (not GST_BUFFER_FLAG_IS_SET(buf, GST_BUFFER_FLAG_DELTA_UNIT)) {
+        media->onKeyframe();
+    }
+
+    std::lock_guard<std::mutex> lock(media->m_encodeStartsMutex);
+    auto& starts = media->m_encodeStarts;
+    while (not starts.empty()) {
+        auto start = starts.front();
+        starts.pop_front();
+        if (start.pts == pts) {
+            std::chrono::duration<double> elapsed = now - start.time;
+            media->m_rtspProxyProcessor->getGovernor().reportEncodeCost(
+                elapsed.count());
+
+            auto composed =
+                media->m_composeTimes[start.frame % COMPOSE_TIMES].load();
+            if (composed > 0) {
+                auto latencyMs = double(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        now.time_since_epoch()).count() - composed) / 1e6;
+                media->m_frameLatencyMs = (media->m_frameLatencyMs > 0.) ?
+                    0.9 * media->m_frameLatencyMs + 0.1 * latencyMs :
+                    latencyMs;
+                ProxyMetrics::instance().set(
+                    "output.frame_latency_ms", media->m_frameLatencyMs);
+            }
+
+            if (FrameTracer::isEnabled()) {
+                TraceEvent event;
+                event.name = "encode";
+                event.startNs = FrameTracer::toNs(start.time);
+                event.endNs = FrameTracer::toNs(now);
+                event.frame = start.frame;
+                event.flowIn = FrameTracer::flowId(media, start.frame);
+                FrameTracer::instance().record(event);
+            }
+            break;
+        }
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+void
+RtspMedia::requestKeyframe()
+{
+    auto& metrics = ProxyMetrics::instance();
+    metrics.add("output.keyframe_requests");
+
+    std::lock_guard<std::mutex> lock(m_keyframeMutex);
+    if (not m_playPending) {
+        // measure from the first client still waiting, the others joined
+        // later and wait less
+        m_playPending = true;
+        m_playTime = std::chrono::steady_clock::now();
+    }
+
+    if (not m_keyframeConfig.onPlay || not m_encoderSrcPad) {
+        return;
+    }
+    if (m_keyframeWanted || m_keyframeInFlight) {
+        // the keyframe asked for by another client serves this one too
+        metrics.add("output.keyframe_requests_coalesced");
+        return;
+    }
+    m_keyframeWanted = true;
+}
+
+void
+RtspMedia::forceKeyframe()
+{
+    auto now = std::chrono::steady_clock::now();
+    {
+        std::lock_guard<std::mutex> lock(m_keyframeMutex);
+        auto minInterval =
+            std::chrono::milliseconds(m_keyframeConfig.minIntervalMs);
+        if (m_keyframeForcedTime.time_since_epoch().count() != 0 &&
+            now - m_keyframeForcedTime < minInterval) {
+            return;
+        }
+        m_keyframeWanted = false;
+        m_keyframeInFlight = true;
+        m_keyframeForcedTime = now;
+    }
+
+    // all-headers makes the encoder and the payloader send SPS/PPS right
+    // before the keyframe, so the client doesn't wait for config-interval
+    auto* event = gst_video_event_new_upstream_force_key_unit(
+        GST_CLOCK_TIME_NONE, TRUE, 0);
+    if (not gst_pad_send_event(m_encoderSrcPad, event)) {
+        fprintf(stderr, "WARNING: the encoder refused to force a keyframe\n");
+        std::lock_guard<std::mutex> lock(m_keyframeMutex);
+        m_keyframeInFlight = false;
+        return;
+    }
+    ProxyMetrics::instance().add("output.keyframes_forced");
+}
+
+void
+RtspMedia::onKeyframe()
+{
+    double waitedMs = -1.;
+    {
+        std::lock_guard<std::mutex> lock(m_keyframeMutex);
+        m_keyframeInFlight = false;
+        // a regular keyframe serves the clients still waiting as well
+        m_keyframeWanted = false;
+        if (m_playPending) {
+            m_playPending = false;
+            std::chrono::duration<double, std::milli> elapsed =
+                std::chrono::steady_clock::now() - m_playTime;
+            waitedMs = elapsed.count();
+        }
+    }
+
+    if (waitedMs >= 0.) {
+        ProxyMetrics::instance().set("output.time_to_keyframe_ms", waitedMs);
+        #if DEBUG_RTSP_MEDIA
+            printf("keyframe %.1f ms after PLAY\n", waitedMs);
+            fflush(stdout);
+        #endif
+    }
+}
+
+GstBusSyncReply
+RtspMedia::onBusSync(
+    GstBus*,
+    GstMessage* message,
+    ThreadRoleConfig* placement)
+{
+    if (GST_MESSAGE_TYPE(message) == GST_MESSAGE_STREAM_STATUS) {
+        GstStreamStatusType type;
+        GstElement* owner = nullptr;
+        gst_message_parse_stream_status(message, &type, &owner);
+
+        // ENTER is posted from the new streaming thread itself
+        if (type == GST_STREAM_STATUS_TYPE_ENTER) {
+            ThreadPlacement::apply("output-stream", *placement);
+        }
+    }
+    return GST_BUS_PASS;
+}
+
+gboolean
+RtspMedia::onAdaptiveBitrateTimer(TimerGuardPtr* guard)
+{
+    std::lock_guard<std::mutex> lock((*guard)->mutex);
+    if (not (*guard)->media) {
+        return G_SOURCE_REMOVE;
+    }
+    (*guard)->media->adaptBitrate();
+    return G_SOURCE_CONTINUE;
+}
+
+void
+RtspMedia::adaptBitrate()
+{
+    BitrateSample sample;
+    sampleReceiverReports(sample);
+    sample.queueFill = m_queueFill;
+
+    auto& metrics = ProxyMetrics::instance();
+    metrics.set("output.rtcp_loss", sample.loss);
+    metrics.set("output.rtcp_jitter_ms", sample.jitterMs);
+    metrics.set("output.queue_fill", sample.queueFill);
+
+    auto& controller = *m_bitrateController;
+    auto previous = controller.getBitrate();
+
+    if (controller.update(sample)) {
+        g_object_set(
+            m_encoder, "bitrate", guint(controller.getBitrate()), NULL);
+
+        printf(
+            "Adaptive bitrate: %u -> %u kbit/s "
+            "(loss=%.3f, jitter=%.1f ms, queue=%.2f)\n",
+            previous,
+            controller.getBitrate(),
+            sample.loss,
+            sample.jitterMs,
+            sample.queueFill);
+        fflush(stdout);
+
+        metrics.set("output.bitrate_kbps", controller.getBitrate());
+        metrics.add("output.bitrate_adjustments");
+    }
+}
+
+void
+RtspMedia::sampleReceiverReports(BitrateSample& sample)
+{
+    if (gst_rtsp_media_n_streams(m_gstMedia) == 0) {
+        return;
+    }
+
+    GstRTSPStream* stream = gst_rtsp_media_get_stream(m_gstMedia, 0);
+    GObject* session = gst_rtsp_stream_get_rtpsession(stream);
+    if (not session) {
+        return;
+    }
+
+    G_GNUC_BEGIN_IGNORE_DEPRECATIONS
+    GValueArray* sources = nullptr;
+    g_object_get(session, "sources", &sources, NULL);
+
+    for (guint i = 0; sources && i < sources->n_values; i++) {
+        GObject* source =
+            G_OBJECT(g_value_get_object(g_value_array_get_nth(sources, i)));
+
+        GstStructure* stats = nullptr;
+        g_object_get(source, "stats", &stats, NULL);
+        if (not stats) {
+            continue;
+        }
+
+        // only sources that carry a receiver report block about our stream
+        gboolean haveRb = FALSE;
+        gst_structure_get_boolean(stats, "have-rb", &haveRb);
+        if (haveRb) {
+            guint fractionLost = 0;
+            guint jitter = 0;
+            gint clockRate = 0;
+            gst_structure_get_uint(stats, "rb-fractionlost", &fractionLost);
+            gst_structure_get_uint(stats, "rb-jitter", &jitter);
+            if (not gst_structure_get_int(stats, "clock-rate", &clockRate) ||
+                clockRate <= 0) {
+                clockRate = 90000;
+            }
+
+            // fraction lost is an 8 bit fixed point number,
+            // jitter is in RTP timestamp units
+            double loss = double(fractionLost) / 256.;
+            double jitterMs = double(jitter) * 1000. / double(clockRate);
+
+            sample.loss = (loss > sample.loss) ? loss : sample.loss;
+            sample.jitterMs =
+                (jitterMs > sample.jitterMs) ? jitterMs : sample.jitterMs;
+        }
+        gst_structure_free(stats);
+    }
+
+    if (sources) {
+        g_value_array_free(sources);
+    }
+    G_GNUC_END_IGNORE_DEPRECATIONS
+
+    g_object_unref(session);
+}
+
+CvMatPtr
+RtspMedia::popFrame(uint64_t* frameId)
+{
+    CvMatPtr ptr;
+    if (m_view) {
+        m_view->buffer.pop(ptr);
+    } else {
+        ptr = m_rtspProxyProcessor->getFrame(frameId);
+    }
+    return ptr;
 }
 
 GstFlowReturn
@@ -38,15 +519,38 @@ RtspMedia::onNeedData(
     guint,
     RtspMedia* media)
 {
+    bool tracing = FrameTracer::isEnabled();
+    auto pullStart = tracing ? FrameTracer::now() : 0;
+
     // get a new frame from the processor, if available
-    auto frame = media->m_rtspProxyProcessor.getFrame();
-    if (not frame) {
+    uint64_t frameId = 0;
+    auto frame = media->popFrame(&frameId);
+    if (frame && media->m_lowLatency) {
+        // frames composed while the encoder was busy are already late,
+        // skip to the newest one
+        uint64_t newerId = 0;
+        while (CvMatPtr newer = media->popFrame(&newerId)) {
+            frame = newer;
+            frameId = newerId;
+            ProxyMetrics::instance().add("output.skipped_frames");
+        }
+    }
+    bool repeated = not frame;
+    if (repeated) {
         // frame is not available - use the previous one
         frame = media->m_lastFrame;
+        ProxyMetrics::instance().add("output.repeated_frames");
     } else {
         media->m_lastFrame = frame;
     }
 
+    auto depth = media->m_view ?
+        media->m_view->buffer.read_available() :
+        media->m_rtspProxyProcessor->getQueueDepth();
+    media->m_queueFill =
+        double(depth) /
+        double(media->m_rtspProxyProcessor->getQueueCapacity());
+
     if (frame->empty()) {
         fprintf(
             stderr,
@@ -63,6 +567,11 @@ RtspMedia::onNeedData(
 
     gst_buffer_fill(buf, 0, frame->data, dataSize);
 
+    // remember when the frame was composed, to measure the output latency
+    media->m_composeTimes[media->m_frameNumber % COMPOSE_TIMES] =
+        (repeated || media->m_view) ?
+            0 : media->m_rtspProxyProcessor->getComposeTime(frameId);
+
     GST_BUFFER_OFFSET(buf) = media->m_frameNumber;
     GST_BUFFER_OFFSET_END(buf) = media->m_frameNumber;
 
@@ -71,10 +580,28 @@ RtspMedia::onNeedData(
     GST_BUFFER_DURATION(buf) =
         static_cast<GstClockTime>(media->m_frameDuration);
 
+    // a client waits for a keyframe, make this frame one
+    if (media->m_keyframeWanted) {
+        media->forceKeyframe();
+    }
+
     GstFlowReturn ret = GST_FLOW_ERROR;
     g_signal_emit_by_name(gstSrc, "push-buffer", buf, &ret);
     gst_buffer_unref(buf);
 
+    if (tracing) {
+        // view frames are not numbered by the processor
+        TraceEvent event;
+        event.name = repeated ? "pull-repeated" : "pull";
+        event.startNs = pullStart;
+        event.endNs = FrameTracer::now();
+        event.frame = media->m_frameNumber;
+        event.flowIn = (repeated || media->m_view) ? 0 :
+            FrameTracer::flowId(media->m_rtspProxyProcessor.get(), frameId);
+        event.flowOut = FrameTracer::flowId(media, media->m_frameNumber);
+        FrameTracer::instance().record(event);
+    }
+
     if (ret != GST_FLOW_OK) {
         fprintf(stderr, "\nERROR: g_signal_emit_by_name failed: %d\n", ret);
     }
@@ -34,6 +34,12 @@ RtspProxyConfig::RtspProxyConfig(std::string const& configFile)
         config["input_rtsp_locations_t"].as<std::vector<std::string>>(
             std::vector<std::string>());
 
+    // backup locations of each camera, e.g. a substream or a second recorder
+    auto backupLocations =
+        config["input_rtsp_backup_locations_t"].as<
+            std::vector<std::vector<std::string>>>(
+                std::vector<std::vector<std::string>>());
+
     auto inputRtspPipelineIdxT =
         config["input_gst_rtsp_pipeline_idx_t"].as<std::string>("");
 
@@ -67,6 +73,18 @@ RtspProxyConfig::RtspProxyConfig(std::string const& configFile)
     for (auto& loc : inputLocations) {
         SUB_TEMPLATES(loc);
     }
+    for (auto& locs : backupLocations) {
+        for (auto& loc : locs) {
+            SUB_TEMPLATES(loc);
+        }
+    }
+
+    if (backupLocations.size() > m_inputPipelines.size()) {
+        throw std::runtime_error(
+            "Invalid config. input_rtsp_backup_locations_t has more entries "
+            "than input_gst_rtsp_pipelines");
+    }
+    m_inputBackupPipelines.resize(m_inputPipelines.size());
 
     // now build actual pipeline for each camera we suppose to connect to
     for (size_t i=0; i < m_inputPipelines.size(); i++) {
@@ -83,9 +101,150 @@ RtspProxyConfig::RtspProxyConfig(std::string const& configFile)
                     " input_gst_rtsp_pipelines. Required by {PIPELINE_IDX} in"
                     " element " + std::to_string(i));
             }
+            // backups are the same pipeline on another location
+            if (i < backupLocations.size()) {
+                for (auto const& loc : backupLocations[i]) {
+                    std::string backup = inputRtspPipelineIdxT;
+                    boost::replace_all(backup, "{LOCATION}", loc);
+                    std::string backupPipe = pipe;
+                    boost::replace_all(backupPipe, "{PIPELINE_IDX}", backup);
+                    m_inputBackupPipelines[i].push_back(backupPipe);
+                }
+            }
+
             std::string tmp = inputRtspPipelineIdxT;
             boost::replace_all(tmp, "{LOCATION}", inputLocations[i]);
             boost::replace_all(pipe, "{PIPELINE_IDX}", tmp);
+        } else if (i < backupLocations.size() &&
+            not backupLocations[i].empty()) {
+            throw std::runtime_error(
+                "Invalid config. input_rtsp_backup_locations_t requires "
+                "{PIPELINE_IDX} in element " + std::to_string(i) +
+                " of input_gst_rtsp_pipelines");
+        }
+    }
+
+    //
+    // Recorded files replace the cameras
+    //
+    auto& files = m_fileIngest;
+    auto fileLocations =
+        config["input_file_locations"].as<std::vector<std::string>>(
+            std::vector<std::string>());
+    auto fileMode = config["input_file_mode"].as<std::string>("realtime");
+    files.loop = config["input_file_loop"].as<bool>(files.loop);
+    files.fps = config["input_file_fps"].as<double>(files.fps);
+    files.duration = config["input_file_duration"].as<uint>(files.duration);
+    files.encode = config["input_file_encode"].as<bool>(files.encode);
+
+    if (fileMode != "realtime" && fileMode != "fast") {
+        throw std::runtime_error(
+            "Invalid config. input_file_mode must be 'realtime' or 'fast'");
+    }
+    files.realtime = (fileMode == "realtime");
+
+    if (not fileLocations.empty()) {
+        files.enabled = true;
+
+        auto filePipelineT =
+            config["input_file_pipeline_t"].as<std::string>(
+                "filesrc location={LOCATION} ! decodebin ! videoconvert "
+                "! appsink sync=false");
+
+        m_inputPipelines.clear();
+        for (auto const& loc : fileLocations) {
+            std::string pipe = filePipelineT;
+            boost::replace_all(pipe, "{LOCATION}", loc);
+            m_inputPipelines.push_back(pipe);
+        }
+        m_inputBackupPipelines.assign(
+            m_inputPipelines.size(), CameraPipelines());
+    } else if (not files.realtime) {
+        throw std::runtime_error(
+            "Invalid config. input_file_mode 'fast' requires "
+            "input_file_locations");
+    }
+
+    //
+    // Load the adaptive jitter buffer configuration
+    //
+    auto& jb = m_jitterBuffer;
+    jb.enabled = config["input_jitter_enabled"].as<bool>(jb.enabled);
+    jb.minMs = config["input_jitter_min_ms"].as<uint>(jb.minMs);
+    jb.maxMs = config["input_jitter_max_ms"].as<uint>(jb.maxMs);
+    jb.initialMs = config["input_jitter_initial_ms"].as<uint>(jb.initialMs);
+    jb.stepMs = config["input_jitter_step_ms"].as<uint>(jb.stepMs);
+    jb.lateHigh = config["input_jitter_late_high"].as<double>(jb.lateHigh);
+    jb.jitterFactor =
+        config["input_jitter_factor"].as<double>(jb.jitterFactor);
+    jb.downSamples =
+        config["input_jitter_down_samples"].as<uint>(jb.downSamples);
+    jb.intervalMs =
+        config["input_jitter_interval_ms"].as<uint>(jb.intervalMs);
+
+    if (jb.enabled) {
+        if (jb.minMs > jb.maxMs || jb.initialMs < jb.minMs ||
+            jb.initialMs > jb.maxMs) {
+            throw std::runtime_error(
+                "Invalid config. input_jitter_initial_ms must be between "
+                "input_jitter_min_ms and input_jitter_max_ms");
+        }
+        if (jb.stepMs == 0 || jb.downSamples == 0 || jb.intervalMs == 0) {
+            throw std::runtime_error(
+                "Invalid config. input_jitter_step_ms, "
+                "input_jitter_down_samples and input_jitter_interval_ms "
+                "cannot be zero");
+        }
+    }
+
+    //
+    // Load the camera reconnect configuration
+    //
+    auto& rc = m_reconnect;
+    rc.enabled = config["input_reconnect_enabled"].as<bool>(rc.enabled);
+    rc.stallMs = config["input_reconnect_stall_ms"].as<uint>(rc.stallMs);
+    rc.backoffMinMs =
+        config["input_reconnect_backoff_min_ms"].as<uint>(rc.backoffMinMs);
+    rc.backoffMaxMs =
+        config["input_reconnect_backoff_max_ms"].as<uint>(rc.backoffMaxMs);
+    rc.jitter = config["input_reconnect_jitter"].as<double>(rc.jitter);
+
+    if (rc.enabled) {
+        if (rc.stallMs == 0 || rc.backoffMinMs == 0 ||
+            rc.backoffMinMs > rc.backoffMaxMs) {
+            throw std::runtime_error(
+                "Invalid config. input_reconnect_stall_ms and "
+                "input_reconnect_backoff_min_ms cannot be zero, and "
+                "input_reconnect_backoff_min_ms cannot exceed "
+                "input_reconnect_backoff_max_ms");
+        }
+        if (rc.jitter < 0. || rc.jitter >= 1.) {
+            throw std::runtime_error(
+                "Invalid config. input_reconnect_jitter must be in [0, 1)");
+        }
+    }
+
+    //
+    // Load the ingest worker configuration
+    //
+    auto& workers = m_ingestWorkers;
+    workers.enabled =
+        config["input_workers_enabled"].as<bool>(workers.enabled);
+    workers.cameras = config["input_workers_cameras"].as<uint>(workers.cameras);
+    workers.slots = config["input_workers_slots"].as<uint>(workers.slots);
+    workers.restartMs =
+        config["input_workers_restart_ms"].as<uint>(workers.restartMs);
+
+    if (workers.enabled) {
+        if (workers.cameras == 0 || workers.slots < 2) {
+            throw std::runtime_error(
+                "Invalid config. input_workers_cameras cannot be zero and "
+                "input_workers_slots must be at least 2");
+        }
+        if (files.enabled) {
+            throw std::runtime_error(
+                "Invalid config. input_workers_enabled cannot be used with "
+                "input_file_locations");
         }
     }
 
@@ -97,11 +256,18 @@ RtspProxyConfig::RtspProxyConfig(std::string const& configFile)
         config["output_width"].as<uint>(m_outputDimensions.width);
     m_outputDimensions.height =
         config["output_height"].as<uint>(m_outputDimensions.height);
+    m_mosaicColumns =
+        config["output_mosaic_columns"].as<uint>(m_mosaicColumns);
     m_outputPath =
         config["output_path"].as<std::string>(m_outputPath);
     m_outputPipeline =
         config["output_gst_rtsp_pipeline"].as<std::string>(m_outputPipeline);
 
+    // views are encoded by the output pipeline, unless they have their own
+    auto viewPipeline =
+        config["output_view_gst_rtsp_pipeline"].as<std::string>(
+            m_outputPipeline);
+
     boost::replace_all(
         m_outputPipeline,
         "{OUTPUT_WIDTH}",
@@ -116,6 +282,410 @@ RtspProxyConfig::RtspProxyConfig(std::string const& configFile)
         m_outputPipeline,
         "{OUTPUT_FPS}",
         std::to_string(m_outputFps));
+
+    m_outputEncoderName =
+        config["output_encoder_name"].as<std::string>(m_outputEncoderName);
+
+    m_outputLowLatency =
+        config["output_low_latency"].as<bool>(m_outputLowLatency);
+
+    auto engine = config["output_engine"].as<std::string>("opencv");
+    if (engine != "opencv" && engine != "gstreamer") {
+        throw std::runtime_error(
+            "Invalid config. output_engine must be 'opencv' or 'gstreamer'");
+    }
+    m_outputEngine = (engine == "gstreamer") ?
+        OutputEngine::GStreamer : OutputEngine::OpenCv;
+
+    //
+    // Load the camera label overlay configuration
+    //
+    auto& overlay = m_overlay;
+    overlay.enabled =
+        config["output_overlay_enabled"].as<bool>(overlay.enabled);
+    overlay.cameraNames =
+        config["output_overlay_camera_names"].as<std::vector<std::string>>(
+            overlay.cameraNames);
+    overlay.clock = config["output_overlay_clock"].as<bool>(overlay.clock);
+    overlay.fontScale =
+        config["output_overlay_font_scale"].as<double>(overlay.fontScale);
+    overlay.noSignalMs =
+        config["output_overlay_no_signal_ms"].as<uint>(overlay.noSignalMs);
+
+    if (overlay.fontScale <= 0.) {
+        throw std::runtime_error(
+            "Invalid config. output_overlay_font_scale must be positive");
+    }
+
+    //
+    // Load the shared memory frame output configuration
+    //
+    auto& shm = m_shmOutput;
+    shm.enabled = config["output_shm_enabled"].as<bool>(shm.enabled);
+    shm.name = config["output_shm_name"].as<std::string>(shm.name);
+    shm.slots = config["output_shm_slots"].as<uint>(shm.slots);
+    shm.cameras = config["output_shm_cameras"].as<bool>(shm.cameras);
+
+    if (shm.enabled) {
+        if (shm.name.size() < 2 || shm.name[0] != '/' ||
+            shm.name.find('/', 1) != std::string::npos) {
+            throw std::runtime_error(
+                "Invalid config. output_shm_name must start with '/' and "
+                "contain no other '/'");
+        }
+        if (shm.slots < 2) {
+            throw std::runtime_error(
+                "Invalid config. output_shm_slots must be at least 2");
+        }
+    }
+
+    //
+    // Load the adaptive bitrate configuration
+    //
+    auto& abr = m_adaptiveBitrate;
+    abr.enabled = config["output_abr_enabled"].as<bool>(abr.enabled);
+    abr.minKbps = config["output_abr_min_kbps"].as<uint>(abr.minKbps);
+    abr.maxKbps = config["output_abr_max_kbps"].as<uint>(abr.maxKbps);
+    abr.stepDownFactor =
+        config["output_abr_step_down_factor"].as<double>(abr.stepDownFactor);
+    abr.stepUpKbps =
+        config["output_abr_step_up_kbps"].as<uint>(abr.stepUpKbps);
+    abr.lossHigh = config["output_abr_loss_high"].as<double>(abr.lossHigh);
+    abr.lossLow = config["output_abr_loss_low"].as<double>(abr.lossLow);
+    abr.jitterHighMs =
+        config["output_abr_jitter_high_ms"].as<double>(abr.jitterHighMs);
+    abr.queueHigh = config["output_abr_queue_high"].as<double>(abr.queueHigh);
+    abr.downSamples =
+        config["output_abr_down_samples"].as<uint>(abr.downSamples);
+    abr.upSamples = config["output_abr_up_samples"].as<uint>(abr.upSamples);
+    abr.intervalMs =
+        config["output_abr_interval_ms"].as<uint>(abr.intervalMs);
+
+    if (abr.enabled) {
+        if (abr.minKbps == 0 || abr.minKbps > abr.maxKbps) {
+            throw std::runtime_error(
+                "Invalid config. output_abr_min_kbps must be non zero and "
+                "not larger than output_abr_max_kbps");
+        }
+        if (abr.stepDownFactor <= 0. || abr.stepDownFactor >= 1.) {
+            throw std::runtime_error(
+                "Invalid config. output_abr_step_down_factor must be "
+                "between 0 and 1");
+        }
+        if (abr.lossLow > abr.lossHigh) {
+            throw std::runtime_error(
+                "Invalid config. output_abr_loss_low cannot be larger than "
+                "output_abr_loss_high");
+        }
+        if (abr.intervalMs == 0) {
+            throw std::runtime_error(
+                "Invalid config. output_abr_interval_ms cannot be zero");
+        }
+    }
+
+    //
+    // Load the keyframe configuration
+    //
+    auto& keyframe = m_keyframe;
+    keyframe.onPlay =
+        config["output_keyframe_on_play"].as<bool>(keyframe.onPlay);
+    keyframe.minIntervalMs = config["output_keyframe_min_interval_ms"]
+        .as<uint>(keyframe.minIntervalMs);
+    keyframe.intraRefresh =
+        config["output_intra_refresh"].as<bool>(keyframe.intraRefresh);
+
+    //
+    // Load the overload governor configuration
+    //
+    auto& gov = m_governor;
+    gov.enabled = config["output_governor_enabled"].as<bool>(gov.enabled);
+    gov.overloadRatio =
+        config["output_governor_overload_ratio"].as<double>(gov.overloadRatio);
+    gov.headroomRatio =
+        config["output_governor_headroom_ratio"].as<double>(gov.headroomRatio);
+    gov.downFrames =
+        config["output_governor_down_frames"].as<uint>(gov.downFrames);
+    gov.upFrames = config["output_governor_up_frames"].as<uint>(gov.upFrames);
+
+    // the first level is always the normal operation
+    gov.levels.push_back(GovernorLevel());
+
+    auto levels = config["output_governor_levels"];
+    for (size_t i = 0; levels && i < levels.size(); i++) {
+        GovernorLevel level;
+        level.fpsDivisor =
+            levels[i]["fps_divisor"].as<uint>(level.fpsDivisor);
+        level.composeScale =
+            levels[i]["compose_scale"].as<double>(level.composeScale);
+        level.tileSkip = levels[i]["tile_skip"].as<uint>(level.tileSkip);
+
+        // a disabled governor never leaves the first level
+        if (gov.enabled && (level.fpsDivisor == 0 || level.tileSkip == 0 ||
+            level.composeScale <= 0. || level.composeScale > 1.)) {
+            throw std::runtime_error(
+                "Invalid config. output_governor_levels element " +
+                std::to_string(i) + " must have non zero fps_divisor and "
+                "tile_skip, and compose_scale in (0, 1]");
+        }
+        gov.levels.push_back(level);
+    }
+
+    if (gov.enabled && gov.headroomRatio >= gov.overloadRatio) {
+        throw std::runtime_error(
+            "Invalid config. output_governor_headroom_ratio must be smaller "
+            "than output_governor_overload_ratio");
+    }
+
+    //
+    // Load the output multicast configuration
+    //
+    auto& mcast = m_outputMulticast;
+    mcast.enabled =
+        config["output_multicast_enabled"].as<bool>(mcast.enabled);
+    mcast.only = config["output_multicast_only"].as<bool>(mcast.only);
+    mcast.addressMin =
+        config["output_multicast_address_min"].as<std::string>(
+            mcast.addressMin);
+    mcast.addressMax =
+        config["output_multicast_address_max"].as<std::string>(
+            mcast.addressMax);
+    mcast.portMin =
+        config["output_multicast_port_min"].as<ushort>(mcast.portMin);
+    mcast.portMax =
+        config["output_multicast_port_max"].as<ushort>(mcast.portMax);
+    mcast.ttl = config["output_multicast_ttl"].as<uint>(mcast.ttl);
+    mcast.iface =
+        config["output_multicast_iface"].as<std::string>(mcast.iface);
+
+    if (mcast.enabled) {
+        if (mcast.portMin % 2 != 0 || mcast.portMax <= mcast.portMin) {
+            throw std::runtime_error(
+                "Invalid config. output_multicast_port_min must be even "
+                "and below output_multicast_port_max");
+        }
+        if (mcast.ttl == 0 || mcast.ttl > 255) {
+            throw std::runtime_error(
+                "Invalid config. output_multicast_ttl must be 1..255");
+        }
+    } else if (mcast.only) {
+        throw std::runtime_error(
+            "Invalid config. output_multicast_only requires "
+            "output_multicast_enabled");
+    }
+
+    //
+    // Load the viewport configuration
+    //
+    auto& view = m_view;
+    view.enabled = config["output_view_enabled"].as<bool>(view.enabled);
+    view.width = config["output_view_width"].as<uint>(view.width);
+    view.height = config["output_view_height"].as<uint>(view.height);
+    view.maxViews = config["output_view_max"].as<uint>(view.maxViews);
+
+    if (view.enabled && (view.width == 0 || view.height == 0 ||
+        view.maxViews == 0)) {
+        throw std::runtime_error(
+            "Invalid config. output_view_width, output_view_height and "
+            "output_view_max cannot be zero");
+    }
+
+    view.pipeline = viewPipeline;
+    boost::replace_all(
+        view.pipeline, "{OUTPUT_WIDTH}", std::to_string(view.width));
+    boost::replace_all(
+        view.pipeline, "{OUTPUT_HEIGHT}", std::to_string(view.height));
+    boost::replace_all(
+        view.pipeline, "{OUTPUT_FPS}", std::to_string(m_outputFps));
+
+    //
+    // Load the replay configuration
+    //
+    auto& replay = m_replay;
+    replay.enabled = config["replay_enabled"].as<bool>(replay.enabled);
+    replay.path = config["replay_path"].as<std::string>(replay.path);
+    replay.directory =
+        config["replay_directory"].as<std::string>(replay.directory);
+    replay.segmentCount =
+        config["replay_segment_count"].as<size_t>(replay.segmentCount);
+    replay.segmentSize =
+        config["replay_segment_size"].as<size_t>(replay.segmentSize);
+    replay.queueSize =
+        config["replay_queue_size"].as<size_t>(replay.queueSize);
+    replay.pipeline =
+        config["replay_gst_rtsp_pipeline"].as<std::string>(replay.pipeline);
+
+    if (replay.enabled) {
+        if (replay.segmentCount < 2 || replay.segmentSize == 0 ||
+            replay.queueSize == 0) {
+            throw std::runtime_error(
+                "Invalid config. replay_segment_count must be at least 2, "
+                "replay_segment_size and replay_queue_size cannot be zero");
+        }
+        if (replay.path == m_outputPath) {
+            throw std::runtime_error(
+                "Invalid config. replay_path must differ from output_path");
+        }
+        if (replay.pipeline.empty()) {
+            throw std::runtime_error(
+                "Invalid config. replay_gst_rtsp_pipeline is not set");
+        }
+    }
+
+    //
+    // Load the HTTP endpoint configuration
+    //
+    auto& http = m_http;
+    http.enabled = config["http_enabled"].as<bool>(http.enabled);
+    http.address = config["http_address"].as<std::string>(http.address);
+    http.port = config["http_port"].as<ushort>(http.port);
+    http.threads = config["http_threads"].as<uint>(http.threads);
+    http.jpegQuality =
+        config["snapshot_jpeg_quality"].as<int>(http.jpegQuality);
+
+    if (http.enabled && http.threads == 0) {
+        throw std::runtime_error(
+            "Invalid config. http_threads cannot be zero");
+    }
+
+    //
+    // Load the RTSP server configuration
+    //
+    auto& server = m_server;
+    server.port = config["server_port"].as<ushort>(server.port);
+    server.threads = config["server_threads"].as<uint>(server.threads);
+    server.backlog = config["server_backlog"].as<int>(server.backlog);
+
+    auto persistence =
+        config["server_media_persistence"].as<std::string>("none");
+
+    if (server.backlog <= 0) {
+        throw std::runtime_error(
+            "Invalid config. server_backlog must be positive");
+    }
+    if (persistence == "none") {
+        server.mediaPersistence = MediaPersistence::None;
+    } else if (persistence == "startup") {
+        server.mediaPersistence = MediaPersistence::Startup;
+    } else if (persistence == "first_use") {
+        server.mediaPersistence = MediaPersistence::FirstUse;
+    } else {
+        throw std::runtime_error(
+            "Invalid config. server_media_persistence must be 'none', "
+            "'startup' or 'first_use'");
+    }
+
+    //
+    // Load the thread placement configuration
+    //
+    auto loadRole = [&config](std::string const& role, ThreadRoleConfig& dst)
+    {
+        auto prefix = "placement_" + role + "_";
+        dst.cpus = config[prefix + "cpus"].as<std::string>(dst.cpus);
+        dst.policy = config[prefix + "policy"].as<std::string>(dst.policy);
+        dst.priority = config[prefix + "priority"].as<int>(dst.priority);
+        dst.nice = config[prefix + "nice"].as<int>(dst.nice);
+
+        bool realtime = dst.policy == "fifo" || dst.policy == "rr";
+        if (not realtime && dst.policy != "other" &&
+            dst.policy != "batch" && dst.policy != "idle") {
+            throw std::runtime_error(
+                "Invalid config. Unknown " + prefix + "policy '" +
+                dst.policy + "'");
+        }
+        if (realtime && (dst.priority < 1 || dst.priority > 99)) {
+            throw std::runtime_error(
+                "Invalid config. " + prefix + "priority must be 1..99");
+        }
+        if (dst.nice < -20 || dst.nice > 19) {
+            throw std::runtime_error(
+                "Invalid config. " + prefix + "nice must be -20..19");
+        }
+    };
+
+    auto& placement = m_placement;
+    loadRole("main", placement.main);
+    loadRole("input", placement.input);
+    loadRole("processor", placement.processor);
+    loadRole("output", placement.output);
+    loadRole("analytics", placement.analytics);
+    placement.numaFrameBuffers =
+        config["placement_numa_frame_buffers"].as<bool>(
+            placement.numaFrameBuffers);
+
+    //
+    // Load the motion analytics configuration
+    //
+    auto& analytics = m_analytics;
+    analytics.enabled =
+        config["analytics_enabled"].as<bool>(analytics.enabled);
+    analytics.fps = config["analytics_fps"].as<double>(analytics.fps);
+    analytics.width = config["analytics_width"].as<uint>(analytics.width);
+    analytics.workers =
+        config["analytics_workers"].as<uint>(analytics.workers);
+    analytics.queueSize =
+        config["analytics_queue_size"].as<uint>(analytics.queueSize);
+    analytics.threshold =
+        config["analytics_threshold"].as<uint>(analytics.threshold);
+    analytics.minArea =
+        config["analytics_min_area"].as<double>(analytics.minArea);
+    analytics.overlay =
+        config["analytics_overlay"].as<bool>(analytics.overlay);
+
+    if (analytics.enabled) {
+        if (analytics.fps <= 0. || analytics.width == 0) {
+            throw std::runtime_error(
+                "Invalid config. analytics_fps and analytics_width must be "
+                "positive");
+        }
+        if (analytics.workers == 0 || analytics.queueSize == 0) {
+            throw std::runtime_error(
+                "Invalid config. analytics_workers and analytics_queue_size "
+                "cannot be zero");
+        }
+        if (analytics.threshold > 255) {
+            throw std::runtime_error(
+                "Invalid config. analytics_threshold must be 0..255");
+        }
+    }
+
+    //
+    // Load the tracing configuration
+    //
+    auto& trace = m_trace;
+    trace.enabled = config["trace_enabled"].as<bool>(trace.enabled);
+    trace.eventsPerThread =
+        config["trace_events_per_thread"].as<uint>(trace.eventsPerThread);
+    trace.path = config["trace_path"].as<std::string>(trace.path);
+
+    if (trace.enabled && trace.eventsPerThread == 0) {
+        throw std::runtime_error(
+            "Invalid config. trace_events_per_thread cannot be zero");
+    }
+
+    m_metricsReportInterval =
+        config["metrics_report_interval"].as<uint>(m_metricsReportInterval);
+
+    m_configWatch = config["config_watch"].as<bool>(m_configWatch);
+
+    // views, overlay, analytics and the shm output work on the OpenCV frames
+    // of the processor, and replay tees the encoder output of the processor
+    // fed media. The GStreamer engine has neither, its media is the
+    // compositor pipeline alone.
+    if (m_outputEngine == OutputEngine::GStreamer &&
+        (m_view.enabled || m_overlay.enabled || m_analytics.enabled ||
+            m_replay.enabled || m_shmOutput.enabled)) {
+        throw std::runtime_error(
+            "Invalid config. output_engine 'gstreamer' cannot be used with "
+            "output_view_enabled, output_overlay_enabled, analytics_enabled, "
+            "replay_enabled or output_shm_enabled");
+    }
+
+    // the compositor runs the camera pipelines itself
+    if (m_outputEngine == OutputEngine::GStreamer && m_ingestWorkers.enabled) {
+        throw std::runtime_error(
+            "Invalid config. output_engine 'gstreamer' cannot be used with "
+            "input_workers_enabled");
+    }
 }
 
 }
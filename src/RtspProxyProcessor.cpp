@@ -1,46 +1,108 @@
 // Open CV headers
 #include <opencv2/imgproc/imgproc.hpp>  // cv::resize
 
+// System headers
+#include <time.h>
+#include <unistd.h>
+
+// STL headers
+#include <algorithm>
+#include <chrono>
+
 // Project headers
 #include <RtspProxyProcessor.hpp>
+#include <ThreadPlacement.hpp>
+#include <ProxyMetrics.hpp>
+#include <FrameTracer.hpp>
+#include <MosaicLayout.hpp>
+#include <IngestWorker.hpp>
 
 namespace rtsp_proxy_server {
 
 #define DEBUG_PROXY_PROCESSOR 0
 
+namespace {
+
+/**
+ * \brief Map a rectangle between two coordinate systems of a different
+ *        size. Adjacent rectangles stay adjacent.
+ */
+cv::Rect
+scaleRect(cv::Rect const& rect, cv::Size const& from, cv::Size const& to)
+{
+    auto sx = [&](int x) { return int(int64_t(x) * to.width / from.width); };
+    auto sy = [&](int y) { return int(int64_t(y) * to.height / from.height); };
+
+    int x = sx(rect.x);
+    int y = sy(rect.y);
+    return cv::Rect(
+        x, y, sx(rect.x + rect.width) - x, sy(rect.y + rect.height) - y);
+}
+
+}
+
 RtspProxyProcessor::RtspProxyProcessor(
-    std::shared_ptr<const RtspProxyConfig> config)
+    std::shared_ptr<const RtspProxyConfig> config,
+    SnapshotCache* snapshotCache,
+    AnalyticsEngine* analytics)
     :
     m_buffer(config->getInputBufferSize()),
+    m_bufferSize(config->getInputBufferSize()),
     m_outputSize(
         int(config->getOutputDimensions().width),
-        int(config->getOutputDimensions().height))
+        int(config->getOutputDimensions().height)),
+    m_outputFps(config->getOutputFps()),
+    m_mosaicColumns(config->getMosaicColumns()),
+    m_governor(config->getGovernor(), config->getOutputFps()),
+    m_snapshotCache(snapshotCache),
+    m_analytics(analytics),
+    m_inputPipelines(config->getInputPipelines()),
+    m_inputBackupPipelines(config->getInputBackupPipelines()),
+    m_placement(config->getPlacement().processor),
+    m_frameNode(
+        config->getPlacement().numaFrameBuffers ?
+            ThreadPlacement::getNumaNode(config->getPlacement().processor) :
+            -1),
+    m_lowLatency(config->getOutputLowLatency()),
+    m_noSignalTime(config->getOverlay().noSignalMs),
+    m_unpaced(
+        config->getFileIngest().enabled && not config->getFileIngest().realtime)
 {
     m_openCvReaders.resize(config->getInputPipelinesNum());
     m_lastFrame.resize(config->getInputPipelinesNum());
+    m_lastFrameTime.resize(
+        config->getInputPipelinesNum(), std::chrono::steady_clock::now());
+
+    if (config->getOverlay().enabled ||
+        (m_analytics && m_analytics->isOverlayEnabled())) {
+        m_overlay.reset(new OverlayRenderer(config->getOverlay()));
+    }
+
+    if (config->getShmOutput().enabled) {
+        m_shmOutput.reset(new ShmOutput(config->getShmOutput()));
+    }
 
     // add one empty frame into the buffer so our consumer always has a "valid"
     // frame
     for (auto& f : m_lastFrame) {
-        f = std::make_shared<cv::Mat>(2160, 3840, CV_8UC3, cv::Scalar(0));
+        f = makeEmptyFrame();
     }
 
     // push one "good" frame so consumer has something valid to read
     // before we are ready
     m_buffer.push(m_lastFrame[0]);
+    m_pushedFrames++;
 
     // Initialize a semaphore to get notified about incoming frames
     sem_init(&m_videoFrameReadySemaphore, 0, 0);
 
     // Open all configured GST pipelines
     for (size_t idx=0; idx < config->getInputPipelinesNum(); idx++ ) {
-        m_openCvReaders[idx].reset(
-            new OpenCvReader(
-                config->getInputPipelines()[idx],
-                config->getInputBufferSize(),
-                &m_videoFrameReadySemaphore));
+        m_openCvReaders[idx] = openReader(*config, idx);
     }
 
+    attachAnalytics();
+
     // start the reader's thread
     start();
 }
@@ -48,6 +110,167 @@ RtspProxyProcessor::RtspProxyProcessor(
 RtspProxyProcessor::~RtspProxyProcessor()
 {
     stop();
+
+    // the readers close after the analytics may be gone
+    for (auto& r : m_openCvReaders) {
+        r->setFrameListener(FrameListener());
+    }
+}
+
+std::unique_ptr<OpenCvReader>
+RtspProxyProcessor::openReader(RtspProxyConfig const& config, size_t cam)
+{
+    // with ingest workers the camera is decoded by a worker, and read from
+    // its ring
+    std::string shmRing;
+    if (config.getIngestWorkers().enabled) {
+        shmRing = IngestWorker::getRingName(getpid(), cam);
+    }
+    return std::unique_ptr<OpenCvReader>(
+        new OpenCvReader(
+            config.getInputPipelines()[cam],
+            config.getInputBufferSize(),
+            &m_videoFrameReadySemaphore,
+            config.getPlacement().input,
+            m_frameNode,
+            config.getFileIngest(),
+            config.getJitterBuffer(),
+            config.getInputBackupPipelines()[cam],
+            config.getReconnect(),
+            shmRing));
+}
+
+CvMatPtr
+RtspProxyProcessor::makeEmptyFrame()
+{
+    return std::make_shared<cv::Mat>(2160, 3840, CV_8UC3, cv::Scalar(0));
+}
+
+ViewOutputPtr
+RtspProxyProcessor::addView(Viewport const& viewport, cv::Size const& size)
+{
+    auto view = std::make_shared<ViewOutput>(viewport, size, m_bufferSize);
+
+    // like the mosaic, the view starts with a valid frame
+    view->buffer.push(
+        std::make_shared<cv::Mat>(size, CV_8UC3, cv::Scalar(0)));
+
+    std::lock_guard<std::mutex> lock(m_viewsMutex);
+    m_views.push_back(view);
+    return view;
+}
+
+void
+RtspProxyProcessor::removeView(ViewOutputPtr const& view)
+{
+    std::lock_guard<std::mutex> lock(m_viewsMutex);
+    for (auto it = m_views.begin(); it != m_views.end(); ++it) {
+        if (*it == view) {
+            m_views.erase(it);
+            break;
+        }
+    }
+}
+
+void
+RtspProxyProcessor::reconfigure(std::shared_ptr<const RtspProxyConfig> config)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_pendingConfigMutex);
+        m_pendingConfig = config;
+    }
+    // wake up the processor thread, the new layout is applied before the
+    // next output frame
+    sem_post(&m_videoFrameReadySemaphore);
+}
+
+void
+RtspProxyProcessor::applyPendingConfig()
+{
+    std::shared_ptr<const RtspProxyConfig> config;
+    {
+        std::lock_guard<std::mutex> lock(m_pendingConfigMutex);
+        config.swap(m_pendingConfig);
+    }
+    if (not config) {
+        return;
+    }
+
+    auto const& pipelines = config->getInputPipelines();
+    auto const& backups = config->getInputBackupPipelines();
+
+    std::vector<std::unique_ptr<OpenCvReader>> readers(pipelines.size());
+    std::vector<CvMatPtr> lastFrames(pipelines.size());
+    std::vector<std::chrono::steady_clock::time_point> lastFrameTimes(
+        pipelines.size(), std::chrono::steady_clock::now());
+    std::vector<bool> reused(m_openCvReaders.size(), false);
+    size_t kept = 0;
+
+    // keep readers whose pipeline hasn't changed, wherever they moved to in
+    // the new layout. Readers of ingest workers only where they are, the
+    // rings are named by camera index. They follow the ring of their worker
+    // if it is restarted.
+    bool workers = config->getIngestWorkers().enabled;
+    for (size_t i = 0; i < pipelines.size(); i++) {
+        for (size_t j = 0; j < m_openCvReaders.size(); j++) {
+            if (workers && j != i) {
+                continue;
+            }
+            if (not reused[j] && m_inputPipelines[j] == pipelines[i] &&
+                m_inputBackupPipelines[j] == backups[i]) {
+                reused[j] = true;
+                readers[i] = std::move(m_openCvReaders[j]);
+                lastFrames[i] = m_lastFrame[j];
+                lastFrameTimes[i] = m_lastFrameTime[j];
+                kept++;
+                break;
+            }
+        }
+    }
+
+    // open new and changed cameras
+    for (size_t i = 0; i < pipelines.size(); i++) {
+        if (not readers[i]) {
+            readers[i] = openReader(*config, i);
+            lastFrames[i] = makeEmptyFrame();
+        }
+    }
+
+    // tear down removed and changed cameras off the processor thread, so the
+    // rest of the mosaic keeps flowing while their pipelines close
+    auto retired =
+        std::make_shared<std::vector<std::unique_ptr<OpenCvReader>>>();
+    for (auto& r : m_openCvReaders) {
+        if (r) {
+            r->setFrameListener(FrameListener());
+            retired->push_back(std::move(r));
+        }
+    }
+    size_t closed = retired->size();
+    m_retirer.retire([retired] { retired->clear(); });
+
+    printf(
+        "Configuration applied: %zu cameras kept, %zu opened, %zu closed\n",
+        kept,
+        pipelines.size() - kept,
+        closed);
+    fflush(stdout);
+
+    m_openCvReaders = std::move(readers);
+    m_lastFrame = std::move(lastFrames);
+    m_lastFrameTime = std::move(lastFrameTimes);
+    m_inputPipelines = pipelines;
+    m_inputBackupPipelines = backups;
+
+    // cameras may have moved, label them by their new index
+    if (m_overlay) {
+        m_overlay->setCameraNames(config->getOverlay().cameraNames);
+    }
+    attachAnalytics();
+
+    // the layout may have changed, redraw all tiles
+    m_mosaicColumns = config->getMosaicColumns();
+    m_canvas.release();
 }
 
 bool
@@ -95,93 +318,368 @@ RtspProxyProcessor::stop() {
     }
 }
 
+cv::Rect
+RtspProxyProcessor::getTileRect(size_t idx, cv::Size const& canvasSize) const
+{
+    return getMosaicTileRect(
+        idx, m_openCvReaders.size(), canvasSize, m_mosaicColumns);
+}
+
+CvMatPtr
+RtspProxyProcessor::composeFrame(GovernorLevel const& level, uint64_t idx)
+{
+    cv::Size canvasSize(
+        int(double(m_outputSize.width) * level.composeScale + 0.5),
+        int(double(m_outputSize.height) * level.composeScale + 0.5));
+
+    // all tiles have to be redrawn when the canvas changes
+    bool fullRefresh = false;
+    if (m_canvas.size() != canvasSize) {
+        m_canvas.create(canvasSize, CV_8UC3);
+        fullRefresh = true;
+    }
+
+    // allocate space for a new, processed, frame
+    auto outputFrame = std::make_shared<cv::Mat>();
+
+    try {
+        // under load only a subset of tiles is refreshed in each frame,
+        // the rest keep their previous content
+        std::vector<size_t> tiles;
+        for (size_t i=0; i < m_lastFrame.size(); i++) {
+            if (fullRefresh || level.tileSkip <= 1 ||
+                (idx + i) % level.tileSkip == 0) {
+                tiles.push_back(i);
+            }
+        }
+
+        auto composeTiles = [&](cv::Range const& range) {
+            for (int t = range.start; t < range.end; t++) {
+                auto i = tiles[size_t(t)];
+                cv::Mat tile = m_canvas(getTileRect(i, canvasSize));
+                cv::resize(*m_lastFrame[i], tile, tile.size());
+            }
+        };
+
+        // tiles don't overlap, so they can be scaled by different threads
+        // to get the frame out sooner
+        cv::Range all(0, int(tiles.size()));
+        if (m_lowLatency && tiles.size() > 1) {
+            cv::parallel_for_(all, composeTiles, double(tiles.size()));
+        } else {
+            composeTiles(all);
+        }
+
+        // adjust canvas size to our output size
+        if (canvasSize == m_outputSize) {
+            m_canvas.copyTo(*outputFrame);
+        } else {
+            cv::resize(m_canvas, *outputFrame, m_outputSize);
+        }
+
+        // labels are drawn at the output resolution, after scaling, and
+        // never into the canvas whose tiles are kept between frames
+        if (m_overlay) {
+            drawOverlay(*outputFrame);
+        }
+
+    } catch(cv::Exception const& e) {
+        fprintf(stderr, "OpenCV call Failed:\n\t%s\n", e.what());
+        return CvMatPtr();
+    }
+
+    // account frames the input queues had to drop
+    size_t dropped = 0;
+    for (auto const& r : m_openCvReaders) {
+        dropped += r->getDroppedFrames();
+    }
+    ProxyMetrics::instance().set("input.dropped_frames", double(dropped));
+
+    return outputFrame;
+}
+
 void
-RtspProxyProcessor::rtspProxyProcessorThread() {
-    // wait for the cameras to be connected
-    // or RTSP client to disconnect
-    while (m_running && not isConnected()) {
-        sem_wait(&m_videoFrameReadySemaphore);
+RtspProxyProcessor::attachAnalytics()
+{
+    if (not m_analytics) {
+        return;
+    }
+    m_analytics->setCameras(m_openCvReaders.size());
+
+    for (size_t i = 0; i < m_openCvReaders.size(); i++) {
+        auto* analytics = m_analytics;
+        m_openCvReaders[i]->setFrameListener(
+            [analytics, i](CvMatPtr const& frame) {
+                analytics->offer(i, frame);
+            });
     }
+}
 
-    if (m_running) {
-        printf(
-            "\nAll cameras connected. Starting RTSP Proxy processing...\n\n");
+void
+RtspProxyProcessor::drawOverlay(cv::Mat& frame)
+{
+    auto now = std::chrono::steady_clock::now();
+
+    std::vector<AnalyticsResult> results;
+    if (m_analytics && m_analytics->isOverlayEnabled()) {
+        results = m_analytics->getResults();
+    }
+
+    std::vector<TileOverlay> tiles(m_openCvReaders.size());
+    for (size_t i = 0; i < tiles.size(); i++) {
+        auto& tile = tiles[i];
+        tile.rect = getTileRect(i, frame.size());
+        tile.cam = i;
+        tile.noSignal = not m_openCvReaders[i]->isConnected() ||
+            now - m_lastFrameTime[i] > m_noSignalTime;
+
+        if (i >= results.size()) {
+            continue;
+        }
+        auto const& r = tile.rect;
+        for (auto const& box : results[i].boxes) {
+            tile.motion.push_back(cv::Rect(
+                r.x + int(box.x * r.width),
+                r.y + int(box.y * r.height),
+                int(box.width * r.width + 0.5),
+                int(box.height * r.height + 0.5)));
+        }
     }
+    m_overlay->draw(frame, tiles);
+}
 
-    std::vector<CvMatPtr> currFrame;
-    currFrame.resize(m_openCvReaders.size());
+void
+RtspProxyProcessor::publishIngestStats()
+{
+    auto& metrics = ProxyMetrics::instance();
+    for (size_t i = 0; i < m_openCvReaders.size(); i++) {
+        auto stats = m_openCvReaders[i]->getIngestStats();
+        auto prefix = "input.cam" + std::to_string(i) + ".";
+        metrics.set(prefix + "down", stats.down ? 1. : 0.);
+        metrics.set(prefix + "reconnects", double(stats.reconnects));
+        metrics.set(prefix + "outage_sec", stats.outageSec);
+        metrics.set(prefix + "source", double(stats.source));
+        if (not stats.available) {
+            continue;
+        }
+        metrics.set(prefix + "latency_ms", stats.latencyMs);
+        metrics.set(prefix + "jitter_ms", stats.jitterMs);
+        metrics.set(prefix + "late_packets", double(stats.late));
+        metrics.set(prefix + "lost_packets", double(stats.lost));
+    }
+}
+
+CvMatPtr
+RtspProxyProcessor::composeView(ViewOutput const& view)
+{
+    auto frame = std::make_shared<cv::Mat>(view.size, CV_8UC3, cv::Scalar(0));
+
+    cv::Rect roi = view.viewport.roi;
+    if (view.viewport.cam >= 0) {
+        // the camera may be gone after a configuration reload
+        if (size_t(view.viewport.cam) >= m_lastFrame.size()) {
+            return frame;
+        }
+        roi = getTileRect(size_t(view.viewport.cam), m_outputSize);
+    }
+
+    try {
+        // the view is composed from the camera frames, so a zoomed view
+        // shows the cameras in more detail than the mosaic does
+        for (size_t i = 0; i < m_lastFrame.size(); i++) {
+            cv::Rect tile = getTileRect(i, m_outputSize);
+            cv::Rect area = roi & tile;
+            if (area.area() == 0) {
+                continue;
+            }
+            cv::Mat const& src = *m_lastFrame[i];
+
+            // the area in view pixels, and in camera pixels
+            cv::Rect dst = scaleRect(
+                cv::Rect(area.x - roi.x, area.y - roi.y,
+                    area.width, area.height),
+                roi.size(),
+                view.size);
+            cv::Rect srcArea = scaleRect(
+                cv::Rect(area.x - tile.x, area.y - tile.y,
+                    area.width, area.height),
+                tile.size(),
+                src.size());
+            if (dst.area() == 0 || srcArea.area() == 0) {
+                continue;
+            }
+
+            cv::Mat viewTile = (*frame)(dst);
+            cv::resize(src(srcArea), viewTile, viewTile.size());
+        }
+    } catch(cv::Exception const& e) {
+        fprintf(stderr, "OpenCV call Failed:\n\t%s\n", e.what());
+        return CvMatPtr();
+    }
+    return frame;
+}
+
+void
+RtspProxyProcessor::rtspProxyProcessorThread() {
+    // the canvas and output frames are allocated here, so they are local
+    // to the processor CPUs
+    ThreadPlacement::apply("processor", m_placement);
+
+    // the mosaic is composed as soon as any camera delivers. A camera that
+    // is down keeps reconnecting, its tile stays empty (NO SIGNAL with the
+    // overlay) meanwhile, instead of holding back the whole mosaic.
+    if (not isConnected()) {
+        printf("\nNot all cameras connected yet, their tiles stay empty\n");
+    }
+    printf("\nStarting RTSP Proxy processing...\n\n");
+
+    // the compositor never runs faster than the output FPS divided by the
+    // governor's divisor. A small tolerance keeps camera arrival jitter from
+    // halving the composed FPS.
+    auto lastCompose = std::chrono::steady_clock::time_point();
+    uint64_t composedFrames = 0;
+
+    using Clock = std::chrono::steady_clock;
+    using Seconds = std::chrono::duration<double>;
+    auto& metrics = ProxyMetrics::instance();
+
+    // end of the previous composed frame
+    auto idleStart = Clock::now();
+
+    auto nextStatsReport = Clock::now();
+
+    // with all cameras down no frame wakes the processor, it keeps
+    // composing the last frames and the NO SIGNAL tiles at the output FPS
+    long frameIntervalNs =
+        1000L * 1000 * 1000 / long(std::max(m_outputFps, 1U));
 
     while (m_running) {
         /*--------------------------------------------*/
         /*-- wait for a video frame      -------------*/
         /*--------------------------------------------*/
-        sem_wait(&m_videoFrameReadySemaphore);
-
-        #if DEBUG_PROXY_PROCESSOR
-            auto start = std::chrono::steady_clock::now();
-        #endif
+        timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += frameIntervalNs;
+        if (deadline.tv_nsec >= 1000 * 1000 * 1000) {
+            deadline.tv_sec += deadline.tv_nsec / (1000 * 1000 * 1000);
+            deadline.tv_nsec %= 1000 * 1000 * 1000;
+        }
+        sem_timedwait(&m_videoFrameReadySemaphore, &deadline);
 
-        // allocate space for a new, processed, frame
-        auto outputFrame = std::make_shared<cv::Mat>();
+        applyPendingConfig();
 
         //
-        // load frames from all cameras. If a camera doesn't have a valid
-        // frame - load the previous one saved for this camera
+        // load frames from all cameras. If a camera doesn't have a new
+        // frame - keep the previous one saved for this camera
         //
-        int w = 0;
-        int h = 0;
+        bool tracing = FrameTracer::isEnabled();
+        bool finished = not m_openCvReaders.empty();
         for (size_t i=0; i < m_openCvReaders.size(); i++) {
-            currFrame[i] = m_openCvReaders[i]->getFrame();
-            if (not currFrame[i]) {
-                currFrame[i] = m_lastFrame[i];
+            auto pickupStart = tracing ? FrameTracer::now() : 0;
+            uint64_t frameId = 0;
+            auto frame = m_openCvReaders[i]->getFrame(&frameId);
+            if (frame) {
+                m_lastFrame[i] = frame;
+                m_lastFrameTime[i] = std::chrono::steady_clock::now();
+                if (m_snapshotCache) {
+                    m_snapshotCache->publishCamera(i, frame);
+                }
+                if (m_shmOutput) {
+                    m_shmOutput->publishCamera(i, *frame, m_lastFrameTime[i]);
+                }
+                if (tracing) {
+                    TraceEvent event;
+                    event.name = "pickup";
+                    event.startNs = pickupStart;
+                    event.endNs = FrameTracer::now();
+                    event.frame = frameId;
+                    event.cam = int(i);
+                    event.flowIn = FrameTracer::flowId(
+                        m_openCvReaders[i].get(), frameId);
+                    FrameTracer::instance().record(event);
+                }
             }
-            w += currFrame[i]->cols;
-            h = (h > currFrame[i]->rows) ? h : currFrame[i]->rows;
+            finished = finished && m_openCvReaders[i]->isFinished();
         }
+        m_inputFinished = finished;
 
-        // Place all camera frames in one row
+        if (Clock::now() >= nextStatsReport) {
+            publishIngestStats();
+            nextStatsReport = Clock::now() + std::chrono::seconds(1);
+        }
 
-        // 1. Create canvas that fits all frames
-        cv::Mat canvas(h, w, currFrame[0]->type());
+        auto const& level = m_governor.getLevel();
 
-        #if DEBUG_PROXY_PROCESSOR
-            printf("Canvas: %d x %d\n", canvas.cols, canvas.rows);
-        #endif
-
-        w = 0;
-        try {
-            for (auto& frame : currFrame) {
-                cv::Rect image(w, 0, frame->cols, frame->rows);
+        auto start = Clock::now();
+        Seconds sinceLast = start - lastCompose;
+        if (not m_unpaced && sinceLast.count() <
+            0.9 * double(level.fpsDivisor) / double(m_outputFps)) {
+            continue;
+        }
+        lastCompose = start;
 
-                frame->copyTo(canvas(image));
+        auto outputFrame = composeFrame(level, composedFrames++);
+        if (not outputFrame) {
+            continue;
+        }
 
-                w += frame->cols;
+        std::vector<ViewOutputPtr> views;
+        {
+            std::lock_guard<std::mutex> lock(m_viewsMutex);
+            views = m_views;
+        }
+        for (auto const& view : views) {
+            auto viewFrame = composeView(*view);
+            if (viewFrame && not view->buffer.push(viewFrame)) {
+                metrics.add("output.view_dropped_frames");
             }
-
-            // adjust canvas size to our output size
-            cv::resize(canvas, *outputFrame, m_outputSize);
-
-        } catch(cv::Exception const& e) {
-            fprintf(stderr, "OpenCV call Failed:\n\t%s\n", e.what());
-            continue;
         }
+        auto composeEnd = Clock::now();
 
         // send new processed frame to out consumer
-        m_buffer.push(outputFrame);
-
-        // save all last frames in case we cannot read fast enough from the
-        // camera streams
-        for (size_t i=0; i < currFrame.size(); i++) {
-            m_lastFrame[i] = currFrame[i];
+        uint64_t frameId = m_pushedFrames;
+        m_composeTimes[frameId % m_composeTimes.size()].store(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                start.time_since_epoch()).count(),
+            std::memory_order_release);
+        bool queued = m_buffer.push(outputFrame);
+        if (queued) {
+            m_pushedFrames++;
+        } else {
+            metrics.add("output.dropped_frames");
+        }
+        if (tracing) {
+            TraceEvent event;
+            event.name = queued ? "compose" : "compose-dropped";
+            event.startNs = FrameTracer::toNs(start);
+            event.endNs = FrameTracer::toNs(composeEnd);
+            event.frame = frameId;
+            event.flowOut = queued ? FrameTracer::flowId(this, frameId) : 0;
+            FrameTracer::instance().record(event);
         }
+        if (m_snapshotCache) {
+            m_snapshotCache->publishOutput(outputFrame);
+        }
+        if (m_shmOutput) {
+            m_shmOutput->publishOutput(*outputFrame, start);
+        }
+
+        auto end = Clock::now();
+        Seconds elapsed = end - start;
+        m_governor.reportComposeCost(elapsed.count());
+
+        // time spent in each stage, for benchmarks. Waiting includes
+        // collecting the input frames.
+        metrics.add("processor.wait_sec", Seconds(start - idleStart).count());
+        metrics.add(
+            "processor.compose_sec", Seconds(composeEnd - start).count());
+        metrics.add(
+            "processor.publish_sec", Seconds(end - composeEnd).count());
+        metrics.add("processor.composed_frames");
+        idleStart = end;
 
         #if DEBUG_PROXY_PROCESSOR
-            auto end = std::chrono::steady_clock::now();
-            auto elapsed =
-                    std::chrono::duration_cast<std::chrono::nanoseconds>(
-                        end - start).count();
-            printf("ProxyView processing took: %zu ns (%0.6lf s)\n",
-                elapsed, double(elapsed)/1000./1000./1000.);
+            printf("ProxyView processing took: %0.6lf s\n", elapsed.count());
         #endif
     }
     m_running = false;
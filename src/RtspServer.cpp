@@ -1,36 +1,103 @@
+#include <signal.h>
+#include <stdlib.h>
 #include <string.h>
 
+#include <chrono>
+
+#include <glib-unix.h>
+
 #include <RtspServer.hpp>
 #include <RtspProxyConfig.hpp>
+#include <CompositorPipeline.hpp>
+#include <FrameTracer.hpp>
+#include <ProxyMetrics.hpp>
+#include <ReplayMedia.hpp>
+#include <ThreadPlacement.hpp>
+#include <ViewMediaFactory.hpp>
 
 namespace rtsp_proxy_server {
 
+namespace {
+
+/** interval of the main loop heartbeat in milliseconds */
+const guint HEARTBEAT_MS = 20;
+
+/** heartbeat delay counted as a main loop stall, in milliseconds */
+const double STALL_MS = 50.;
+
+/**
+ * \brief Get the launch string of the output mount point: the output
+ *        pipeline fed by the processor, or the whole mosaic built by the
+ *        GStreamer engine
+ */
+std::string
+getOutputLaunch(RtspProxyConfig const& config)
+{
+    if (config.getOutputEngine() == OutputEngine::GStreamer) {
+        return CompositorPipeline::build(config);
+    }
+    return config.getOutputPipeline();
+}
+
+}
+
 RtspServer::RtspServer(
     int argc,
     char** argv) {
 
     if (argc > 1) {
-        m_config = std::make_shared<RtspProxyConfig>(argv[1]);
-    } else {
-        m_config = std::make_shared<RtspProxyConfig>();
+        m_configFile = argv[1];
     }
+    m_config = std::make_shared<RtspProxyConfig>(m_configFile);
+
+    ThreadPlacement::report(m_config->getPlacement());
 
     gst_init(&argc, &argv);
 
+    m_reaper.reset(new Reaper());
+
     // Create an instance of the RTSP server
     m_server = gst_rtsp_server_new();
 
-    //g_object_set(m_server, "service", m_port.c_str(), NULL);
+    auto const& server = m_config->getServer();
+    gst_rtsp_server_set_service(
+        m_server, std::to_string(server.port).c_str());
+    gst_rtsp_server_set_backlog(m_server, server.backlog);
+
+    // serve each client from a pool thread with its own main context. One
+    // thread is the pool's own default, 0 keeps all clients in the main
+    // loop.
+    GstRTSPThreadPool* pool = gst_rtsp_server_get_thread_pool(m_server);
+    gst_rtsp_thread_pool_set_max_threads(pool, gint(server.threads));
+    g_object_unref(pool);
+
+    if (server.threads > 0) {
+        g_print("Serving RTSP clients from %u threads\n", server.threads);
+    } else {
+        g_print("Serving RTSP clients from the main loop\n");
+    }
+
     GstRTSPMountPoints* mounts = gst_rtsp_server_get_mount_points(m_server);
 
-    m_factory = gst_rtsp_media_factory_new();
+    // the factory tells the mosaic and the views of the mount point apart
+    m_factory = ViewMediaFactory::create(this);
 
-    gst_rtsp_media_factory_set_launch(
-        m_factory,
-        m_config->getOutputPipeline().c_str());
+    auto launch = getOutputLaunch(*m_config);
+    gst_rtsp_media_factory_set_launch(m_factory, launch.c_str());
 
     gst_rtsp_media_factory_set_shared(m_factory, TRUE);
 
+    g_signal_connect(
+        m_factory,
+        "media-constructed",
+        G_CALLBACK(&RtspServer::onConstructRtspMedia),
+        static_cast<gpointer>(this));
+
+    auto const& mcast = m_config->getOutputMulticast();
+    if (mcast.enabled) {
+        setupMulticast(mcast);
+    }
+
     auto id = g_signal_connect(
         m_server,
         "client-connected",
@@ -46,17 +113,142 @@ RtspServer::RtspServer(
         m_config->getOutputPath().c_str(),
         m_factory);
 
+    g_print("Added mount point '%s'\n", m_config->getOutputPath().c_str());
+    g_print("GStreamer pipeline is:\n\t'%s'\n", launch.c_str());
+
+    auto const& replay = m_config->getReplay();
+    if (replay.enabled) {
+        m_segmentRing.reset(new SegmentRing(replay));
+
+        // every replay client seeks on its own, so the media is not shared
+        m_replayFactory = gst_rtsp_media_factory_new();
+        gst_rtsp_media_factory_set_launch(
+            m_replayFactory, replay.pipeline.c_str());
+
+        g_signal_connect(
+            m_replayFactory,
+            "media-constructed",
+            G_CALLBACK(&RtspServer::onConstructReplayMedia),
+            static_cast<gpointer>(this));
+
+        gst_rtsp_mount_points_add_factory(
+            mounts, replay.path.c_str(), m_replayFactory);
+
+        g_print("Added replay mount point '%s'\n", replay.path.c_str());
+    }
+
     /* don't need the ref to the mapper anymore */
     g_object_unref(mounts);
 
-    g_print("Added mount point '%s'\n", m_config->getOutputPath().c_str());
-    g_print("GStreamer pipeline is:\n\t'%s'\n",
-        m_config->getOutputPipeline().c_str());
+    // the workers decode the cameras for all processors to come
+    if (m_config->getIngestWorkers().enabled) {
+        m_ingestSupervisor.reset(
+            new IngestSupervisor(m_configFile, m_config));
+    }
+
+    if (m_config->getAnalytics().enabled) {
+        m_analytics.reset(
+            new AnalyticsEngine(
+                m_config->getAnalytics(),
+                m_config->getPlacement().analytics));
+    }
+
+    auto const& http = m_config->getHttp();
+    if (http.enabled) {
+        m_snapshotCache.reset(new SnapshotCache(http.jpegQuality));
+        m_httpServer.reset(
+            new HttpServer(http.address, http.port, http.threads));
+
+        m_httpServer->addHandler(
+            "/snapshot.jpg",
+            [this](std::string const& query) {
+                return onSnapshotRequest(query);
+            });
+        m_httpServer->addHandler(
+            "/metrics",
+            [](std::string const&) {
+                return HttpResponse::text(
+                    200, ProxyMetrics::instance().format());
+            });
+        if (m_config->getTrace().enabled) {
+            m_httpServer->addHandler(
+                "/trace.json",
+                [](std::string const&) {
+                    auto res = HttpResponse::text(
+                        200, FrameTracer::instance().formatJson());
+                    res.contentType = "application/json";
+                    return res;
+                });
+        }
+        if (m_analytics) {
+            m_httpServer->addHandler(
+                "/analytics.json",
+                [this](std::string const&) {
+                    auto res = HttpResponse::text(
+                        200, m_analytics->formatJson());
+                    res.contentType = "application/json";
+                    return res;
+                });
+        }
+    }
+}
+
+void
+RtspServer::setupMulticast(MulticastConfig const& mcast)
+{
+    // the shared media sends every packet once to the group, no matter
+    // how many clients joined it
+    GstRTSPAddressPool* pool = gst_rtsp_address_pool_new();
+    if (not gst_rtsp_address_pool_add_range(
+            pool,
+            mcast.addressMin.c_str(),
+            mcast.addressMax.c_str(),
+            mcast.portMin,
+            mcast.portMax,
+            guint8(mcast.ttl))) {
+        g_object_unref(pool);
+        throw std::runtime_error(
+            "Invalid multicast range " + mcast.addressMin + " - " +
+            mcast.addressMax);
+    }
+    gst_rtsp_media_factory_set_address_pool(m_factory, pool);
+    g_object_unref(pool);
+
+    gst_rtsp_media_factory_set_max_mcast_ttl(m_factory, mcast.ttl);
+    if (not mcast.iface.empty()) {
+        gst_rtsp_media_factory_set_multicast_iface(
+            m_factory, mcast.iface.c_str());
+    }
+
+    int protocols = GST_RTSP_LOWER_TRANS_UDP_MCAST;
+    if (not mcast.only) {
+        protocols |= GST_RTSP_LOWER_TRANS_UDP | GST_RTSP_LOWER_TRANS_TCP;
+    }
+    gst_rtsp_media_factory_set_protocols(
+        m_factory, GstRTSPLowerTrans(protocols));
+
+    // SSM receivers join (source, group), the source is the address of the
+    // sending interface
+    bool ssm = mcast.addressMin.compare(0, 4, "232.") == 0;
+    g_print(
+        "Multicast output%s: %s - %s, ports %u - %u, ttl %u, %s%s\n",
+        mcast.only ? " only" : "",
+        mcast.addressMin.c_str(),
+        mcast.addressMax.c_str(),
+        mcast.portMin,
+        mcast.portMax,
+        mcast.ttl,
+        ssm ? "source-specific, source is the address of " :
+            "any-source",
+        ssm ? (mcast.iface.empty() ? "the default interface" :
+            mcast.iface.c_str()) : "");
 }
 
 void
 RtspServer::run()
 {
+    ThreadPlacement::apply("main-loop", m_config->getPlacement().main);
+
     // Create the main gstreamer loop
     auto loop = g_main_loop_new(NULL, FALSE);
 
@@ -67,6 +259,59 @@ RtspServer::run()
             "Is another instance already running?");
     }
 
+    g_timeout_add(
+        HEARTBEAT_MS,
+        reinterpret_cast<GSourceFunc>(&RtspServer::onHeartbeat),
+        this);
+
+    if (m_config->getMetricsReportInterval() > 0) {
+        g_timeout_add_seconds(
+            m_config->getMetricsReportInterval(),
+            reinterpret_cast<GSourceFunc>(&RtspServer::onMetricsReport),
+            this);
+    }
+
+    auto persistence = m_config->getServer().mediaPersistence;
+    if (persistence == MediaPersistence::Startup) {
+        preparePersistentMedia();
+    }
+
+    // reload the configuration on SIGHUP, and optionally on file changes
+    g_unix_signal_add(
+        SIGHUP,
+        reinterpret_cast<GSourceFunc>(&RtspServer::onReloadSignal),
+        this);
+
+    // write the frame trace on SIGUSR1
+    if (m_config->getTrace().enabled) {
+        g_unix_signal_add(
+            SIGUSR1,
+            reinterpret_cast<GSourceFunc>(&RtspServer::onTraceSignal),
+            this);
+    }
+
+    if (m_config->getConfigWatch()) {
+        GFile* file = g_file_new_for_path(m_configFile.c_str());
+        GError* err = nullptr;
+        m_configMonitor =
+            g_file_monitor_file(file, G_FILE_MONITOR_NONE, nullptr, &err);
+        g_object_unref(file);
+
+        if (not m_configMonitor) {
+            g_printerr(
+                "Failed to watch '%s': %s\n",
+                m_configFile.c_str(),
+                err ? err->message : "unknown error");
+            g_clear_error(&err);
+        } else {
+            g_signal_connect(
+                m_configMonitor,
+                "changed",
+                G_CALLBACK(&RtspServer::onConfigFileChanged),
+                static_cast<gpointer>(this));
+        }
+    }
+
     g_print("\nRtspServer started\n");
     g_main_loop_run(loop);
 
@@ -74,6 +319,237 @@ RtspServer::run()
     g_print("\nRtspServer STOPPED\n");
 }
 
+void
+RtspServer::preparePersistentMedia()
+{
+    // the media is looked up by the key of the URL clients use, it only
+    // depends on the port and the path
+    auto config = getConfig();
+    auto url = "rtsp://127.0.0.1:" + std::to_string(config->getServer().port) +
+        config->getOutputPath();
+
+    GstRTSPUrl* gstUrl = nullptr;
+    if (gst_rtsp_url_parse(url.c_str(), &gstUrl) != GST_RTSP_OK) {
+        g_printerr("Failed to parse '%s'\n", url.c_str());
+        return;
+    }
+    auto start = std::chrono::steady_clock::now();
+    GstRTSPMedia* media = gst_rtsp_media_factory_construct(m_factory, gstUrl);
+    gst_rtsp_url_free(gstUrl);
+    if (not media) {
+        g_printerr("Failed to construct the output media\n");
+        return;
+    }
+
+    // the media's bus is watched from a pool thread, like for a client
+    GstRTSPContext ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.server = m_server;
+    GstRTSPThreadPool* pool = gst_rtsp_server_get_thread_pool(m_server);
+    GstRTSPThread* thread = gst_rtsp_thread_pool_get_thread(
+        pool, GST_RTSP_THREAD_TYPE_MEDIA, &ctx);
+    g_object_unref(pool);
+
+    if (not thread || not gst_rtsp_media_prepare(media, thread)) {
+        g_printerr("Failed to prepare the output media\n");
+        g_object_unref(media);
+        return;
+    }
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    ProxyMetrics::instance().set("output.media_prepare_ms", elapsed.count());
+    g_print("Output media prepared in %.1f ms\n", elapsed.count());
+
+    std::lock_guard<std::mutex> lock(m_persistentMediaMutex);
+    m_persistentMedia = media;
+}
+
+void
+RtspServer::retainMedia(GstRTSPMedia* gstRtspMedia)
+{
+    // a media prepared at startup is replaced by the first one played
+    // after it was released
+    auto persistence = getConfig()->getServer().mediaPersistence;
+    if (persistence == MediaPersistence::None) {
+        return;
+    }
+
+    // only the mosaic media is kept, views come and go with their clients
+    bool mosaic =
+        g_object_get_data(G_OBJECT(gstRtspMedia), "rtsp-proxy-media") ||
+        g_object_get_data(G_OBJECT(gstRtspMedia), "rtsp-proxy-compositor");
+    if (not mosaic || ViewMediaFactory::getViewport(gstRtspMedia)) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_persistentMediaMutex);
+    if (m_persistentMedia) {
+        return;
+    }
+
+    // preparing a prepared media only counts one more user, it is then not
+    // unprepared when its last client leaves
+    if (gst_rtsp_media_prepare(gstRtspMedia, nullptr)) {
+        m_persistentMedia = GST_RTSP_MEDIA(g_object_ref(gstRtspMedia));
+        g_print("Output media is kept prepared\n");
+    }
+}
+
+void
+RtspServer::releasePersistentMedia()
+{
+    GstRTSPMedia* media = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_persistentMediaMutex);
+        std::swap(media, m_persistentMedia);
+    }
+    if (media) {
+        gst_rtsp_media_unprepare(media);
+        g_object_unref(media);
+    }
+}
+
+std::shared_ptr<RtspProxyProcessor>
+RtspServer::acquireProcessor()
+{
+    // media of different clients may be constructed in parallel, make sure
+    // they all get the same processor
+    std::lock_guard<std::mutex> lock(m_processorMutex);
+    auto processor = m_processor.lock();
+    if (not processor) {
+        processor = std::make_shared<RtspProxyProcessor>(
+            getConfig(), getSnapshotCache(), getAnalytics());
+        m_processor = processor;
+    }
+    return processor;
+}
+
+void
+RtspServer::reloadConfig()
+{
+    g_print("Reloading configuration '%s'...\n", m_configFile.c_str());
+
+    std::shared_ptr<RtspProxyConfig> config;
+    std::string launch;
+    try {
+        config = std::make_shared<RtspProxyConfig>(m_configFile);
+        launch = getOutputLaunch(*config);
+    } catch (std::exception const& e) {
+        g_printerr(
+            "Failed to reload configuration, keeping the current one: %s\n",
+            e.what());
+        return;
+    }
+
+    auto old = getConfig();
+    if (launch != getOutputLaunch(*old)) {
+        // running media keep their pipeline for their clients, new clients
+        // get a new media with the new pipeline. With the GStreamer engine
+        // that includes the cameras.
+        gst_rtsp_media_factory_set_launch(m_factory, launch.c_str());
+        ViewMediaFactory::evictMedia(m_factory);
+        g_print("Output pipeline changed, new sessions get a new media\n");
+
+        // the output queue of a processor has a single consumer, the new
+        // media get a processor of their own. The old one goes with the
+        // last of the old media.
+        {
+            std::lock_guard<std::mutex> lock(m_processorMutex);
+            m_processor.reset();
+        }
+
+        // the kept media would serve the old pipeline forever. A new one is
+        // kept from the next client on.
+        releasePersistentMedia();
+    }
+    if (config->getOutputPath() != old->getOutputPath() ||
+        config->getReplay().enabled != old->getReplay().enabled ||
+        config->getHttp().enabled != old->getHttp().enabled ||
+        config->getTrace().enabled != old->getTrace().enabled ||
+        config->getAnalytics().enabled != old->getAnalytics().enabled) {
+        g_printerr(
+            "WARNING: mount point, replay, HTTP, trace and analytics "
+            "settings require a restart\n");
+    }
+
+    if (config->getIngestWorkers().enabled !=
+        old->getIngestWorkers().enabled) {
+        g_printerr("WARNING: input_workers_enabled requires a restart\n");
+    } else if (m_ingestSupervisor &&
+        (config->getInputPipelines() != old->getInputPipelines() ||
+            config->getInputBackupPipelines() !=
+                old->getInputBackupPipelines() ||
+            config->getIngestWorkers().cameras !=
+                old->getIngestWorkers().cameras)) {
+        // workers load the configuration when they start, those whose
+        // cameras changed are restarted. The processor follows their rings
+        // as they come back.
+        m_ingestSupervisor->restart(config);
+    }
+
+    std::atomic_store(&m_config, config);
+
+    std::shared_ptr<RtspProxyProcessor> processor;
+    {
+        std::lock_guard<std::mutex> lock(m_processorMutex);
+        processor = m_processor.lock();
+    }
+    if (processor) {
+        processor->reconfigure(config);
+    }
+    ProxyMetrics::instance().add("config.reloads");
+}
+
+gboolean
+RtspServer::onReloadSignal(RtspServer* rtspProxyServer)
+{
+    rtspProxyServer->reloadConfig();
+    return G_SOURCE_CONTINUE;
+}
+
+gboolean
+RtspServer::onTraceSignal(RtspServer* rtspProxyServer)
+{
+    auto path = rtspProxyServer->getConfig()->getTrace().path;
+    if (FrameTracer::instance().writeJson(path)) {
+        g_print("Frame trace written to '%s'\n", path.c_str());
+    } else {
+        g_printerr("Failed to write the frame trace to '%s'\n", path.c_str());
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+void
+RtspServer::onConfigFileChanged(
+    GFileMonitor*,
+    GFile*,
+    GFile*,
+    GFileMonitorEvent event,
+    RtspServer* rtspProxyServer)
+{
+    if (event != G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT &&
+        event != G_FILE_MONITOR_EVENT_CREATED) {
+        return;
+    }
+
+    // editors write files in several steps, wait for them to settle
+    if (rtspProxyServer->m_reloadTimerId > 0) {
+        g_source_remove(rtspProxyServer->m_reloadTimerId);
+    }
+    rtspProxyServer->m_reloadTimerId = g_timeout_add(
+        500,
+        reinterpret_cast<GSourceFunc>(&RtspServer::onReloadTimer),
+        rtspProxyServer);
+}
+
+gboolean
+RtspServer::onReloadTimer(RtspServer* rtspProxyServer)
+{
+    rtspProxyServer->m_reloadTimerId = 0;
+    rtspProxyServer->reloadConfig();
+    return G_SOURCE_REMOVE;
+}
+
 void
 RtspServer::onClientConnected(GstRTSPServer*,
     GstRTSPClient* gstClient,
@@ -86,9 +562,16 @@ RtspServer::onClientConnected(GstRTSPServer*,
         reinterpret_cast<GCallback>(&RtspServer::onClientDisconnected),
         rtspProxyServer);
 
-    auto res = rtspProxyServer->m_clients.emplace(gstClient, client);
+    size_t numClients = 0;
+    bool res = false;
+    {
+        std::lock_guard<std::mutex> lock(rtspProxyServer->m_clientsMutex);
+        res = rtspProxyServer->m_clients.emplace(gstClient, client).second;
+        numClients = rtspProxyServer->m_clients.size();
+    }
+    ProxyMetrics::instance().set("server.clients", numClients);
 
-    g_print("client %p is added to the list: res=%d\n", gstClient, res.second);
+    g_print("client %p is added to the list: res=%d\n", gstClient, res);
 }
 
 void RtspServer::onClientDisconnected(GstRTSPClient* gstClient,
@@ -96,15 +579,187 @@ void RtspServer::onClientDisconnected(GstRTSPClient* gstClient,
 {
     g_printerr("Got a disconnect from client %p", gstClient);
 
-    auto it = rtspProxyServer->m_clients.find(gstClient);
-    if (it == rtspProxyServer->m_clients.end()) {
+    // clients close in their own pool threads, only the bookkeeping is
+    // done under the lock
+    RtspClient* client = nullptr;
+    size_t numClients = 0;
+    {
+        std::lock_guard<std::mutex> lock(rtspProxyServer->m_clientsMutex);
+        auto it = rtspProxyServer->m_clients.find(gstClient);
+        if (it != rtspProxyServer->m_clients.end()) {
+            client = it->second;
+            rtspProxyServer->m_clients.erase(it);
+        }
+        numClients = rtspProxyServer->m_clients.size();
+    }
+    ProxyMetrics::instance().set("server.clients", numClients);
+
+    if (not client) {
         g_printerr("Could not locate the disconnecting client!");
     } else {
-        g_print("deleting client %p\n", it->second);
-        delete it->second;
-        rtspProxyServer->m_clients.erase(it);
+        g_print("deleting client %p\n", client);
+        delete client;
         g_print("client disconnected.\n");
     }
 }
 
+void
+RtspServer::onConstructRtspMedia(
+    GstRTSPMediaFactory*,
+    GstRTSPMedia* gstRtspMedia,
+    RtspServer* rtspProxyServer)
+{
+    try {
+        auto config = rtspProxyServer->getConfig();
+        if (config->getOutputEngine() == OutputEngine::GStreamer) {
+            attachCompositor(gstRtspMedia, *config);
+            return;
+        }
+
+        // destroying a media may destroy the processor, which joins its
+        // threads and closes the cameras. That never runs on the thread
+        // releasing the last reference, often the main loop.
+        auto* reaper = rtspProxyServer->getReaper();
+        RtspMediaPtr media(
+            new RtspMedia(gstRtspMedia, rtspProxyServer),
+            [reaper](RtspMedia* m) { reaper->retire([m] { delete m; }); });
+
+        // the media is shared by all clients of the mosaic or of a view,
+        // and is used until the gstreamer media is finalized
+        g_object_set_data_full(
+            G_OBJECT(gstRtspMedia),
+            "rtsp-proxy-media",
+            new RtspMediaPtr(media),
+            [](gpointer data) {
+                auto* ptr = static_cast<RtspMediaPtr*>(data);
+                (*ptr)->detach();
+                delete ptr;
+            });
+    } catch (std::exception const& e) {
+        g_printerr("Failed to create media: %s\n", e.what());
+    }
+}
+
+void
+RtspServer::attachCompositor(
+    GstRTSPMedia* gstRtspMedia,
+    RtspProxyConfig const& config)
+{
+    GstElement* bin = gst_rtsp_media_get_element(gstRtspMedia);
+    GstElement* encoder = gst_bin_get_by_name(
+        GST_BIN(bin), config.getOutputEncoderName().c_str());
+    if (not encoder) {
+        fprintf(
+            stderr,
+            "WARNING: encoder '%s' not found in the output pipeline. The "
+            "output latency is not measured.\n",
+            config.getOutputEncoderName().c_str());
+        gst_object_unref(bin);
+        return;
+    }
+
+    // the mosaic has no processor, the latency from compose to encoded
+    // frame is measured by the compositor pads instead
+    GstPad* src = gst_element_get_static_pad(encoder, "src");
+    double latencyMs = 0.;
+    auto* compositor = new CompositorPipeline(
+        bin,
+        src,
+        [latencyMs](double ms) mutable {
+            latencyMs = (latencyMs > 0.) ? 0.9 * latencyMs + 0.1 * ms : ms;
+            ProxyMetrics::instance().set("output.frame_latency_ms", latencyMs);
+        });
+    gst_object_unref(src);
+    gst_object_unref(encoder);
+    gst_object_unref(bin);
+
+    g_object_set_data_full(
+        G_OBJECT(gstRtspMedia),
+        "rtsp-proxy-compositor",
+        compositor,
+        [](gpointer data) { delete static_cast<CompositorPipeline*>(data); });
+}
+
+void
+RtspServer::onConstructReplayMedia(
+    GstRTSPMediaFactory*,
+    GstRTSPMedia* gstRtspMedia,
+    RtspServer* rtspProxyServer)
+{
+    try {
+        auto* media =
+            new ReplayMedia(gstRtspMedia, *rtspProxyServer->m_segmentRing);
+
+        // the replay media lives as long as the gstreamer media
+        g_object_set_data_full(
+            G_OBJECT(gstRtspMedia),
+            "rtsp-proxy-replay-media",
+            media,
+            [](gpointer data) { delete static_cast<ReplayMedia*>(data); });
+    } catch (std::exception const& e) {
+        g_printerr("Failed to create replay media: %s\n", e.what());
+    }
+}
+
+HttpResponse
+RtspServer::onSnapshotRequest(std::string const& query)
+{
+    ProxyMetrics::instance().add("snapshot.requests");
+
+    HttpBody jpeg;
+    std::string cam;
+    if (HttpServer::getQueryParam(query, "cam", cam)) {
+        char* end = nullptr;
+        auto idx = strtoul(cam.c_str(), &end, 10);
+        if (cam.empty() || *end != '\0' ||
+            idx >= getConfig()->getInputPipelinesNum()) {
+            return HttpResponse::text(400, "invalid camera index\n");
+        }
+        jpeg = m_snapshotCache->getCameraJpeg(idx);
+    } else {
+        jpeg = m_snapshotCache->getOutputJpeg();
+    }
+
+    if (not jpeg) {
+        // frames are only produced while a client plays the output
+        return HttpResponse::text(503, "no frame available\n");
+    }
+
+    HttpResponse res;
+    res.contentType = "image/jpeg";
+    res.body = jpeg;
+    return res;
+}
+
+gboolean
+RtspServer::onHeartbeat(RtspServer* rtspProxyServer)
+{
+    auto now = std::chrono::steady_clock::now();
+    auto& last = rtspProxyServer->m_lastHeartbeat;
+
+    if (last != std::chrono::steady_clock::time_point()) {
+        double stallMs = std::chrono::duration<double, std::milli>(
+            now - last).count() - HEARTBEAT_MS;
+
+        auto& metrics = ProxyMetrics::instance();
+        if (stallMs > rtspProxyServer->m_maxStallMs) {
+            rtspProxyServer->m_maxStallMs = stallMs;
+            metrics.set("server.main_loop_stall_max_ms", stallMs);
+        }
+        if (stallMs >= STALL_MS) {
+            metrics.add("server.main_loop_stalls");
+            metrics.add("server.main_loop_stall_sec", stallMs / 1000.);
+        }
+    }
+    last = now;
+    return G_SOURCE_CONTINUE;
+}
+
+gboolean
+RtspServer::onMetricsReport(RtspServer*)
+{
+    g_print("Metrics:\n%s", ProxyMetrics::instance().format().c_str());
+    return G_SOURCE_CONTINUE;
+}
+
 } // end of namespace
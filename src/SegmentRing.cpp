@@ -0,0 +1,372 @@
+// System headers
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// Project headers
+#include <SegmentRing.hpp>
+#include <ProxyMetrics.hpp>
+
+namespace rtsp_proxy_server {
+
+namespace {
+
+/** header written in front of every record in a segment */
+struct RecordHeader {
+    uint32_t magic;
+    uint32_t flags;
+    uint64_t size;
+    uint64_t timestamp;
+};
+
+constexpr uint32_t RECORD_MAGIC = 0x52505859; // "RPXY"
+constexpr uint32_t RECORD_FLAG_KEYFRAME = 1;
+
+size_t
+alignRecord(size_t size)
+{
+    return (size + 7) & ~size_t(7);
+}
+
+uint64_t
+wallClockNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000ull + uint64_t(ts.tv_nsec);
+}
+
+}
+
+SegmentRing::SegmentRing(ReplayConfig const& config)
+    :
+    m_config(config),
+    m_queue(config.queueSize)
+{
+    if (mkdir(m_config.directory.c_str(), 0755) != 0 && errno != EEXIST) {
+        throw std::runtime_error(
+            "Failed to create replay directory '" + m_config.directory +
+            "': " + strerror(errno));
+    }
+
+    for (size_t i = 0; i < m_config.segmentCount; i++) {
+        std::unique_ptr<Segment> seg(new Segment());
+
+        char name[32];
+        snprintf(name, sizeof(name), "/segment-%03zu.bin", i);
+        std::string path = m_config.directory + name;
+
+        seg->fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (seg->fd < 0 ||
+            ftruncate(seg->fd, off_t(m_config.segmentSize)) != 0) {
+            throw std::runtime_error(
+                "Failed to create replay segment '" + path + "': " +
+                strerror(errno));
+        }
+
+        void* data = mmap(
+            nullptr,
+            m_config.segmentSize,
+            PROT_READ | PROT_WRITE,
+            MAP_SHARED,
+            seg->fd,
+            0);
+        if (data == MAP_FAILED) {
+            throw std::runtime_error(
+                "Failed to map replay segment '" + path + "': " +
+                strerror(errno));
+        }
+        seg->data = static_cast<uint8_t*>(data);
+
+        m_segments.push_back(std::move(seg));
+    }
+    m_segments[m_current]->generation = ++m_generation;
+
+    printf(
+        "Replay ring: %zu segments of %zu bytes in '%s'\n",
+        m_config.segmentCount,
+        m_config.segmentSize,
+        m_config.directory.c_str());
+
+    sem_init(&m_queueSemaphore, 0, 0);
+
+    m_running = true;
+    m_thread = std::thread(&SegmentRing::writerThread, this);
+}
+
+SegmentRing::~SegmentRing()
+{
+    m_running = false;
+    sem_post(&m_queueSemaphore);
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+
+    PendingRecord record;
+    while (m_queue.pop(record)) {
+        gst_buffer_unref(record.buffer);
+    }
+    sem_destroy(&m_queueSemaphore);
+
+    for (auto& seg : m_segments) {
+        if (seg->data) {
+            munmap(seg->data, m_config.segmentSize);
+        }
+        if (seg->fd >= 0) {
+            close(seg->fd);
+        }
+    }
+}
+
+void
+SegmentRing::push(GstBuffer* buf)
+{
+    PendingRecord record = { gst_buffer_ref(buf), wallClockNs() };
+    if (not m_queue.push(record)) {
+        gst_buffer_unref(buf);
+        m_queueDrops++;
+        return;
+    }
+    sem_post(&m_queueSemaphore);
+}
+
+void
+SegmentRing::setCaps(std::string const& caps)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_caps = caps;
+}
+
+std::string
+SegmentRing::getCaps() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_caps;
+}
+
+bool
+SegmentRing::getRange(uint64_t& first, uint64_t& last) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_keyframes.empty()) {
+        return false;
+    }
+    first = m_keyframes.front().timestamp;
+    last = m_lastTimestamp;
+    return true;
+}
+
+bool
+SegmentRing::seek(uint64_t timestamp, SegmentPosition& pos) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_keyframes.empty()) {
+        return false;
+    }
+
+    // keyframes are ordered by time, find the last one not after timestamp
+    auto it = m_keyframes.begin();
+    for (auto k = m_keyframes.begin(); k != m_keyframes.end(); ++k) {
+        if (k->timestamp > timestamp) {
+            break;
+        }
+        it = k;
+    }
+    pos = it->pos;
+    return true;
+}
+
+SegmentRing::ReadResult
+SegmentRing::read(
+    SegmentPosition& pos,
+    GstBuffer*& buf,
+    uint64_t& timestamp)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    Segment* seg = m_segments[pos.segment].get();
+    if (seg->generation != pos.generation) {
+        return ReadResult::LOST;
+    }
+
+    if (pos.offset >= seg->used) {
+        if (pos.segment == m_current) {
+            return ReadResult::WAIT;
+        }
+
+        // continue in the segment written after this one
+        size_t next = (pos.segment + 1) % m_segments.size();
+        if (m_segments[next]->generation != pos.generation + 1) {
+            return ReadResult::LOST;
+        }
+        pos.segment = next;
+        pos.generation++;
+        pos.offset = 0;
+
+        seg = m_segments[next].get();
+        if (pos.offset >= seg->used) {
+            return ReadResult::WAIT;
+        }
+    }
+
+    auto* header = reinterpret_cast<RecordHeader*>(seg->data + pos.offset);
+    if (header->magic != RECORD_MAGIC) {
+        return ReadResult::LOST;
+    }
+
+    // the segment can't be recycled while the buffer wrapping it is alive
+    seg->pins++;
+    lock.unlock();
+
+    buf = gst_buffer_new_wrapped_full(
+        GST_MEMORY_FLAG_READONLY,
+        seg->data + pos.offset + sizeof(RecordHeader),
+        header->size,
+        0,
+        header->size,
+        new SegmentPin{this, pos.segment},
+        &SegmentRing::onBufferReleased);
+
+    if (not (header->flags & RECORD_FLAG_KEYFRAME)) {
+        GST_BUFFER_FLAG_SET(buf, GST_BUFFER_FLAG_DELTA_UNIT);
+    }
+    timestamp = header->timestamp;
+
+    pos.offset += alignRecord(sizeof(RecordHeader) + header->size);
+    return ReadResult::OK;
+}
+
+void
+SegmentRing::waitForData(
+    SegmentPosition const& pos,
+    std::chrono::milliseconds timeout)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    Segment const* seg = m_segments[pos.segment].get();
+    if (seg->generation != pos.generation ||
+        pos.segment != m_current ||
+        pos.offset < seg->used) {
+        return;
+    }
+    m_dataWritten.wait_for(lock, timeout);
+}
+
+void
+SegmentRing::onBufferReleased(gpointer data)
+{
+    auto* pin = static_cast<SegmentPin*>(data);
+    pin->ring->m_segments[pin->segment]->pins--;
+    delete pin;
+}
+
+void
+SegmentRing::writerThread()
+{
+    while (m_running) {
+        sem_wait(&m_queueSemaphore);
+
+        PendingRecord record;
+        while (m_queue.pop(record)) {
+            writeRecord(record);
+            gst_buffer_unref(record.buffer);
+        }
+
+        // the live path only counts its drops, the metric is published here
+        ProxyMetrics::instance().set(
+            "replay.queue_dropped_frames", double(m_queueDrops));
+    }
+}
+
+void
+SegmentRing::writeRecord(PendingRecord const& record)
+{
+    auto& metrics = ProxyMetrics::instance();
+
+    size_t dataSize = gst_buffer_get_size(record.buffer);
+    size_t recordSize = alignRecord(sizeof(RecordHeader) + dataSize);
+    bool keyframe =
+        not GST_BUFFER_FLAG_IS_SET(record.buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+
+    if (recordSize > m_config.segmentSize) {
+        metrics.add("replay.dropped_frames");
+        m_waitKeyframe = true;
+        return;
+    }
+
+    // frames dropped by push() leave a gap as well
+    if (m_queueDrops != m_queueDropsSeen) {
+        m_queueDropsSeen = m_queueDrops;
+        m_waitKeyframe = true;
+    }
+
+    // after a gap the stream can only resume from a keyframe
+    if (m_waitKeyframe && not keyframe) {
+        metrics.add("replay.dropped_frames");
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    Segment* seg = m_segments[m_current].get();
+    if (seg->used + recordSize > m_config.segmentSize) {
+        size_t next = (m_current + 1) % m_segments.size();
+        Segment* nextSeg = m_segments[next].get();
+
+        // never wait for readers, drop the data instead
+        if (nextSeg->pins > 0) {
+            metrics.add("replay.dropped_frames");
+            m_waitKeyframe = true;
+            return;
+        }
+
+        // forget keyframes of the recycled segment, they are the oldest
+        while (not m_keyframes.empty() &&
+            m_keyframes.front().pos.segment == next) {
+            m_keyframes.pop_front();
+        }
+
+        nextSeg->generation = ++m_generation;
+        nextSeg->used = 0;
+        m_current = next;
+        seg = nextSeg;
+    }
+
+    size_t offset = seg->used;
+    uint64_t generation = seg->generation;
+    lock.unlock();
+
+    // readers only look at records below 'used', so the copy into the
+    // segment can be done without holding the lock
+    auto* header = reinterpret_cast<RecordHeader*>(seg->data + offset);
+    header->magic = RECORD_MAGIC;
+    header->flags = keyframe ? RECORD_FLAG_KEYFRAME : 0;
+    header->size = dataSize;
+    header->timestamp = record.timestamp;
+    gst_buffer_extract(
+        record.buffer, 0, seg->data + offset + sizeof(RecordHeader), dataSize);
+
+    lock.lock();
+    seg->used = offset + recordSize;
+    m_lastTimestamp = record.timestamp;
+    m_waitKeyframe = false;
+
+    if (keyframe) {
+        Keyframe k;
+        k.pos.segment = m_current;
+        k.pos.generation = generation;
+        k.pos.offset = offset;
+        k.timestamp = record.timestamp;
+        m_keyframes.push_back(k);
+    }
+    lock.unlock();
+
+    m_dataWritten.notify_all();
+    metrics.add("replay.written_bytes", double(recordSize));
+}
+
+} // end of namespace
@@ -0,0 +1,339 @@
+// System headers
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// STL headers
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <stdexcept>
+
+// Project headers
+#include <ShmFrameRing.hpp>
+
+namespace rtsp_proxy_server {
+
+namespace {
+
+/** "RPSR", marks an initialized ring */
+const uint32_t MAGIC = 0x52535052;
+
+/** layout version, changed whenever the structures below change */
+const uint32_t VERSION = 2;
+
+/** alignment of the headers and the frame data, one cache line */
+const size_t ALIGN = 64;
+
+static_assert(
+    ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2,
+    "atomics shared between processes must be lock free");
+
+/**
+ * \brief Start of a ring
+ */
+struct RingHeader {
+    /** MAGIC once the writer initialized the ring */
+    std::atomic<uint32_t> magic;
+
+    uint32_t version;
+
+    /** number of slots */
+    uint32_t slots;
+
+    /** process ID of the writer */
+    uint32_t writer;
+
+    /** room for frame data in each slot */
+    uint64_t slotSize;
+
+    /** bytes from one slot to the next, slot header included */
+    uint64_t slotStride;
+
+    /** sequence number of the newest frame, 0 before the first */
+    std::atomic<uint64_t> published;
+
+    /** set when the writer is gone */
+    std::atomic<uint32_t> closed;
+};
+
+/**
+ * \brief Start of a slot, followed by the frame data
+ */
+struct SlotHeader {
+    /** 2 * seq while the frame is readable, 2 * seq + 1 while written */
+    std::atomic<uint64_t> state;
+
+    uint64_t ptsNs;
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride;
+    uint32_t format;
+    uint64_t size;
+};
+
+size_t
+alignUp(size_t size)
+{
+    return (size + ALIGN - 1) / ALIGN * ALIGN;
+}
+
+const size_t HEADER_SIZE = alignUp(sizeof(RingHeader));
+const size_t SLOT_HEADER_SIZE = alignUp(sizeof(SlotHeader));
+
+RingHeader*
+getHeader(const uint8_t* base)
+{
+    return reinterpret_cast<RingHeader*>(const_cast<uint8_t*>(base));
+}
+
+SlotHeader*
+getSlot(const uint8_t* base, uint64_t seq)
+{
+    auto* header = getHeader(base);
+    auto offset = HEADER_SIZE + (seq % header->slots) * header->slotStride;
+    return reinterpret_cast<SlotHeader*>(const_cast<uint8_t*>(base) + offset);
+}
+
+std::runtime_error
+makeError(std::string const& what, std::string const& name)
+{
+    return std::runtime_error(
+        what + " '" + name + "': " + std::string(strerror(errno)));
+}
+
+/**
+ * \brief Tell the readers of a ring left under a name that it is closed
+ */
+void
+closeStale(std::string const& name)
+{
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd < 0) {
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && size_t(st.st_size) >= HEADER_SIZE) {
+        void* base = mmap(
+            nullptr, HEADER_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (base != MAP_FAILED) {
+            auto* header = static_cast<RingHeader*>(base);
+            if (header->magic.load(std::memory_order_acquire) == MAGIC) {
+                header->closed.store(1, std::memory_order_release);
+            }
+            munmap(base, HEADER_SIZE);
+        }
+    }
+    close(fd);
+}
+
+}
+
+void
+closeShmFrameRing(std::string const& name)
+{
+    closeStale(name);
+    shm_unlink(name.c_str());
+}
+
+ShmFrameWriter::ShmFrameWriter(
+    std::string const& name,
+    uint32_t slots,
+    size_t slotSize)
+    :
+    m_name(name),
+    m_slotSize(slotSize)
+{
+    if (slots < 2) {
+        throw std::runtime_error("a frame ring needs at least 2 slots");
+    }
+
+    // a previous writer may not have removed its ring, e.g. if it crashed
+    closeStale(m_name);
+    shm_unlink(m_name.c_str());
+
+    m_fd = shm_open(m_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (m_fd < 0) {
+        throw makeError("Failed to create shared memory", m_name);
+    }
+
+    auto slotStride = SLOT_HEADER_SIZE + alignUp(slotSize);
+    m_mapSize = HEADER_SIZE + slotStride * slots;
+
+    // the new memory is zeroed: no frame is published, all slots are empty
+    void* base = MAP_FAILED;
+    if (ftruncate(m_fd, off_t(m_mapSize)) == 0) {
+        base = mmap(
+            nullptr, m_mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    }
+    if (base == MAP_FAILED) {
+        auto error = makeError("Failed to map shared memory", m_name);
+        close(m_fd);
+        shm_unlink(m_name.c_str());
+        throw error;
+    }
+    m_base = static_cast<uint8_t*>(base);
+
+    auto* header = new (m_base) RingHeader();
+    header->version = VERSION;
+    header->slots = slots;
+    header->writer = uint32_t(getpid());
+    header->slotSize = slotSize;
+    header->slotStride = slotStride;
+    header->published.store(0);
+    header->closed.store(0);
+
+    // readers check the magic before anything else
+    header->magic.store(MAGIC, std::memory_order_release);
+}
+
+ShmFrameWriter::~ShmFrameWriter()
+{
+    getHeader(m_base)->closed.store(1, std::memory_order_release);
+    munmap(m_base, m_mapSize);
+
+    // the name may already belong to the ring of a newer writer
+    int fd = shm_open(m_name.c_str(), O_RDONLY, 0);
+    if (fd >= 0) {
+        struct stat ours;
+        struct stat named;
+        if (fstat(m_fd, &ours) == 0 && fstat(fd, &named) == 0 &&
+            ours.st_ino == named.st_ino) {
+            shm_unlink(m_name.c_str());
+        }
+        close(fd);
+    }
+    close(m_fd);
+}
+
+uint64_t
+ShmFrameWriter::write(ShmFrame const& frame)
+{
+    if (frame.size > m_slotSize) {
+        return 0;
+    }
+
+    auto seq = ++m_seq;
+    auto* slot = getSlot(m_base, seq);
+
+    // readers of the frame previously in this slot see it change
+    slot->state.store(2 * seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot->ptsNs = frame.ptsNs;
+    slot->width = frame.width;
+    slot->height = frame.height;
+    slot->stride = frame.stride;
+    slot->format = frame.format;
+    slot->size = frame.size;
+    memcpy(
+        reinterpret_cast<uint8_t*>(slot) + SLOT_HEADER_SIZE,
+        frame.data,
+        frame.size);
+
+    slot->state.store(2 * seq, std::memory_order_release);
+    getHeader(m_base)->published.store(seq, std::memory_order_release);
+    return seq;
+}
+
+ShmFrameReader::ShmFrameReader(std::string const& name)
+{
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        throw makeError("Failed to open shared memory", name);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || size_t(st.st_size) < HEADER_SIZE) {
+        close(fd);
+        throw std::runtime_error("'" + name + "' is not a frame ring");
+    }
+    m_mapSize = size_t(st.st_size);
+
+    void* base = mmap(nullptr, m_mapSize, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        throw makeError("Failed to map shared memory", name);
+    }
+    m_base = static_cast<const uint8_t*>(base);
+
+    auto* header = getHeader(m_base);
+    bool valid =
+        header->magic.load(std::memory_order_acquire) == MAGIC &&
+        header->version == VERSION &&
+        header->slots >= 2 &&
+        HEADER_SIZE + header->slots * header->slotStride <= m_mapSize;
+    if (not valid) {
+        munmap(const_cast<uint8_t*>(m_base), m_mapSize);
+        throw std::runtime_error(
+            "'" + name + "' is not a frame ring of this version");
+    }
+}
+
+ShmFrameReader::~ShmFrameReader()
+{
+    munmap(const_cast<uint8_t*>(m_base), m_mapSize);
+}
+
+bool
+ShmFrameReader::next(ShmFrame& frame)
+{
+    auto* header = getHeader(m_base);
+    auto seq = header->published.load(std::memory_order_acquire);
+    if (seq == 0 || seq == m_seq) {
+        return false;
+    }
+
+    auto* slot = getSlot(m_base, seq);
+    auto state = slot->state.load(std::memory_order_acquire);
+    if (state != 2 * seq) {
+        return false;
+    }
+
+    frame.seq = seq;
+    frame.ptsNs = slot->ptsNs;
+    frame.width = slot->width;
+    frame.height = slot->height;
+    frame.stride = slot->stride;
+    frame.format = slot->format;
+    frame.size = size_t(std::min<uint64_t>(slot->size, header->slotSize));
+    frame.data = reinterpret_cast<const uint8_t*>(slot) + SLOT_HEADER_SIZE;
+
+    // the frame header is only valid if the slot wasn't rewritten meanwhile
+    if (not isIntact(frame)) {
+        return false;
+    }
+
+    if (m_seq > 0 && seq > m_seq + 1) {
+        m_skipped += seq - m_seq - 1;
+    }
+    m_seq = seq;
+    return true;
+}
+
+bool
+ShmFrameReader::isIntact(ShmFrame const& frame) const
+{
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return getSlot(m_base, frame.seq)->state.load(
+        std::memory_order_relaxed) == 2 * frame.seq;
+}
+
+bool
+ShmFrameReader::isClosed() const
+{
+    return getHeader(m_base)->closed.load(std::memory_order_acquire) != 0;
+}
+
+bool
+ShmFrameReader::isWriterAlive() const
+{
+    // EPERM means the process exists but belongs to another user
+    auto pid = pid_t(getHeader(m_base)->writer);
+    return kill(pid, 0) == 0 || errno != ESRCH;
+}
+
+} // end of namespace
@@ -0,0 +1,94 @@
+// STL headers
+#include <cstdio>
+#include <stdexcept>
+
+// Project headers
+#include <ShmOutput.hpp>
+#include <ProxyMetrics.hpp>
+
+namespace rtsp_proxy_server {
+
+ShmOutput::ShmOutput(ShmOutputConfig const& config)
+    :
+    m_config(config)
+{
+    m_output.name = m_config.name + "-mosaic";
+}
+
+void
+ShmOutput::publishOutput(
+    cv::Mat const& frame,
+    std::chrono::steady_clock::time_point time)
+{
+    if (publish(m_output, frame, time)) {
+        ProxyMetrics::instance().add("shm.output_frames");
+    }
+}
+
+void
+ShmOutput::publishCamera(
+    size_t cam,
+    cv::Mat const& frame,
+    std::chrono::steady_clock::time_point time)
+{
+    if (not m_config.cameras) {
+        return;
+    }
+    while (m_cameras.size() <= cam) {
+        Ring ring;
+        ring.name = m_config.name + "-cam" + std::to_string(m_cameras.size());
+        m_cameras.push_back(std::move(ring));
+    }
+    if (publish(m_cameras[cam], frame, time)) {
+        ProxyMetrics::instance().add("shm.camera_frames");
+    }
+}
+
+bool
+ShmOutput::publish(
+    Ring& ring,
+    cv::Mat const& frame,
+    std::chrono::steady_clock::time_point time)
+{
+    if (ring.failed || frame.empty() || frame.type() != CV_8UC3) {
+        return false;
+    }
+
+    // rows are published back to back
+    cv::Mat packed = frame.isContinuous() ? frame : frame.clone();
+    size_t size = packed.total() * packed.elemSize();
+
+    if (not ring.writer || ring.writer->getSlotSize() < size) {
+        // readers of a replaced ring see it closed, and open the new one
+        ring.writer.reset();
+        try {
+            ring.writer.reset(
+                new ShmFrameWriter(ring.name, m_config.slots, size));
+        } catch (std::runtime_error const& e) {
+            fprintf(stderr, "Shared memory output disabled: %s\n", e.what());
+            ring.failed = true;
+            return false;
+        }
+        printf(
+            "Publishing %dx%d frames into shared memory '%s'\n",
+            packed.cols,
+            packed.rows,
+            ring.name.c_str());
+        fflush(stdout);
+    }
+
+    ShmFrame out;
+    out.ptsNs = uint64_t(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            time.time_since_epoch()).count());
+    out.width = uint32_t(packed.cols);
+    out.height = uint32_t(packed.rows);
+    out.stride = uint32_t(packed.cols * packed.elemSize());
+    out.format = SHM_FORMAT_BGR;
+    out.data = packed.data;
+    out.size = size;
+
+    return ring.writer->write(out) != 0;
+}
+
+} // end of namespace
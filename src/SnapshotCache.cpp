@@ -0,0 +1,74 @@
+// Open CV headers
+#include <opencv2/imgcodecs/imgcodecs.hpp>  // cv::imencode
+
+// Project headers
+#include <SnapshotCache.hpp>
+#include <ProxyMetrics.hpp>
+
+namespace rtsp_proxy_server {
+
+constexpr size_t SnapshotCache::OUTPUT;
+
+SnapshotCache::SnapshotCache(int jpegQuality)
+    :
+    m_jpegQuality(jpegQuality)
+{
+}
+
+SnapshotCache::Source&
+SnapshotCache::getSource(size_t id)
+{
+    std::lock_guard<std::mutex> lock(m_sourcesMutex);
+    auto& src = m_sources[id];
+    if (not src) {
+        src.reset(new Source());
+    }
+    return *src;
+}
+
+void
+SnapshotCache::publish(size_t id, CvMatPtr const& frame)
+{
+    auto& src = getSource(id);
+
+    std::lock_guard<std::mutex> lock(src.frameMutex);
+    src.frame = frame;
+    src.generation++;
+}
+
+HttpBody
+SnapshotCache::getJpeg(size_t id)
+{
+    auto& src = getSource(id);
+
+    CvMatPtr frame;
+    uint64_t generation = 0;
+    {
+        std::lock_guard<std::mutex> lock(src.frameMutex);
+        frame = src.frame;
+        generation = src.generation;
+    }
+    if (not frame || frame->empty()) {
+        return HttpBody();
+    }
+
+    // requests racing for the same generation queue up here and reuse the
+    // JPEG encoded by the first one
+    std::lock_guard<std::mutex> lock(src.jpegMutex);
+    if (src.jpeg && src.jpegGeneration >= generation) {
+        return src.jpeg;
+    }
+
+    auto jpeg = std::make_shared<std::vector<uint8_t>>();
+    std::vector<int> params = { cv::IMWRITE_JPEG_QUALITY, m_jpegQuality };
+    if (not cv::imencode(".jpg", *frame, *jpeg, params)) {
+        return HttpBody();
+    }
+    ProxyMetrics::instance().add("snapshot.encodes");
+
+    src.jpeg = jpeg;
+    src.jpegGeneration = generation;
+    return src.jpeg;
+}
+
+} // end of namespace
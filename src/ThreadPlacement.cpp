@@ -0,0 +1,358 @@
+// System headers
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// STL headers
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+// Project headers
+#include <ThreadPlacement.hpp>
+
+namespace rtsp_proxy_server {
+
+#define DEBUG_THREAD_PLACEMENT 0
+
+namespace {
+
+// memory policy constants from <numaif.h>, so we don't depend on libnuma
+constexpr int NUMA_MPOL_PREFERRED = 1;
+constexpr unsigned NUMA_MPOL_MF_MOVE = 1 << 1;
+
+int
+getPolicy(std::string const& name)
+{
+    if (name == "fifo") {
+        return SCHED_FIFO;
+    } else if (name == "rr") {
+        return SCHED_RR;
+    } else if (name == "batch") {
+        return SCHED_BATCH;
+    } else if (name == "idle") {
+        return SCHED_IDLE;
+    }
+    return SCHED_OTHER;
+}
+
+const char*
+getPolicyName(int policy)
+{
+    switch (policy) {
+        case SCHED_FIFO: return "fifo";
+        case SCHED_RR: return "rr";
+        case SCHED_BATCH: return "batch";
+        case SCHED_IDLE: return "idle";
+        default: return "other";
+    }
+}
+
+pid_t
+getTid()
+{
+    return pid_t(syscall(SYS_gettid));
+}
+
+/**
+ * \brief Get the CPUs of each NUMA node. Empty if the host doesn't expose
+ *        its NUMA topology.
+ */
+std::vector<cpu_set_t>
+getNumaNodes()
+{
+    std::vector<cpu_set_t> nodes;
+    for (int node = 0; ; node++) {
+        auto path = "/sys/devices/system/node/node" +
+            std::to_string(node) + "/cpulist";
+        FILE* f = fopen(path.c_str(), "r");
+        if (not f) {
+            break;
+        }
+        char buf[1024] = {0};
+        if (not fgets(buf, sizeof(buf), f)) {
+            buf[0] = '\0';
+        }
+        fclose(f);
+        buf[strcspn(buf, "\n")] = '\0';
+
+        cpu_set_t cpus;
+        if (not ThreadPlacement::parseCpuList(buf, cpus)) {
+            CPU_ZERO(&cpus);
+        }
+        nodes.push_back(cpus);
+    }
+    return nodes;
+}
+
+}
+
+bool
+ThreadPlacement::parseCpuList(std::string const& list, cpu_set_t& cpus)
+{
+    CPU_ZERO(&cpus);
+
+    size_t pos = 0;
+    while (pos < list.size()) {
+        auto end = list.find(',', pos);
+        if (end == std::string::npos) {
+            end = list.size();
+        }
+        auto range = list.substr(pos, end - pos);
+        pos = end + 1;
+
+        char* next = nullptr;
+        long first = strtol(range.c_str(), &next, 10);
+        long last = first;
+        if (next == range.c_str()) {
+            return false;
+        }
+        if (*next == '-') {
+            const char* lastStr = next + 1;
+            last = strtol(lastStr, &next, 10);
+            if (next == lastStr) {
+                return false;
+            }
+        }
+        while (*next == ' ') {
+            next++;
+        }
+        if (*next != '\0' || first < 0 || last < first ||
+            last >= CPU_SETSIZE) {
+            return false;
+        }
+        for (long cpu = first; cpu <= last; cpu++) {
+            CPU_SET(int(cpu), &cpus);
+        }
+    }
+    return CPU_COUNT(&cpus) > 0;
+}
+
+std::string
+ThreadPlacement::formatCpuList(cpu_set_t const& cpus)
+{
+    std::string list;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (not CPU_ISSET(cpu, &cpus)) {
+            continue;
+        }
+        int last = cpu;
+        while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, &cpus)) {
+            last++;
+        }
+        if (not list.empty()) {
+            list += ",";
+        }
+        list += std::to_string(cpu);
+        if (last > cpu) {
+            list += "-" + std::to_string(last);
+        }
+        cpu = last;
+    }
+    return list;
+}
+
+void
+ThreadPlacement::apply(std::string const& name, ThreadRoleConfig const& role)
+{
+    pthread_t self = pthread_self();
+
+    // the main thread's name is the process name, keep it for pidof & co
+    if (getTid() != getpid()) {
+        pthread_setname_np(self, name.substr(0, 15).c_str());
+    }
+
+    if (not role.cpus.empty()) {
+        cpu_set_t cpus;
+        int rc = parseCpuList(role.cpus, cpus) ?
+            pthread_setaffinity_np(self, sizeof(cpus), &cpus) : EINVAL;
+        if (rc != 0) {
+            fprintf(
+                stderr,
+                "WARNING: thread '%s': failed to set CPUs '%s': %s\n",
+                name.c_str(), role.cpus.c_str(), strerror(rc));
+        }
+    }
+
+    int policy = getPolicy(role.policy);
+    if (policy != SCHED_OTHER) {
+        struct sched_param param;
+        memset(&param, 0, sizeof(param));
+        if (policy == SCHED_FIFO || policy == SCHED_RR) {
+            param.sched_priority = role.priority;
+        }
+        int rc = pthread_setschedparam(self, policy, &param);
+        if (rc != 0) {
+            fprintf(
+                stderr,
+                "WARNING: thread '%s': failed to set policy '%s': %s\n",
+                name.c_str(), role.policy.c_str(), strerror(rc));
+        }
+    }
+
+    // on Linux the nice value is per thread
+    if (role.nice != 0 && policy != SCHED_FIFO && policy != SCHED_RR) {
+        if (setpriority(PRIO_PROCESS, id_t(getTid()), role.nice) != 0) {
+            fprintf(
+                stderr,
+                "WARNING: thread '%s': failed to set nice %d: %s\n",
+                name.c_str(), role.nice, strerror(errno));
+        }
+    }
+
+    //
+    // report what we actually got
+    //
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    pthread_getaffinity_np(self, sizeof(cpus), &cpus);
+
+    int actualPolicy = SCHED_OTHER;
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    pthread_getschedparam(self, &actualPolicy, &param);
+
+    int nice = getpriority(PRIO_PROCESS, id_t(getTid()));
+
+    ThreadRoleConfig actual;
+    actual.cpus = formatCpuList(cpus);
+
+    printf(
+        "Thread '%s' (tid %d): cpus %s, node %d, policy %s, priority %d, "
+        "nice %d\n",
+        name.c_str(),
+        int(getTid()),
+        actual.cpus.c_str(),
+        getNumaNode(actual),
+        getPolicyName(actualPolicy),
+        param.sched_priority,
+        nice);
+    fflush(stdout);
+}
+
+int
+ThreadPlacement::getNumaNode(ThreadRoleConfig const& role)
+{
+    cpu_set_t cpus;
+    if (role.cpus.empty() || not parseCpuList(role.cpus, cpus)) {
+        return -1;
+    }
+
+    auto nodes = getNumaNodes();
+    for (size_t node = 0; node < nodes.size(); node++) {
+        cpu_set_t common;
+        CPU_AND(&common, &cpus, &nodes[node]);
+        if (CPU_EQUAL(&common, &cpus)) {
+            return int(node);
+        }
+    }
+    return -1;
+}
+
+void
+ThreadPlacement::bindToNode(void* addr, size_t size, int node)
+{
+    if (node < 0 || node >= int(sizeof(unsigned long) * 8 - 1) ||
+        size == 0) {
+        return;
+    }
+
+    // mbind works on whole pages
+    auto pageSize = uintptr_t(sysconf(_SC_PAGESIZE));
+    auto start = reinterpret_cast<uintptr_t>(addr) & ~(pageSize - 1);
+    auto end = (reinterpret_cast<uintptr_t>(addr) + size + pageSize - 1) &
+        ~(pageSize - 1);
+
+    unsigned long mask = 1UL << node;
+    long rc = syscall(
+        SYS_mbind,
+        start,
+        end - start,
+        NUMA_MPOL_PREFERRED,
+        &mask,
+        sizeof(mask) * 8,
+        NUMA_MPOL_MF_MOVE);
+
+    static std::atomic<bool> warned(false);
+    if (rc != 0 && not warned.exchange(true)) {
+        fprintf(
+            stderr,
+            "WARNING: failed to bind frame buffers to NUMA node %d: %s\n",
+            node, strerror(errno));
+    }
+    #if DEBUG_THREAD_PLACEMENT
+        else if (rc == 0) {
+            printf("bound %zu bytes at %p to node %d\n", size, addr, node);
+        }
+    #endif
+}
+
+void
+ThreadPlacement::report(PlacementConfig const& placement)
+{
+    cpu_set_t online;
+    CPU_ZERO(&online);
+    sched_getaffinity(0, sizeof(online), &online);
+
+    printf("Thread placement:\n");
+    auto nodes = getNumaNodes();
+    for (size_t node = 0; node < nodes.size(); node++) {
+        printf(
+            "  NUMA node %zu: cpus %s\n",
+            node, formatCpuList(nodes[node]).c_str());
+    }
+
+    struct {
+        const char* name;
+        ThreadRoleConfig const& role;
+    } roles[] = {
+        { "main", placement.main },
+        { "input", placement.input },
+        { "processor", placement.processor },
+        { "output", placement.output },
+        { "analytics", placement.analytics },
+    };
+
+    for (auto const& r : roles) {
+        if (not r.role.cpus.empty()) {
+            cpu_set_t cpus;
+            cpu_set_t usable;
+            bool valid = parseCpuList(r.role.cpus, cpus);
+            CPU_AND(&usable, &cpus, &online);
+            if (not valid || CPU_COUNT(&usable) == 0) {
+                throw std::runtime_error(
+                    std::string("Invalid config. placement_") + r.name +
+                    "_cpus '" + r.role.cpus + "' has no usable CPU");
+            }
+        }
+
+        printf(
+            "  %-9s cpus %s, node %d, policy %s, priority %d, nice %d\n",
+            r.name,
+            r.role.cpus.empty() ? "all" : r.role.cpus.c_str(),
+            getNumaNode(r.role),
+            r.role.policy.c_str(),
+            r.role.priority,
+            r.role.nice);
+    }
+
+    if (placement.numaFrameBuffers) {
+        int node = getNumaNode(placement.processor);
+        if (node < 0) {
+            fprintf(
+                stderr,
+                "WARNING: placement_processor_cpus don't belong to one NUMA "
+                "node, camera frames are not bound to a node\n");
+        } else {
+            printf("  camera frames are allocated on node %d\n", node);
+        }
+    }
+    fflush(stdout);
+}
+
+} // end of namespace
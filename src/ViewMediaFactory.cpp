@@ -0,0 +1,218 @@
+// Project headers
+#include <ViewMediaFactory.hpp>
+#include <RtspServer.hpp>
+#include <ProxyMetrics.hpp>
+
+namespace rtsp_proxy_server {
+
+#define DEBUG_VIEW_MEDIA_FACTORY 0
+
+//
+// GObject subclass of GstRTSPMediaFactory, overriding how shared media are
+// looked up and how their pipelines are created
+//
+struct ProxyViewFactory {
+    GstRTSPMediaFactory parent;
+
+    /** server providing the configuration */
+    RtspServer* server;
+
+    /** number of view media alive, updated atomically */
+    gint views;
+
+    /**
+     * part of every media key, bumped to keep new clients off the media
+     * created so far. Updated atomically.
+     */
+    gint generation;
+};
+
+struct ProxyViewFactoryClass {
+    GstRTSPMediaFactoryClass parent;
+};
+
+G_DEFINE_TYPE(
+    ProxyViewFactory, proxy_view_factory, GST_TYPE_RTSP_MEDIA_FACTORY)
+
+namespace {
+
+/** key of the view attached to the element of a view media */
+const char* VIEW_DATA = "rtsp-proxy-viewport";
+
+struct ViewData {
+    Viewport viewport;
+    ProxyViewFactory* factory = nullptr;
+};
+
+/**
+ * \brief Release a view when its media is gone
+ */
+void
+releaseView(gpointer data)
+{
+    auto view = static_cast<ViewData*>(data);
+    auto views = g_atomic_int_add(&view->factory->views, -1) - 1;
+    ProxyMetrics::instance().set("output.views", views);
+
+    g_object_unref(view->factory);
+    delete view;
+}
+
+/**
+ * \brief Get the view requested by a URL
+ *
+ * \return false if the view is invalid, or views are disabled
+ */
+bool
+getUrlViewport(
+    ProxyViewFactory* factory,
+    const GstRTSPUrl* url,
+    Viewport& viewport)
+{
+    auto config = factory->server->getConfig();
+
+    std::string error;
+    if (not Viewport::parse(
+            url->query ? url->query : "", *config, viewport, error)) {
+        g_printerr("Rejected view '%s': %s\n", url->query, error.c_str());
+        return false;
+    }
+    if (not viewport.isMosaic() && not config->getView().enabled) {
+        g_printerr(
+            "Rejected view '%s': output_view_enabled is false\n",
+            url->query);
+        return false;
+    }
+    return true;
+}
+
+gchar*
+genKey(GstRTSPMediaFactory* factory, const GstRTSPUrl* url)
+{
+    Viewport viewport;
+    if (not getUrlViewport(
+            reinterpret_cast<ProxyViewFactory*>(factory), url, viewport)) {
+        // no key, no media: the client gets an error
+        return nullptr;
+    }
+
+    // the default key is the whole URL, so every spelling of a view, and
+    // any unrelated parameter, would get its own media
+    auto key = std::to_string(url->port) + url->abspath;
+    if (not viewport.isMosaic()) {
+        key += "?" + viewport.getKey();
+    }
+    auto self = reinterpret_cast<ProxyViewFactory*>(factory);
+    key += "#" + std::to_string(g_atomic_int_get(&self->generation));
+    #if DEBUG_VIEW_MEDIA_FACTORY
+        printf("media key of '%s': '%s'\n", url->query, key.c_str());
+    #endif
+    return g_strdup(key.c_str());
+}
+
+GstElement*
+createElement(GstRTSPMediaFactory* factory, const GstRTSPUrl* url)
+{
+    auto self = reinterpret_cast<ProxyViewFactory*>(factory);
+
+    Viewport viewport;
+    if (not getUrlViewport(self, url, viewport)) {
+        return nullptr;
+    }
+    if (viewport.isMosaic()) {
+        return GST_RTSP_MEDIA_FACTORY_CLASS(
+            proxy_view_factory_parent_class)->create_element(factory, url);
+    }
+
+    auto config = self->server->getConfig();
+
+    // every view has its own encoder, cap how many run at the same time
+    auto views = g_atomic_int_add(&self->views, 1) + 1;
+    if (views > gint(config->getView().maxViews)) {
+        g_atomic_int_add(&self->views, -1);
+        g_printerr(
+            "Rejected view '%s': output_view_max %u views are streamed\n",
+            viewport.getKey().c_str(),
+            config->getView().maxViews);
+        return nullptr;
+    }
+
+    // a plain bin like the default create_element makes, the media puts it
+    // into its own pipeline
+    GError* err = nullptr;
+    GstElement* element = gst_parse_launch_full(
+        config->getView().pipeline.c_str(),
+        nullptr,
+        GST_PARSE_FLAG_PLACE_IN_BIN,
+        &err);
+    if (not element) {
+        g_atomic_int_add(&self->views, -1);
+        g_printerr(
+            "Failed to create view '%s': %s\n",
+            viewport.getKey().c_str(),
+            err ? err->message : "unknown error");
+        g_clear_error(&err);
+        return nullptr;
+    }
+    g_clear_error(&err);
+
+    auto view = new ViewData();
+    view->viewport = viewport;
+    view->factory = self;
+    g_object_ref(self);
+
+    // the view is released with the media owning the element
+    g_object_set_data_full(G_OBJECT(element), VIEW_DATA, view, &releaseView);
+
+    ProxyMetrics::instance().set("output.views", views);
+    g_print("Created view '%s'\n", viewport.getKey().c_str());
+    return element;
+}
+
+}
+
+static void
+proxy_view_factory_class_init(ProxyViewFactoryClass* klass)
+{
+    auto factoryClass = GST_RTSP_MEDIA_FACTORY_CLASS(klass);
+    factoryClass->gen_key = &genKey;
+    factoryClass->create_element = &createElement;
+}
+
+static void
+proxy_view_factory_init(ProxyViewFactory* factory)
+{
+    factory->server = nullptr;
+    factory->views = 0;
+    factory->generation = 0;
+}
+
+GstRTSPMediaFactory*
+ViewMediaFactory::create(RtspServer* server)
+{
+    auto factory = static_cast<ProxyViewFactory*>(
+        g_object_new(proxy_view_factory_get_type(), nullptr));
+    factory->server = server;
+    return GST_RTSP_MEDIA_FACTORY(factory);
+}
+
+Viewport const*
+ViewMediaFactory::getViewport(GstRTSPMedia* media)
+{
+    GstElement* element = gst_rtsp_media_get_element(media);
+    auto view = static_cast<ViewData*>(
+        g_object_get_data(G_OBJECT(element), VIEW_DATA));
+    gst_object_unref(element);
+
+    // the media keeps the element and its view alive
+    return view ? &view->viewport : nullptr;
+}
+
+void
+ViewMediaFactory::evictMedia(GstRTSPMediaFactory* factory)
+{
+    auto self = reinterpret_cast<ProxyViewFactory*>(factory);
+    g_atomic_int_inc(&self->generation);
+}
+
+} // end of namespace
@@ -0,0 +1,105 @@
+// System headers
+#include <stdlib.h>
+
+// Project headers
+#include <Viewport.hpp>
+#include <HttpServer.hpp>
+
+namespace rtsp_proxy_server {
+
+namespace {
+
+/**
+ * \brief Parse a non negative decimal number, the whole string must match
+ */
+bool
+parseNumber(std::string const& str, int& value)
+{
+    if (str.empty() || str[0] < '0' || str[0] > '9') {
+        return false;
+    }
+    char* end = nullptr;
+    long v = strtol(str.c_str(), &end, 10);
+    if (*end != '\0' || v > 0x7fffffff) {
+        return false;
+    }
+    value = int(v);
+    return true;
+}
+
+}
+
+std::string
+Viewport::getKey() const
+{
+    if (cam >= 0) {
+        return "cam=" + std::to_string(cam);
+    }
+    if (roi.area() > 0) {
+        return "roi=" + std::to_string(roi.x) + "," + std::to_string(roi.y) +
+            "," + std::to_string(roi.width) + "," +
+            std::to_string(roi.height);
+    }
+    return "";
+}
+
+bool
+Viewport::parse(
+    std::string const& query,
+    RtspProxyConfig const& config,
+    Viewport& viewport,
+    std::string& error)
+{
+    viewport = Viewport();
+
+    std::string cam;
+    std::string roi;
+    bool haveCam = HttpServer::getQueryParam(query, "cam", cam);
+    bool haveRoi = HttpServer::getQueryParam(query, "roi", roi);
+
+    if (haveCam && haveRoi) {
+        error = "only one of 'cam' and 'roi' can be set";
+        return false;
+    }
+
+    if (haveCam) {
+        int idx = 0;
+        if (not parseNumber(cam, idx) ||
+            size_t(idx) >= config.getInputPipelinesNum()) {
+            error = "invalid camera index '" + cam + "'";
+            return false;
+        }
+        viewport.cam = idx;
+    }
+
+    if (haveRoi) {
+        int v[4] = { 0, 0, 0, 0 };
+        size_t pos = 0;
+        for (int i = 0; i < 4; i++) {
+            auto end = roi.find(',', pos);
+            if ((i < 3) == (end == std::string::npos) ||
+                not parseNumber(roi.substr(pos, end - pos), v[i])) {
+                error = "'roi' must be x,y,w,h";
+                return false;
+            }
+            pos = end + 1;
+        }
+
+        cv::Rect mosaic(
+            0,
+            0,
+            int(config.getOutputDimensions().width),
+            int(config.getOutputDimensions().height));
+        viewport.roi = cv::Rect(v[0], v[1], v[2], v[3]);
+        if (viewport.roi.area() == 0 ||
+            (viewport.roi & mosaic) != viewport.roi) {
+            error = "'roi' " + roi + " is not inside the " +
+                std::to_string(mosaic.width) + "x" +
+                std::to_string(mosaic.height) + " mosaic";
+            return false;
+        }
+    }
+    return true;
+}
+
+} // end of namespace
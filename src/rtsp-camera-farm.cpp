@@ -0,0 +1,361 @@
+// System headers
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// STL headers
+#include <cmath>
+#include <string>
+#include <vector>
+
+// gstreamer headers
+#include <glib-unix.h>
+#include <gst/gst.h>
+#include <gst/rtsp-server/rtsp-server.h>
+
+//
+// Synthetic camera farm for scale testing the RTSP proxy on one machine.
+//
+// Serves N H.264 RTSP streams generated by videotestsrc and x264enc, camera
+// i on rtsp://127.0.0.1:<port + i>/cam. Each camera has its own RTSP server,
+// so one camera can be disconnected without touching the others.
+//
+// Cameras can be made to behave less than ideal:
+//   - a start-up delay: every new camera session waits a random time up to
+//     the delay before answering, like a camera starting its encoder
+//   - jitter: every encoded frame is held back a random time up to the
+//     jitter. Keep it well below the frame interval.
+//   - periodic disconnects: every interval one random camera drops all its
+//     clients
+//
+// With -y a matching rtsp-proxy.yaml is written, so the proxy can be
+// pointed at the farm right away:
+//
+//   rtsp-camera-farm -n 16 -y /tmp/farm.yaml
+//   rtsp-proxy-server /tmp/farm.yaml
+//
+
+#define DEBUG_CAMERA_FARM 0
+
+namespace {
+
+struct FarmOptions {
+    /** number of cameras */
+    uint cameras = 4;
+
+    /** RTSP port of the first camera, the others follow */
+    uint port = 8600;
+
+    /** stream format */
+    uint width = 1280;
+    uint height = 720;
+    uint fps = 15;
+
+    /** keyframe interval in frames */
+    uint gop = 30;
+
+    /** encoder bitrate in kbit/s */
+    uint bitrateKbps = 2000;
+
+    /** maximum start-up delay of a camera session in milliseconds */
+    uint startupDelayMs = 0;
+
+    /** maximum delay of each frame in milliseconds */
+    uint jitterMs = 0;
+
+    /** seconds between disconnects of a random camera, 0 to disable */
+    uint disconnectSec = 0;
+
+    /** configuration file to write for the proxy, empty to skip */
+    std::string yamlPath;
+};
+
+struct Camera {
+    uint idx = 0;
+    GstRTSPServer* server = nullptr;
+    FarmOptions const* options = nullptr;
+};
+
+/** patterns cycled through the cameras, so tiles are easy to tell apart */
+const char* PATTERNS[] = { "ball", "smpte", "snow", "circular", "pinwheel" };
+
+std::string
+getLaunch(FarmOptions const& opt, uint idx)
+{
+    auto pattern = PATTERNS[idx % (sizeof(PATTERNS) / sizeof(PATTERNS[0]))];
+
+    char launch[1024];
+    snprintf(
+        launch,
+        sizeof(launch),
+        "( videotestsrc is-live=true pattern=%s "
+        "! video/x-raw,width=%u,height=%u,framerate=%u/1 "
+        "! textoverlay text=\"cam %u\" font-desc=\"Sans 48\" "
+        "! timeoverlay valignment=bottom "
+        "! x264enc tune=zerolatency speed-preset=ultrafast "
+        "key-int-max=%u bitrate=%u "
+        "! rtph264pay name=pay0 pt=96 config-interval=1 )",
+        pattern,
+        opt.width,
+        opt.height,
+        opt.fps,
+        idx,
+        opt.gop,
+        opt.bitrateKbps);
+    return launch;
+}
+
+GstPadProbeReturn
+onFrameJitter(GstPad*, GstPadProbeInfo*, Camera* camera)
+{
+    g_usleep(gulong(g_random_int_range(
+        0, gint32(camera->options->jitterMs * 1000 + 1))));
+    return GST_PAD_PROBE_OK;
+}
+
+void
+onMediaConfigure(
+    GstRTSPMediaFactory*,
+    GstRTSPMedia* media,
+    Camera* camera)
+{
+    auto const& opt = *camera->options;
+
+    if (opt.startupDelayMs > 0) {
+        // this runs while the DESCRIBE request is handled
+        auto delay = g_random_int_range(0, gint32(opt.startupDelayMs + 1));
+        printf("camera %u: starting in %d ms\n", camera->idx, delay);
+        g_usleep(gulong(delay) * 1000);
+    }
+
+    if (opt.jitterMs > 0) {
+        GstElement* element = gst_rtsp_media_get_element(media);
+        GstElement* pay = gst_bin_get_by_name(GST_BIN(element), "pay0");
+        if (pay) {
+            GstPad* pad = gst_element_get_static_pad(pay, "sink");
+            gst_pad_add_probe(
+                pad,
+                GST_PAD_PROBE_TYPE_BUFFER,
+                reinterpret_cast<GstPadProbeCallback>(&onFrameJitter),
+                camera,
+                nullptr);
+            gst_object_unref(pad);
+            gst_object_unref(pay);
+        }
+        gst_object_unref(element);
+    }
+}
+
+GstRTSPFilterResult
+removeClient(GstRTSPServer*, GstRTSPClient*, gpointer)
+{
+    return GST_RTSP_FILTER_REMOVE;
+}
+
+gboolean
+onDisconnectTimer(std::vector<Camera>* cameras)
+{
+    auto& camera = (*cameras)[size_t(
+        g_random_int_range(0, gint32(cameras->size())))];
+
+    printf("camera %u: disconnecting all clients\n", camera.idx);
+    fflush(stdout);
+    gst_rtsp_server_client_filter(camera.server, &removeClient, nullptr);
+    return G_SOURCE_CONTINUE;
+}
+
+gboolean
+onQuit(GMainLoop* loop)
+{
+    g_main_loop_quit(loop);
+    return G_SOURCE_REMOVE;
+}
+
+/**
+ * \brief Write a proxy configuration reading all cameras of the farm
+ */
+bool
+writeProxyConfig(FarmOptions const& opt)
+{
+    FILE* f = fopen(opt.yamlPath.c_str(), "w");
+    if (not f) {
+        perror(opt.yamlPath.c_str());
+        return false;
+    }
+
+    fprintf(f, "# generated by rtsp-camera-farm for %u cameras\n\n",
+        opt.cameras);
+    fprintf(f, "input_ring_buffer_size: 2\n\n");
+
+    fprintf(f, "input_rtsp_locations_t: [");
+    for (uint i = 0; i < opt.cameras; i++) {
+        fprintf(f, "%s\n    \"rtsp://127.0.0.1:%u/cam\"",
+            i == 0 ? "" : ",", opt.port + i);
+    }
+    fprintf(f, " ]\n\n");
+
+    fprintf(f,
+        "input_gst_rtsp_pipeline_idx_t: >-\n"
+        "    rtspsrc location={LOCATION} latency=0\n"
+        "    ! rtph264depay\n"
+        "    ! h264parse\n"
+        "    ! decodebin\n"
+        "    ! videoconvert\n"
+        "    ! appsink drop=true max-buffers=1\n\n");
+
+    fprintf(f, "input_gst_rtsp_pipelines: [");
+    for (uint i = 0; i < opt.cameras; i++) {
+        fprintf(f, "%s \"{PIPELINE_IDX}\"", i == 0 ? "" : ",");
+    }
+    fprintf(f, " ]\n\n");
+
+    // a square-ish grid of 320x180 tiles keeps a sane aspect ratio for
+    // any number of cameras
+    uint columns = uint(std::ceil(std::sqrt(double(opt.cameras))));
+    uint rows = (opt.cameras + columns - 1) / columns;
+    fprintf(f,
+        "output_fps: %u\n"
+        "output_width: %u\n"
+        "output_height: %u\n"
+        "output_mosaic_columns: %u\n"
+        "output_path: \"/be\"\n\n",
+        opt.fps,
+        columns * 320,
+        rows * 180,
+        columns);
+
+    fprintf(f,
+        "output_gst_rtsp_pipeline: >-\n"
+        "    appsrc name=source format=GST_FORMAT_TIME\n"
+        "    caps=video/x-raw,width={OUTPUT_WIDTH},height={OUTPUT_HEIGHT},"
+        "framerate={OUTPUT_FPS}/1,format=BGR\n"
+        "    ! videoconvert\n"
+        "    ! x264enc name=encoder speed-preset=ultrafast tune=zerolatency\n"
+        "    ! rtph264pay config-interval=1 name=pay0\n\n");
+
+    fprintf(f, "metrics_report_interval: 10\n");
+
+    fclose(f);
+    printf("Wrote proxy configuration to '%s'\n", opt.yamlPath.c_str());
+    return true;
+}
+
+void
+usage(const char* name)
+{
+    fprintf(
+        stderr,
+        "usage: %s [-n cameras] [-p first_port] [-W width] [-H height]\n"
+        "       [-f fps] [-g gop] [-b bitrate_kbps] [-s startup_delay_ms]\n"
+        "       [-j jitter_ms] [-d disconnect_interval_s] [-y proxy.yaml]\n",
+        name);
+}
+
+} // end of namespace
+
+int main(int argc, char** argv)
+{
+    gst_init(&argc, &argv);
+
+    FarmOptions opt;
+    int c = 0;
+    while ((c = getopt(argc, argv, "n:p:W:H:f:g:b:s:j:d:y:h")) != -1) {
+        auto value = (optarg) ? uint(strtoul(optarg, nullptr, 10)) : 0;
+        switch (c) {
+            case 'n': opt.cameras = value; break;
+            case 'p': opt.port = value; break;
+            case 'W': opt.width = value; break;
+            case 'H': opt.height = value; break;
+            case 'f': opt.fps = value; break;
+            case 'g': opt.gop = value; break;
+            case 'b': opt.bitrateKbps = value; break;
+            case 's': opt.startupDelayMs = value; break;
+            case 'j': opt.jitterMs = value; break;
+            case 'd': opt.disconnectSec = value; break;
+            case 'y': opt.yamlPath = optarg; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (opt.cameras == 0 || opt.fps == 0 || opt.width == 0 ||
+        opt.height == 0 || opt.port + opt.cameras > 65536) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (not opt.yamlPath.empty() && not writeProxyConfig(opt)) {
+        return 1;
+    }
+
+    std::vector<Camera> cameras(opt.cameras);
+    for (uint i = 0; i < opt.cameras; i++) {
+        auto& camera = cameras[i];
+        camera.idx = i;
+        camera.options = &opt;
+        camera.server = gst_rtsp_server_new();
+        gst_rtsp_server_set_service(
+            camera.server, std::to_string(opt.port + i).c_str());
+
+        GstRTSPMediaFactory* factory = gst_rtsp_media_factory_new();
+        gst_rtsp_media_factory_set_launch(
+            factory, getLaunch(opt, i).c_str());
+
+        // all clients of a camera share one encoder, like a real camera
+        gst_rtsp_media_factory_set_shared(factory, TRUE);
+
+        g_signal_connect(
+            factory,
+            "media-configure",
+            G_CALLBACK(&onMediaConfigure),
+            static_cast<gpointer>(&camera));
+
+        GstRTSPMountPoints* mounts =
+            gst_rtsp_server_get_mount_points(camera.server);
+        gst_rtsp_mount_points_add_factory(mounts, "/cam", factory);
+        g_object_unref(mounts);
+
+        if (gst_rtsp_server_attach(camera.server, NULL) == 0) {
+            fprintf(
+                stderr,
+                "ERROR: camera %u failed to listen on port %u\n",
+                i, opt.port + i);
+            return 1;
+        }
+        #if DEBUG_CAMERA_FARM
+            printf("%s\n", getLaunch(opt, i).c_str());
+        #endif
+    }
+
+    printf(
+        "Serving %u cameras %ux%u@%u, GOP %u, %u kbit/s on "
+        "rtsp://127.0.0.1:%u-%u/cam\n",
+        opt.cameras, opt.width, opt.height, opt.fps, opt.gop,
+        opt.bitrateKbps, opt.port, opt.port + opt.cameras - 1);
+    if (opt.startupDelayMs || opt.jitterMs || opt.disconnectSec) {
+        printf(
+            "start-up delay up to %u ms, jitter up to %u ms, "
+            "disconnect every %u s\n",
+            opt.startupDelayMs, opt.jitterMs, opt.disconnectSec);
+    }
+    fflush(stdout);
+
+    auto loop = g_main_loop_new(NULL, FALSE);
+
+    if (opt.disconnectSec > 0) {
+        g_timeout_add_seconds(
+            opt.disconnectSec,
+            reinterpret_cast<GSourceFunc>(&onDisconnectTimer),
+            &cameras);
+    }
+    g_unix_signal_add(SIGINT, reinterpret_cast<GSourceFunc>(&onQuit), loop);
+    g_unix_signal_add(SIGTERM, reinterpret_cast<GSourceFunc>(&onQuit), loop);
+
+    g_main_loop_run(loop);
+    g_main_loop_unref(loop);
+
+    for (auto& camera : cameras) {
+        g_object_unref(camera.server);
+    }
+    return 0;
+}
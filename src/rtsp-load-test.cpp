@@ -0,0 +1,1424 @@
+// System headers
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+// STL headers
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//
+// Load test for the RTSP proxy server.
+//
+// Opens many RTSP sessions against the server (DESCRIBE, SETUP with TCP
+// interleaved transport, PLAY), keeps them playing for a while, and reports
+// the session setup and DESCRIBE latency percentiles, the time to the first
+// media packet (after PLAY and after DESCRIBE) and to the first H.264
+// keyframe (the first picture a client can decode), and the CPU used by the
+// server process while sessions were set up and while they were playing.
+//
+// Media is received over TCP interleaved (default), unicast UDP or
+// multicast (-T). For UDP transports the received packet rate and the
+// host's UDP/TCP egress packet rate from /proc/net/snmp are reported, so
+// unicast and multicast delivery can be compared at the same client count.
+//
+// Example, against a server running on this machine:
+//
+//   rtsp-load-test -u rtsp://127.0.0.1:8554/be -n 500 -c 50 -d 30
+//       -p $(pidof rtsp-proxy-server)
+//
+// Comparing unicast and multicast egress at 50 clients:
+//
+//   rtsp-load-test -n 50 -T udp -p $(pidof rtsp-proxy-server)
+//   rtsp-load-test -n 50 -T multicast -p $(pidof rtsp-proxy-server)
+//
+// In churn mode (-C) sessions are not kept: each of -c workers sets up a
+// session, plays it for -H milliseconds, tears it down and starts the next
+// one, until -n sessions were played. The session rate, the setup latency
+// and, after the server settled for -S seconds, the growth of the server's
+// memory, open files and threads are reported. With -m the main loop
+// stalls and teardown times are read from the server's /metrics endpoint.
+//
+//   rtsp-load-test -C -n 5000 -c 40 -H 500 -p $(pidof rtsp-proxy-server)
+//       -m 127.0.0.1:8080
+//
+
+#define DEBUG_LOAD_TEST 0
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+/** interval between GET_PARAMETER keep-alives of playing sessions */
+constexpr auto KEEP_ALIVE_INTERVAL = std::chrono::seconds(20);
+
+enum class Transport {
+    TCP,
+    UDP,
+    MULTICAST
+};
+
+struct Options {
+    /** URL of the output mount point */
+    std::string url = "rtsp://127.0.0.1:8554/be";
+
+    /** number of sessions to open */
+    uint clients = 500;
+
+    /** number of sessions set up in parallel */
+    uint concurrency = 50;
+
+    /** seconds to keep all sessions playing after the setup */
+    uint duration = 30;
+
+    /** server process to measure, 0 to skip CPU measurements */
+    pid_t pid = 0;
+
+    /** timeout of each RTSP request in milliseconds */
+    uint timeoutMs = 10000;
+
+    /** how media is delivered */
+    Transport transport = Transport::TCP;
+
+    /** set up and tear down sessions continuously instead of keeping them */
+    bool churn = false;
+
+    /** milliseconds each churned session plays */
+    uint holdMs = 1000;
+
+    /** seconds to let the server settle after churning */
+    uint settle = 5;
+
+    /** host:port of the server's HTTP endpoint, empty to skip metrics */
+    std::string metrics;
+};
+
+struct Url {
+    std::string host;
+    std::string port = "554";
+    std::string path = "/";
+};
+
+bool
+parseUrl(std::string const& str, Url& url)
+{
+    const std::string scheme = "rtsp://";
+    if (str.compare(0, scheme.size(), scheme) != 0) {
+        return false;
+    }
+    auto rest = str.substr(scheme.size());
+    auto slash = rest.find('/');
+    auto hostPort = rest.substr(0, slash);
+    if (slash != std::string::npos) {
+        url.path = rest.substr(slash);
+    }
+    auto colon = hostPort.find(':');
+    url.host = hostPort.substr(0, colon);
+    if (colon != std::string::npos) {
+        url.port = hostPort.substr(colon + 1);
+    }
+    return not url.host.empty() && not url.port.empty();
+}
+
+std::string
+trim(std::string const& str)
+{
+    auto first = str.find_first_not_of(" \t");
+    if (first == std::string::npos) {
+        return "";
+    }
+    auto last = str.find_last_not_of(" \t");
+    return str.substr(first, last - first + 1);
+}
+
+/**
+ * \brief A parsed RTSP response
+ */
+struct RtspResponse {
+    int status = 0;
+    std::vector<std::pair<std::string, std::string>> headers;
+    std::string body;
+
+    std::string header(const char* name) const {
+        for (auto const& h : headers) {
+            if (strcasecmp(h.first.c_str(), name) == 0) {
+                return h.second;
+            }
+        }
+        return "";
+    }
+};
+
+/**
+ * \brief Get a parameter of an RTSP Transport header, e.g. 'port' of
+ *        'RTP/AVP;multicast;destination=224.3.0.1;port=5000-5001'
+ */
+std::string
+getTransportParam(std::string const& transport, std::string const& name)
+{
+    size_t pos = 0;
+    while (pos < transport.size()) {
+        auto end = transport.find(';', pos);
+        if (end == std::string::npos) {
+            end = transport.size();
+        }
+        auto param = transport.substr(pos, end - pos);
+        auto eq = param.find('=');
+        if (trim(param.substr(0, eq)) == name) {
+            return eq == std::string::npos ? "" : trim(param.substr(eq + 1));
+        }
+        pos = end + 1;
+    }
+    return "";
+}
+
+/**
+ * \brief Open a UDP socket bound to a port
+ *
+ * \return socket, or -1 on failure
+ */
+int
+openUdp(ushort port, bool reuse)
+{
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (reuse) {
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    }
+    // many clients share the host, don't lose packets to a small buffer
+    int size = 1 << 20;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+ushort
+getLocalPort(int fd)
+{
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len);
+    return ntohs(addr.sin_port);
+}
+
+/**
+ * \brief Check if an RTP packet carries (the start of) an H.264 IDR picture
+ */
+bool
+isKeyframePacket(const uint8_t* p, size_t size)
+{
+    if (size < 12 || (p[0] >> 6) != 2) {
+        return false;
+    }
+    size_t off = 12 + size_t(p[0] & 0x0f) * 4;
+    if (p[0] & 0x10) {
+        // header extension
+        if (size < off + 4) {
+            return false;
+        }
+        off += 4 + ((size_t(p[off + 2]) << 8) | p[off + 3]) * 4;
+    }
+    if (size <= off) {
+        return false;
+    }
+
+    const uint8_t IDR = 5;
+    const uint8_t STAP_A = 24;
+    const uint8_t FU_A = 28;
+
+    uint8_t type = p[off] & 0x1f;
+    if (type == IDR) {
+        return true;
+    }
+    if (type == FU_A) {
+        // only the first fragment has the start bit
+        return size > off + 1 && (p[off + 1] & 0x80) &&
+            (p[off + 1] & 0x1f) == IDR;
+    }
+    if (type == STAP_A) {
+        for (off++; off + 2 < size; ) {
+            size_t len = (size_t(p[off]) << 8) | p[off + 1];
+            if ((p[off + 2] & 0x1f) == IDR) {
+                return true;
+            }
+            off += 2 + len;
+        }
+    }
+    return false;
+}
+
+/**
+ * \brief Finds the first keyframe in the media received by a session
+ */
+class KeyframeScanner {
+public:
+    /**
+     * \brief Scan received media
+     *
+     * \param[in] datagram data is one RTP packet, not a part of the TCP
+     *            interleaved stream
+     * \return true once a keyframe was received
+     */
+    bool feed(const char* data, size_t size, bool datagram)
+    {
+        if (m_found) {
+            return true;
+        }
+        if (datagram) {
+            m_found = isKeyframePacket(
+                reinterpret_cast<const uint8_t*>(data), size);
+            return m_found;
+        }
+
+        // '$', channel, 16 bit length and the packet, with RTSP responses
+        // to keep-alives in between
+        m_pending.append(data, size);
+        size_t pos = 0;
+        while (not m_found && pos < m_pending.size()) {
+            if (m_pending[pos] == '$') {
+                if (m_pending.size() - pos < 4) {
+                    break;
+                }
+                auto channel = uint8_t(m_pending[pos + 1]);
+                size_t len = (size_t(uint8_t(m_pending[pos + 2])) << 8) |
+                    uint8_t(m_pending[pos + 3]);
+                if (m_pending.size() - pos < 4 + len) {
+                    break;
+                }
+                // RTP on even channels, RTCP on odd ones
+                m_found = channel % 2 == 0 && isKeyframePacket(
+                    reinterpret_cast<const uint8_t*>(&m_pending[pos + 4]),
+                    len);
+                pos += 4 + len;
+            } else if (m_pending.size() - pos < 5) {
+                break;
+            } else if (m_pending.compare(pos, 5, "RTSP/") == 0) {
+                auto end = m_pending.find("\r\n\r\n", pos);
+                if (end == std::string::npos) {
+                    break;
+                }
+                pos = end + 4;
+            } else {
+                pos++;
+            }
+        }
+        m_pending.erase(0, pos);
+        if (m_found) {
+            m_pending.clear();
+            m_pending.shrink_to_fit();
+        }
+        return m_found;
+    }
+
+private:
+    bool m_found = false;
+
+    /** incomplete interleaved packet */
+    std::string m_pending;
+};
+
+/**
+ * \brief Minimal blocking RTSP client session
+ */
+class RtspSession {
+public:
+    RtspSession(
+        Url const& url,
+        std::string const& uri,
+        uint timeoutMs,
+        Transport transport)
+        :
+        m_url(url),
+        m_uri(uri),
+        m_timeoutMs(timeoutMs),
+        m_transport(transport)
+    {
+    }
+
+    ~RtspSession()
+    {
+        for (int fd : { m_fd, m_rtpFd, m_rtcpFd }) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+    }
+
+    /**
+     * \brief Connect and set up a playing session
+     *
+     * \param[out] error reason of a failure
+     * \return true if the server answered PLAY with 200
+     */
+    bool setup(std::string& error)
+    {
+        if (not connectServer(error)) {
+            return false;
+        }
+
+        RtspResponse res;
+        m_describeTime = Clock::now();
+        if (not request("DESCRIBE", m_uri, "Accept: application/sdp\r\n",
+                res, error)) {
+            return false;
+        }
+        m_describeMs = std::chrono::duration<double, std::milli>(
+            Clock::now() - m_describeTime).count();
+
+        auto base = res.header("Content-Base");
+        if (base.empty()) {
+            base = m_uri;
+        }
+        auto control = getControl(res.body, base);
+
+        std::string transport;
+        if (not getTransport(transport, error) ||
+            not request("SETUP", control, transport.c_str(), res, error) ||
+            not joinMulticast(res.header("Transport"), error)) {
+            return false;
+        }
+        m_session = res.header("Session");
+        m_session = m_session.substr(0, m_session.find(';'));
+        if (m_session.empty()) {
+            error = "no session in SETUP response";
+            return false;
+        }
+        m_controlUri = base;
+
+        if (not request("PLAY", base, "Range: npt=0-\r\n", res, error)) {
+            return false;
+        }
+
+        // from now on the sockets are drained by the poll loop
+        fcntl(m_fd, F_SETFL, fcntl(m_fd, F_GETFL) | O_NONBLOCK);
+        if (m_rtpFd >= 0) {
+            fcntl(m_rtpFd, F_SETFL, fcntl(m_rtpFd, F_GETFL) | O_NONBLOCK);
+        }
+        return true;
+    }
+
+    /**
+     * \brief Send a keep-alive without waiting for the response, which is
+     *        drained with the media data
+     */
+    void keepAlive()
+    {
+        auto req = makeRequest("GET_PARAMETER", m_controlUri, "");
+        send(m_fd, req.data(), req.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+    }
+
+    /**
+     * \brief Receive and discard media for a while
+     */
+    void drain(Clock::duration duration)
+    {
+        auto end = Clock::now() + duration;
+        int fd = getMediaFd();
+        char buf[1 << 16];
+
+        for (auto now = Clock::now(); now < end; now = Clock::now()) {
+            struct pollfd pfd;
+            pfd.fd = fd;
+            pfd.events = POLLIN;
+            pfd.revents = 0;
+            auto waitMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                end - now).count();
+            if (poll(&pfd, 1, int(waitMs) + 1) <= 0) {
+                continue;
+            }
+            if (recv(fd, buf, sizeof(buf), 0) == 0) {
+                return;
+            }
+        }
+    }
+
+    /**
+     * \brief Send TEARDOWN without waiting for the response
+     */
+    void teardown()
+    {
+        if (m_fd >= 0 && not m_session.empty()) {
+            auto req = makeRequest("TEARDOWN", m_controlUri, "");
+            send(m_fd, req.data(), req.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+        }
+    }
+
+    int getFd() const { return m_fd; }
+
+    /** socket receiving RTP, the RTSP connection for TCP interleaved */
+    int getMediaFd() const { return m_rtpFd >= 0 ? m_rtpFd : m_fd; }
+
+    /** whether each read of the media socket is one packet */
+    bool isDatagram() const { return m_rtpFd >= 0; }
+
+    /** time DESCRIBE was sent */
+    Clock::time_point getDescribeTime() const { return m_describeTime; }
+
+    /** time until the DESCRIBE response arrived */
+    double getDescribeMs() const { return m_describeMs; }
+
+    /** interleaved media received together with the PLAY response */
+    std::string const& getPending() const { return m_pending; }
+
+private:
+    bool connectServer(std::string& error)
+    {
+        struct addrinfo hints;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+
+        struct addrinfo* addrs = nullptr;
+        int rc = getaddrinfo(
+            m_url.host.c_str(), m_url.port.c_str(), &hints, &addrs);
+        if (rc != 0) {
+            error = gai_strerror(rc);
+            return false;
+        }
+
+        for (auto* a = addrs; a; a = a->ai_next) {
+            m_fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+            if (m_fd < 0) {
+                continue;
+            }
+            struct timeval tv;
+            tv.tv_sec = m_timeoutMs / 1000;
+            tv.tv_usec = (m_timeoutMs % 1000) * 1000;
+            setsockopt(m_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+            setsockopt(m_fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+            if (connect(m_fd, a->ai_addr, a->ai_addrlen) == 0) {
+                break;
+            }
+            error = std::string("connect: ") + strerror(errno);
+            close(m_fd);
+            m_fd = -1;
+        }
+        freeaddrinfo(addrs);
+        return m_fd >= 0;
+    }
+
+    /**
+     * \brief Build the Transport header of SETUP, opening UDP sockets for
+     *        unicast UDP
+     */
+    bool getTransport(std::string& transport, std::string& error)
+    {
+        switch (m_transport) {
+            case Transport::TCP:
+                transport =
+                    "Transport: RTP/AVP/TCP;unicast;interleaved=0-1\r\n";
+                return true;
+
+            case Transport::MULTICAST:
+                transport = "Transport: RTP/AVP;multicast\r\n";
+                return true;
+
+            case Transport::UDP:
+                break;
+        }
+
+        // RTP on an even port, RTCP on the next one
+        for (int attempt = 0; attempt < 16 && m_rtcpFd < 0; attempt++) {
+            m_rtpFd = openUdp(0, false);
+            if (m_rtpFd < 0) {
+                break;
+            }
+            ushort port = getLocalPort(m_rtpFd);
+            if (port % 2 == 0) {
+                m_rtcpFd = openUdp(ushort(port + 1), false);
+            }
+            if (m_rtcpFd < 0) {
+                close(m_rtpFd);
+                m_rtpFd = -1;
+            }
+        }
+        if (m_rtcpFd < 0) {
+            error = "failed to allocate client ports";
+            return false;
+        }
+
+        ushort port = getLocalPort(m_rtpFd);
+        transport = "Transport: RTP/AVP;unicast;client_port=" +
+            std::to_string(port) + "-" + std::to_string(port + 1) + "\r\n";
+        return true;
+    }
+
+    /**
+     * \brief Join the group the server assigned in the SETUP response
+     */
+    bool joinMulticast(std::string const& transport, std::string& error)
+    {
+        if (m_transport != Transport::MULTICAST) {
+            return true;
+        }
+
+        auto group = getTransportParam(transport, "destination");
+        auto ports = getTransportParam(transport, "port");
+        auto source = getTransportParam(transport, "source");
+        auto port = ushort(strtoul(ports.c_str(), nullptr, 10));
+        if (group.empty() || port == 0) {
+            error = "no multicast destination in '" + transport + "'";
+            return false;
+        }
+
+        // all clients on this host bind the same port and get a copy of
+        // every packet
+        m_rtpFd = openUdp(port, true);
+        if (m_rtpFd < 0) {
+            error = "failed to bind multicast port " + ports;
+            return false;
+        }
+
+        int rc = 0;
+        if (source.empty()) {
+            struct ip_mreq mreq;
+            memset(&mreq, 0, sizeof(mreq));
+            inet_pton(AF_INET, group.c_str(), &mreq.imr_multiaddr);
+            mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+            rc = setsockopt(m_rtpFd, IPPROTO_IP, IP_ADD_MEMBERSHIP,
+                &mreq, sizeof(mreq));
+        } else {
+            struct ip_mreq_source mreq;
+            memset(&mreq, 0, sizeof(mreq));
+            inet_pton(AF_INET, group.c_str(), &mreq.imr_multiaddr);
+            inet_pton(AF_INET, source.c_str(), &mreq.imr_sourceaddr);
+            mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+            rc = setsockopt(m_rtpFd, IPPROTO_IP, IP_ADD_SOURCE_MEMBERSHIP,
+                &mreq, sizeof(mreq));
+        }
+        if (rc != 0) {
+            error = "failed to join " + group + ": " + strerror(errno);
+            return false;
+        }
+        return true;
+    }
+
+    std::string makeRequest(
+        const char* method,
+        std::string const& uri,
+        const char* headers)
+    {
+        std::string req = std::string(method) + " " + uri + " RTSP/1.0\r\n";
+        req += "CSeq: " + std::to_string(++m_cseq) + "\r\n";
+        req += "User-Agent: rtsp-load-test\r\n";
+        if (not m_session.empty()) {
+            req += "Session: " + m_session + "\r\n";
+        }
+        req += headers;
+        req += "\r\n";
+        return req;
+    }
+
+    bool request(
+        const char* method,
+        std::string const& uri,
+        const char* headers,
+        RtspResponse& res,
+        std::string& error)
+    {
+        auto req = makeRequest(method, uri, headers);
+        if (send(m_fd, req.data(), req.size(), MSG_NOSIGNAL) !=
+            ssize_t(req.size())) {
+            error = std::string(method) + " send: " + strerror(errno);
+            return false;
+        }
+
+        // read until the end of the headers
+        size_t end = 0;
+        while ((end = m_pending.find("\r\n\r\n")) == std::string::npos) {
+            if (not receive(method, error)) {
+                return false;
+            }
+        }
+        auto head = m_pending.substr(0, end);
+        m_pending.erase(0, end + 4);
+
+        res = RtspResponse();
+        size_t pos = head.find("\r\n");
+        auto statusLine = head.substr(0, pos);
+        if (sscanf(statusLine.c_str(), "RTSP/1.0 %d", &res.status) != 1) {
+            error = std::string(method) + ": bad status line";
+            return false;
+        }
+        while (pos != std::string::npos) {
+            auto next = head.find("\r\n", pos + 2);
+            auto line = head.substr(pos + 2, next - pos - 2);
+            auto colon = line.find(':');
+            if (colon != std::string::npos) {
+                res.headers.emplace_back(
+                    trim(line.substr(0, colon)),
+                    trim(line.substr(colon + 1)));
+            }
+            pos = next;
+        }
+
+        size_t length = strtoul(res.header("Content-Length").c_str(),
+            nullptr, 10);
+        while (m_pending.size() < length) {
+            if (not receive(method, error)) {
+                return false;
+            }
+        }
+        res.body = m_pending.substr(0, length);
+        m_pending.erase(0, length);
+
+        if (res.status != 200) {
+            error = std::string(method) + ": status " +
+                std::to_string(res.status);
+            return false;
+        }
+        return true;
+    }
+
+    bool receive(const char* method, std::string& error)
+    {
+        char buf[4096];
+        ssize_t n = recv(m_fd, buf, sizeof(buf), 0);
+        if (n <= 0) {
+            error = std::string(method) + " recv: " +
+                (n == 0 ? "connection closed" : strerror(errno));
+            return false;
+        }
+        m_pending.append(buf, size_t(n));
+        return true;
+    }
+
+    /**
+     * \brief Get the control URL of the first stream of an SDP
+     */
+    static std::string getControl(
+        std::string const& sdp,
+        std::string const& base)
+    {
+        auto media = sdp.find("\nm=");
+        auto attr = sdp.find("a=control:", media == std::string::npos ?
+            0 : media);
+        if (attr == std::string::npos) {
+            return base;
+        }
+        auto end = sdp.find_first_of("\r\n", attr);
+        auto control = trim(sdp.substr(attr + 10, end - attr - 10));
+        if (control.empty() || control == "*") {
+            return base;
+        }
+        if (control.compare(0, 7, "rtsp://") == 0) {
+            return control;
+        }
+        return (base.back() == '/' ? base : base + "/") + control;
+    }
+
+private:
+    Url m_url;
+    std::string m_uri;
+    std::string m_controlUri;
+    uint m_timeoutMs = 0;
+    Transport m_transport = Transport::TCP;
+
+    int m_fd = -1;
+
+    /** UDP sockets for unicast UDP and multicast */
+    int m_rtpFd = -1;
+    int m_rtcpFd = -1;
+
+    int m_cseq = 0;
+    std::string m_session;
+
+    Clock::time_point m_describeTime;
+    double m_describeMs = 0.;
+
+    /** received but not yet parsed data */
+    std::string m_pending;
+};
+
+/**
+ * \brief CPU time and thread count of a process, from /proc/<pid>/stat
+ */
+struct ProcessStat {
+    bool valid = false;
+    double cpuSec = 0.;
+    long threads = 0;
+};
+
+ProcessStat
+readProcessStat(pid_t pid)
+{
+    ProcessStat stat;
+    if (pid <= 0) {
+        return stat;
+    }
+
+    auto path = "/proc/" + std::to_string(pid) + "/stat";
+    FILE* f = fopen(path.c_str(), "r");
+    if (not f) {
+        return stat;
+    }
+    char buf[1024];
+    size_t n = fread(buf, 1, sizeof(buf) - 1, f);
+    fclose(f);
+    buf[n] = '\0';
+
+    // the process name may contain spaces, fields are counted after it
+    const char* p = strrchr(buf, ')');
+    if (not p) {
+        return stat;
+    }
+
+    unsigned long utime = 0;
+    unsigned long stime = 0;
+    long threads = 0;
+    int fields = sscanf(
+        p + 2,
+        "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu "
+        "%*d %*d %*d %*d %ld",
+        &utime,
+        &stime,
+        &threads);
+    if (fields != 3) {
+        return stat;
+    }
+
+    stat.valid = true;
+    stat.cpuSec = double(utime + stime) / double(sysconf(_SC_CLK_TCK));
+    stat.threads = threads;
+    return stat;
+}
+
+/**
+ * \brief Resident memory and open files of a process, from /proc/<pid>
+ */
+struct ProcessMemory {
+    bool valid = false;
+    long rssKb = 0;
+    long fds = 0;
+};
+
+ProcessMemory
+readProcessMemory(pid_t pid)
+{
+    ProcessMemory mem;
+    if (pid <= 0) {
+        return mem;
+    }
+
+    auto proc = "/proc/" + std::to_string(pid);
+    FILE* f = fopen((proc + "/status").c_str(), "r");
+    if (not f) {
+        return mem;
+    }
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "VmRSS: %ld kB", &mem.rssKb) == 1) {
+            mem.valid = true;
+        }
+    }
+    fclose(f);
+
+    DIR* dir = opendir((proc + "/fd").c_str());
+    if (dir) {
+        while (auto* entry = readdir(dir)) {
+            mem.fds += entry->d_name[0] != '.' ? 1 : 0;
+        }
+        closedir(dir);
+    }
+    return mem;
+}
+
+/**
+ * \brief Read the metrics of the server from its HTTP endpoint
+ *
+ * \param[in] hostPort address of the endpoint, "host:port"
+ * \param[out] metrics metric values by name
+ * \return false if the endpoint could not be read
+ */
+bool
+fetchMetrics(
+    std::string const& hostPort,
+    std::map<std::string, double>& metrics)
+{
+    auto colon = hostPort.rfind(':');
+    if (colon == std::string::npos) {
+        return false;
+    }
+    auto host = hostPort.substr(0, colon);
+    auto port = hostPort.substr(colon + 1);
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo* addrs = nullptr;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &addrs) != 0) {
+        return false;
+    }
+    int fd = -1;
+    for (auto* a = addrs; a && fd < 0; a = a->ai_next) {
+        fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (fd >= 0 && connect(fd, a->ai_addr, a->ai_addrlen) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(addrs);
+    if (fd < 0) {
+        return false;
+    }
+
+    std::string req = "GET /metrics HTTP/1.0\r\n\r\n";
+    std::string res;
+    if (send(fd, req.data(), req.size(), MSG_NOSIGNAL) ==
+        ssize_t(req.size())) {
+        char buf[4096];
+        ssize_t n = 0;
+        while ((n = recv(fd, buf, sizeof(buf), 0)) > 0) {
+            res.append(buf, size_t(n));
+        }
+    }
+    close(fd);
+
+    auto body = res.find("\r\n\r\n");
+    if (res.compare(0, 12, "HTTP/1.0 200") != 0 ||
+        body == std::string::npos) {
+        return false;
+    }
+
+    metrics.clear();
+    size_t pos = body + 4;
+    while (pos < res.size()) {
+        auto end = res.find('\n', pos);
+        auto line = res.substr(pos, end - pos);
+        auto space = line.find(' ');
+        if (space != std::string::npos) {
+            metrics[line.substr(0, space)] =
+                strtod(line.c_str() + space + 1, nullptr);
+        }
+        pos = (end == std::string::npos) ? res.size() : end + 1;
+    }
+    return true;
+}
+
+/**
+ * \brief Packets sent by this host, from /proc/net/snmp
+ */
+uint64_t
+readHostEgressPackets()
+{
+    FILE* f = fopen("/proc/net/snmp", "r");
+    if (not f) {
+        return 0;
+    }
+
+    // each protocol has a line of names followed by a line of values
+    uint64_t packets = 0;
+    char names[2048];
+    char values[2048];
+    while (fgets(names, sizeof(names), f) && fgets(values, sizeof(values), f)) {
+        bool udp = strncmp(names, "Udp:", 4) == 0;
+        bool tcp = strncmp(names, "Tcp:", 4) == 0;
+        if (not udp && not tcp) {
+            continue;
+        }
+        const char* wanted = udp ? "OutDatagrams" : "OutSegs";
+
+        char* nameSave = nullptr;
+        char* valueSave = nullptr;
+        char* name = strtok_r(names, " \n", &nameSave);
+        char* value = strtok_r(values, " \n", &valueSave);
+        while (name && value) {
+            if (strcmp(name, wanted) == 0) {
+                packets += strtoull(value, nullptr, 10);
+            }
+            name = strtok_r(nullptr, " \n", &nameSave);
+            value = strtok_r(nullptr, " \n", &valueSave);
+        }
+    }
+    fclose(f);
+    return packets;
+}
+
+double
+percentile(std::vector<double> const& sorted, double q)
+{
+    if (sorted.empty()) {
+        return 0.;
+    }
+    auto idx = size_t(q * double(sorted.size() - 1) + 0.5);
+    return sorted[std::min(idx, sorted.size() - 1)];
+}
+
+void
+printLatencies(const char* name, std::vector<double> ms)
+{
+    std::sort(ms.begin(), ms.end());
+    printf(
+        "%-22s p50 %8.1f  p90 %8.1f  p99 %8.1f  max %8.1f ms (%zu)\n",
+        name,
+        percentile(ms, 0.50),
+        percentile(ms, 0.90),
+        percentile(ms, 0.99),
+        ms.empty() ? 0. : ms.back(),
+        ms.size());
+}
+
+void
+printCpu(
+    const char* phase,
+    ProcessStat const& start,
+    ProcessStat const& end,
+    double wallSec)
+{
+    if (not start.valid || not end.valid || wallSec <= 0.) {
+        return;
+    }
+    printf(
+        "server CPU %-11s %6.1f %% of one core, %ld threads\n",
+        phase,
+        100. * (end.cpuSec - start.cpuSec) / wallSec,
+        end.threads);
+}
+
+/**
+ * \brief Print a few distinct failure reasons
+ */
+void
+printFailures(std::vector<std::string> const& errors)
+{
+    std::vector<std::string> reasons;
+    for (auto const& e : errors) {
+        if (not e.empty() &&
+            std::find(reasons.begin(), reasons.end(), e) == reasons.end()) {
+            reasons.push_back(e);
+            printf("  failure: %s\n", e.c_str());
+            if (reasons.size() == 5) {
+                break;
+            }
+        }
+    }
+}
+
+void
+usage(const char* name)
+{
+    fprintf(
+        stderr,
+        "usage: %s [-u url] [-n clients] [-c concurrency] [-d seconds] "
+        "[-p server_pid] [-t timeout_ms] [-T tcp|udp|multicast]\n"
+        "       [-C [-H hold_ms] [-S settle_seconds]] [-m http_host:port]\n",
+        name);
+}
+
+double
+elapsedMs(Clock::time_point from, Clock::time_point to)
+{
+    return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+/**
+ * \brief Set up, play and tear down sessions continuously, and report the
+ *        session rate and what the server kept afterwards
+ */
+int
+runChurn(Options const& opt, Url const& url)
+{
+    printf(
+        "Churning %u sessions to %s, %u at a time, playing %u ms each\n",
+        opt.clients, opt.url.c_str(), opt.concurrency, opt.holdMs);
+    fflush(stdout);
+
+    std::map<std::string, double> metricsStart;
+    bool haveMetrics = not opt.metrics.empty() &&
+        fetchMetrics(opt.metrics, metricsStart);
+    if (not opt.metrics.empty() && not haveMetrics) {
+        fprintf(stderr, "Failed to read %s/metrics\n", opt.metrics.c_str());
+    }
+
+    auto memStart = readProcessMemory(opt.pid);
+    auto statStart = readProcessStat(opt.pid);
+    auto start = Clock::now();
+
+    std::vector<double> setupMs(opt.clients, -1.);
+    std::vector<std::string> errors(opt.clients);
+    auto hold = std::chrono::milliseconds(opt.holdMs);
+
+    std::atomic<uint> next(0);
+    std::vector<std::thread> workers;
+    for (uint w = 0; w < std::min(opt.concurrency, opt.clients); w++) {
+        workers.emplace_back([&] {
+            for (uint idx = next++; idx < opt.clients; idx = next++) {
+                auto setupStart = Clock::now();
+                RtspSession session(url, opt.url, opt.timeoutMs, opt.transport);
+                if (not session.setup(errors[idx])) {
+                    continue;
+                }
+                setupMs[idx] = elapsedMs(setupStart, Clock::now());
+
+                session.drain(hold);
+                session.teardown();
+            }
+        });
+    }
+    for (auto& t : workers) {
+        t.join();
+    }
+
+    auto end = Clock::now();
+    auto statEnd = readProcessStat(opt.pid);
+    double churnSec = elapsedMs(start, end) / 1000.;
+
+    std::vector<double> setupOk;
+    for (auto ms : setupMs) {
+        if (ms >= 0.) {
+            setupOk.push_back(ms);
+        }
+    }
+
+    printf("\n");
+    printf(
+        "%zu of %u sessions played in %.1f s, %.1f sessions/s\n",
+        setupOk.size(),
+        opt.clients,
+        churnSec,
+        churnSec > 0. ? double(setupOk.size()) / churnSec : 0.);
+    printLatencies("session setup", setupOk);
+    printf("failed %zu\n", size_t(opt.clients) - setupOk.size());
+    printFailures(errors);
+    printCpu("churning", statStart, statEnd, churnSec);
+
+    // medias and processors are torn down in the background, give the
+    // server time to finish before looking for leftovers
+    printf("\nletting the server settle for %u s...\n", opt.settle);
+    fflush(stdout);
+    std::this_thread::sleep_for(std::chrono::seconds(opt.settle));
+
+    auto memEnd = readProcessMemory(opt.pid);
+    auto statSettled = readProcessStat(opt.pid);
+    if (memStart.valid && memEnd.valid) {
+        printf(
+            "server RSS %ld -> %ld kB (%+ld kB), open files %ld -> %ld, "
+            "threads %ld -> %ld\n",
+            memStart.rssKb,
+            memEnd.rssKb,
+            memEnd.rssKb - memStart.rssKb,
+            memStart.fds,
+            memEnd.fds,
+            statStart.threads,
+            statSettled.threads);
+    }
+
+    std::map<std::string, double> metricsEnd;
+    if (haveMetrics && fetchMetrics(opt.metrics, metricsEnd)) {
+        auto delta = [&](std::string const& name) {
+            return metricsEnd[name] - metricsStart[name];
+        };
+        double teardowns = delta("server.teardowns");
+        printf(
+            "main loop stalls %.0f, %.3f s stalled, longest %.1f ms "
+            "(since server start)\n",
+            delta("server.main_loop_stalls"),
+            delta("server.main_loop_stall_sec"),
+            metricsEnd["server.main_loop_stall_max_ms"]);
+        printf(
+            "media teardowns %.0f, %.1f ms each, %.0f pending\n",
+            teardowns,
+            teardowns > 0. ?
+                delta("server.teardown_sec") * 1000. / teardowns : 0.,
+            metricsEnd["server.teardown_pending"]);
+    }
+
+    return setupOk.size() == opt.clients ? 0 : 2;
+}
+
+} // end of namespace
+
+int main(int argc, char** argv)
+{
+    Options opt;
+    int c = 0;
+    while ((c = getopt(argc, argv, "u:n:c:d:p:t:T:CH:S:m:h")) != -1) {
+        switch (c) {
+            case 'u': opt.url = optarg; break;
+            case 'n': opt.clients = uint(strtoul(optarg, nullptr, 10)); break;
+            case 'c':
+                opt.concurrency = uint(strtoul(optarg, nullptr, 10));
+                break;
+            case 'd': opt.duration = uint(strtoul(optarg, nullptr, 10)); break;
+            case 'p': opt.pid = pid_t(strtol(optarg, nullptr, 10)); break;
+            case 't': opt.timeoutMs = uint(strtoul(optarg, nullptr, 10)); break;
+            case 'T':
+                if (strcmp(optarg, "tcp") == 0) {
+                    opt.transport = Transport::TCP;
+                } else if (strcmp(optarg, "udp") == 0) {
+                    opt.transport = Transport::UDP;
+                } else if (strcmp(optarg, "multicast") == 0) {
+                    opt.transport = Transport::MULTICAST;
+                } else {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'C': opt.churn = true; break;
+            case 'H': opt.holdMs = uint(strtoul(optarg, nullptr, 10)); break;
+            case 'S': opt.settle = uint(strtoul(optarg, nullptr, 10)); break;
+            case 'm': opt.metrics = optarg; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+
+    Url url;
+    if (not parseUrl(opt.url, url) || opt.clients == 0 ||
+        opt.concurrency == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (opt.churn) {
+        return runChurn(opt, url);
+    }
+
+    printf(
+        "Opening %u sessions to %s, %u at a time, playing for %u s\n",
+        opt.clients, opt.url.c_str(), opt.concurrency, opt.duration);
+    fflush(stdout);
+
+    std::vector<std::unique_ptr<RtspSession>> sessions(opt.clients);
+    std::vector<double> setupMs(opt.clients, -1.);
+    std::vector<Clock::time_point> playTime(opt.clients);
+    std::vector<Clock::time_point> describeTime(opt.clients);
+    std::vector<double> describeMs;
+    std::vector<double> firstDataMs;
+    std::vector<double> describeToDataMs;
+    std::vector<double> keyframeMs(opt.clients, -1.);
+    std::vector<KeyframeScanner> scanners(opt.clients);
+    std::vector<std::string> errors(opt.clients);
+
+    int epfd = epoll_create1(0);
+    if (epfd < 0) {
+        perror("epoll_create1");
+        return 1;
+    }
+
+    //
+    // drain media of all playing sessions, so the server never blocks on a
+    // full socket while other sessions are being set up
+    //
+    std::atomic<bool> draining(true);
+    std::atomic<bool> setupDone(false);
+    uint64_t bytes = 0;
+    uint64_t packets = 0;
+    uint closedByServer = 0;
+
+    std::thread drainThread([&] {
+        std::vector<bool> gotData(opt.clients, false);
+        std::vector<char> buf(1 << 16);
+        struct epoll_event events[256];
+        auto lastKeepAlive = Clock::now();
+
+        while (draining) {
+            int n = epoll_wait(epfd, events, 256, 100);
+            auto now = Clock::now();
+
+            for (int i = 0; i < n; i++) {
+                auto idx = events[i].data.u32;
+                int fd = sessions[idx]->getMediaFd();
+                bool datagram = sessions[idx]->isDatagram();
+
+                for (;;) {
+                    ssize_t r = recv(fd, buf.data(), buf.size(), 0);
+                    if (r > 0) {
+                        bytes += uint64_t(r);
+                        packets += datagram ? 1 : 0;
+                        if (not gotData[idx]) {
+                            gotData[idx] = true;
+                            firstDataMs.push_back(
+                                elapsedMs(playTime[idx], now));
+                            describeToDataMs.push_back(
+                                elapsedMs(describeTime[idx], now));
+                        }
+                        if (keyframeMs[idx] < 0. && scanners[idx].feed(
+                                buf.data(), size_t(r), datagram)) {
+                            keyframeMs[idx] = elapsedMs(playTime[idx], now);
+                        }
+                        continue;
+                    }
+                    if (r < 0 && (errno == EAGAIN || errno == EINTR)) {
+                        break;
+                    }
+                    epoll_ctl(epfd, EPOLL_CTL_DEL, fd, nullptr);
+                    closedByServer++;
+                    break;
+                }
+            }
+
+            if (setupDone && now - lastKeepAlive > KEEP_ALIVE_INTERVAL) {
+                lastKeepAlive = now;
+                for (auto& s : sessions) {
+                    if (s) {
+                        s->keepAlive();
+                    }
+                }
+            }
+        }
+    });
+
+    //
+    // set up all sessions
+    //
+    auto statStart = readProcessStat(opt.pid);
+    auto setupStart = Clock::now();
+
+    std::atomic<uint> next(0);
+    std::vector<std::thread> workers;
+    for (uint w = 0; w < std::min(opt.concurrency, opt.clients); w++) {
+        workers.emplace_back([&] {
+            for (uint idx = next++; idx < opt.clients; idx = next++) {
+                auto start = Clock::now();
+                std::unique_ptr<RtspSession> session(
+                    new RtspSession(
+                        url, opt.url, opt.timeoutMs, opt.transport));
+
+                if (not session->setup(errors[idx])) {
+                    #if DEBUG_LOAD_TEST
+                        printf("session %u failed: %s\n",
+                            idx, errors[idx].c_str());
+                    #endif
+                    continue;
+                }
+                auto end = Clock::now();
+                setupMs[idx] = elapsedMs(start, end);
+                playTime[idx] = end;
+                describeTime[idx] = session->getDescribeTime();
+
+                auto const& pending = session->getPending();
+                if (not session->isDatagram() && scanners[idx].feed(
+                        pending.data(), pending.size(), false)) {
+                    keyframeMs[idx] = 0.;
+                }
+
+                sessions[idx] = std::move(session);
+
+                struct epoll_event ev;
+                memset(&ev, 0, sizeof(ev));
+                ev.events = EPOLLIN;
+                ev.data.u32 = idx;
+                epoll_ctl(
+                    epfd, EPOLL_CTL_ADD, sessions[idx]->getMediaFd(), &ev);
+            }
+        });
+    }
+    for (auto& t : workers) {
+        t.join();
+    }
+    setupDone = true;
+
+    auto setupEnd = Clock::now();
+    auto statSetup = readProcessStat(opt.pid);
+    auto egressSetup = readHostEgressPackets();
+
+    uint ok = 0;
+    std::vector<double> setupOk;
+    for (uint i = 0; i < opt.clients; i++) {
+        if (setupMs[i] >= 0.) {
+            ok++;
+            setupOk.push_back(setupMs[i]);
+            describeMs.push_back(sessions[i]->getDescribeMs());
+        }
+    }
+    printf(
+        "%u of %u sessions playing after %.1f s\n",
+        ok, opt.clients, elapsedMs(setupStart, setupEnd) / 1000.);
+    fflush(stdout);
+
+    //
+    // keep them playing
+    //
+    std::this_thread::sleep_for(std::chrono::seconds(opt.duration));
+
+    auto holdEnd = Clock::now();
+    auto statHold = readProcessStat(opt.pid);
+    auto egressHold = readHostEgressPackets();
+
+    draining = false;
+    drainThread.join();
+
+    for (auto& s : sessions) {
+        if (s) {
+            s->teardown();
+        }
+    }
+    sessions.clear();
+    close(epfd);
+
+    //
+    // report
+    //
+    printf("\n");
+    printLatencies("session setup", setupOk);
+    printLatencies("DESCRIBE", describeMs);
+    printLatencies("first media packet", firstDataMs);
+    printLatencies("DESCRIBE to media", describeToDataMs);
+
+    std::vector<double> keyframeOk;
+    for (auto ms : keyframeMs) {
+        if (ms >= 0.) {
+            keyframeOk.push_back(ms);
+        }
+    }
+    printLatencies("first keyframe", keyframeOk);
+
+    double holdSec = elapsedMs(setupEnd, holdEnd) / 1000.;
+    printf(
+        "received %.1f MB, %.1f Mbit/s total while playing\n",
+        double(bytes) / 1e6,
+        holdSec > 0. ? double(bytes) * 8. / 1e6 / holdSec : 0.);
+    if (opt.transport != Transport::TCP && holdSec > 0.) {
+        printf(
+            "received %.0f pps, host egress %.0f pps (UDP + TCP)\n",
+            double(packets) / holdSec,
+            double(egressHold - egressSetup) / holdSec);
+    }
+    printf(
+        "failed %u, closed by server %u, no media %zu, no keyframe %zu\n",
+        opt.clients - ok,
+        closedByServer,
+        size_t(ok) - firstDataMs.size(),
+        size_t(ok) - keyframeOk.size());
+
+    printFailures(errors);
+
+    printCpu("setup", statStart, statSetup,
+        elapsedMs(setupStart, setupEnd) / 1000.);
+    printCpu("playing", statSetup, statHold, holdSec);
+
+    return ok == opt.clients ? 0 : 2;
+}
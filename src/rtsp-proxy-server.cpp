@@ -1,3 +1,6 @@
+#include <FrameTracer.hpp>
+#include <IngestBenchmark.hpp>
+#include <IngestWorker.hpp>
 #include <RtspServer.hpp>
 
 using namespace rtsp_proxy_server;
@@ -5,6 +8,32 @@ using namespace rtsp_proxy_server;
 int main(int argc, char** argv)
 {
     try {
+        // replaying files as fast as possible runs headless
+        auto config = (argc > 1) ?
+            std::make_shared<RtspProxyConfig>(argv[1]) :
+            std::make_shared<RtspProxyConfig>();
+        // tracing is set up before any thread records
+        auto const& trace = config->getTrace();
+        if (trace.enabled) {
+            FrameTracer::instance().enable(trace.eventsPerThread);
+        }
+
+        // started by the proxy to decode some of its cameras:
+        //   rtsp-proxy-server <config> --ingest-worker <index> <proxy pid>
+        if (argc > 4 && std::string(argv[2]) == IngestWorker::OPTION) {
+            IngestWorker worker(
+                config,
+                uint(std::stoul(argv[3])),
+                pid_t(std::stol(argv[4])));
+            return worker.run();
+        }
+
+        auto const& files = config->getFileIngest();
+        if (files.enabled && not files.realtime) {
+            IngestBenchmark benchmark(config);
+            return benchmark.run();
+        }
+
         // Run the server object
         RtspServer server(argc, argv);
         server.run();
@@ -0,0 +1,241 @@
+// System headers
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// STL headers
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+// Project headers
+#include <ShmFrameRing.hpp>
+
+//
+// Sample consumer of the shared memory frame output of the RTSP proxy.
+//
+// Maps a frame ring published with output_shm_enabled and reads the raw
+// frames in place: no RTSP session, no decoding, no copy. Reports the frame
+// rate, the age of the frames when they were picked up (the proxy stamps
+// them with CLOCK_MONOTONIC, shared by all processes of the host), the
+// frames skipped because a newer one was already there and the frames
+// overwritten while they were read. With -o the last intact frame is saved
+// as a PPM image when the consumer exits.
+//
+// The ring is opened again whenever the proxy replaces it, e.g. after a
+// restart or when a camera changed its resolution.
+//
+//   shm-frame-consumer -n /rtsp-proxy-mosaic -d 30 -o /tmp/mosaic.ppm
+//   shm-frame-consumer -n /rtsp-proxy-cam0
+//
+
+#define DEBUG_SHM_CONSUMER 0
+
+using namespace rtsp_proxy_server;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+using Seconds = std::chrono::duration<double>;
+
+/** poll interval while no new frame is there */
+const auto POLL_INTERVAL = std::chrono::milliseconds(1);
+
+/** retry interval while the ring doesn't exist */
+const auto OPEN_RETRY = std::chrono::milliseconds(500);
+
+volatile sig_atomic_t g_stop = 0;
+
+struct Options {
+    std::string name = "/rtsp-proxy-mosaic";
+    uint duration = 0;
+    std::string output;
+};
+
+/**
+ * \brief Statistics of one reporting interval
+ */
+struct Stats {
+    uint64_t frames = 0;
+    uint64_t torn = 0;
+    double ageSumMs = 0.;
+    double ageMaxMs = 0.;
+    uint64_t checksum = 0;
+};
+
+/**
+ * \brief Touch every byte of a frame, like a consumer using it would
+ */
+uint64_t
+sumFrame(ShmFrame const& frame)
+{
+    uint64_t sum = 0;
+    for (size_t i = 0; i < frame.size; i++) {
+        sum += frame.data[i];
+    }
+    return sum;
+}
+
+/**
+ * \brief Save a BGR frame as a binary PPM (RGB) image
+ */
+bool
+savePpm(
+    std::string const& path,
+    uint32_t width,
+    uint32_t height,
+    std::string const& bgr)
+{
+    FILE* f = fopen(path.c_str(), "wb");
+    if (not f) {
+        return false;
+    }
+    fprintf(f, "P6\n%u %u\n255\n", width, height);
+    std::string rgb(bgr);
+    for (size_t i = 0; i + 2 < rgb.size(); i += 3) {
+        std::swap(rgb[i], rgb[i + 2]);
+    }
+    bool ok = fwrite(rgb.data(), 1, rgb.size(), f) == rgb.size();
+    return fclose(f) == 0 && ok;
+}
+
+void
+usage(const char* name)
+{
+    fprintf(
+        stderr,
+        "usage: %s [-n shm_name] [-d duration_s] [-o last_frame.ppm]\n",
+        name);
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    Options opt;
+    int c = 0;
+    while ((c = getopt(argc, argv, "n:d:o:h")) != -1) {
+        switch (c) {
+            case 'n': opt.name = optarg; break;
+            case 'd': opt.duration = uint(strtoul(optarg, nullptr, 10)); break;
+            case 'o': opt.output = optarg; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+
+    signal(SIGINT, [](int) { g_stop = 1; });
+    signal(SIGTERM, [](int) { g_stop = 1; });
+
+    auto start = Clock::now();
+    auto lastReport = start;
+    std::unique_ptr<ShmFrameReader> reader;
+    Stats stats;
+    uint64_t skipped = 0;
+
+    // last intact frame, for -o
+    std::string last;
+    uint32_t lastWidth = 0;
+    uint32_t lastHeight = 0;
+
+    printf("Reading frames from '%s'\n", opt.name.c_str());
+    fflush(stdout);
+
+    while (not g_stop) {
+        auto now = Clock::now();
+        if (opt.duration > 0 &&
+            now - start >= std::chrono::seconds(opt.duration)) {
+            break;
+        }
+
+        if (now - lastReport >= std::chrono::seconds(1)) {
+            double interval = Seconds(now - lastReport).count();
+            printf(
+                "%.1f fps, age avg %.2f ms max %.2f ms, skipped %llu, "
+                "torn %llu\n",
+                double(stats.frames) / interval,
+                stats.frames ? stats.ageSumMs / double(stats.frames) : 0.,
+                stats.ageMaxMs,
+                static_cast<unsigned long long>(
+                    (reader ? reader->getSkipped() : 0) - skipped),
+                static_cast<unsigned long long>(stats.torn));
+            fflush(stdout);
+            skipped = reader ? reader->getSkipped() : 0;
+            stats = Stats();
+            lastReport = now;
+        }
+
+        if (reader && reader->isClosed()) {
+            printf("'%s' was closed, opening it again\n", opt.name.c_str());
+            fflush(stdout);
+            reader.reset();
+            skipped = 0;
+        }
+        if (not reader) {
+            try {
+                reader.reset(new ShmFrameReader(opt.name));
+            } catch (std::runtime_error const& e) {
+                #if DEBUG_SHM_CONSUMER
+                    fprintf(stderr, "%s\n", e.what());
+                #endif
+                std::this_thread::sleep_for(OPEN_RETRY);
+                continue;
+            }
+        }
+
+        ShmFrame frame;
+        if (not reader->next(frame)) {
+            std::this_thread::sleep_for(POLL_INTERVAL);
+            continue;
+        }
+
+        auto pickup = uint64_t(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                Clock::now().time_since_epoch()).count());
+        double ageMs = double(pickup - frame.ptsNs) / 1e6;
+
+        // use the frame in place, then check it wasn't overwritten meanwhile
+        auto sum = sumFrame(frame);
+        if (not reader->isIntact(frame)) {
+            stats.torn++;
+            continue;
+        }
+        stats.frames++;
+        stats.checksum += sum;
+        stats.ageSumMs += ageMs;
+        stats.ageMaxMs = std::max(stats.ageMaxMs, ageMs);
+
+        if (not opt.output.empty() && frame.format == SHM_FORMAT_BGR &&
+            frame.stride == frame.width * 3) {
+            last.assign(
+                reinterpret_cast<const char*>(frame.data), frame.size);
+            if (reader->isIntact(frame)) {
+                lastWidth = frame.width;
+                lastHeight = frame.height;
+            } else {
+                last.clear();
+            }
+        }
+    }
+
+    if (not opt.output.empty()) {
+        if (last.empty()) {
+            fprintf(stderr, "No frame to save\n");
+            return 1;
+        }
+        if (not savePpm(opt.output, lastWidth, lastHeight, last)) {
+            fprintf(stderr, "Failed to write '%s'\n", opt.output.c_str());
+            return 1;
+        }
+        printf(
+            "Last frame (%ux%u) saved to '%s'\n",
+            lastWidth,
+            lastHeight,
+            opt.output.c_str());
+    }
+    return 0;
+}